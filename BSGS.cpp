@@ -0,0 +1,664 @@
+/*
+ * This file is part of the VanitySearch distribution (https://github.com/JeanLucPons/VanitySearch).
+ * Copyright (c) 2019 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BSGS.h"
+#include "Vanity.h"
+#include "Timer.h"
+#include <math.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#ifndef WIN64
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+#define BSGS_HEADER_SIZE 64
+
+// Header of a table file, the table follows
+typedef struct {
+
+  char magic[8];
+  uint32_t version;
+  uint32_t complete;   // Set once all the baby steps are in
+  uint64_t m;
+  uint64_t size;       // Table entries
+
+} BSGS_HEADER;
+
+// ----------------------------------------------------------------------------
+
+BSGS::BSGS(Secp256K1 *secp, vector<string> &pubKeys, Int &rangeStart, Int &rangeEnd,
+           int babyBits, string tableFile, ResultWriter *writer, uint32_t statsInterval) {
+
+  this->secp = secp;
+  this->writer = writer;
+  this->statsInterval = statsInterval;
+  this->tableFile = tableFile;
+  this->table = NULL;
+  this->mapped = NULL;
+  this->mappedSize = 0;
+#ifdef WIN64
+  this->hFile = INVALID_HANDLE_VALUE;
+  this->hMap = NULL;
+#else
+  this->fd = -1;
+#endif
+  this->nbDone = 0;
+  this->endOfSearch = false;
+
+  // Full public keys, a key given twice is searched once
+  for (int i = 0; i < (int)pubKeys.size(); i++) {
+    bool isCompressed;
+    Point p = secp->ParsePublicKeyHex(pubKeys[i], isCompressed);
+    bool dup = false;
+    for (int j = 0; j < (int)keys.size() && !dup; j++)
+      dup = keys[j].x.IsEqual(&p.x) && keys[j].y.IsEqual(&p.y);
+    if (!dup) {
+      keys.push_back(p);
+      compressed.push_back(isCompressed);
+    }
+  }
+  if (keys.size() == 0) {
+    printf("Error: -bsgs needs at least one public key\n");
+    exit(-1);
+  }
+  found = new atomic<bool>[keys.size()];
+  for (int i = 0; i < (int)keys.size(); i++)
+    found[i] = false;
+  nbLeft = (int)keys.size();
+
+  // Key 0 has no public key, the point at infinity is never matched
+  if (rangeEnd.IsZero() || rangeStart.IsZero() || rangeStart.IsGreater(&rangeEnd) || rangeEnd.IsGreaterOrEqual(&secp->order)) {
+    printf("Error: -bsgs needs a range (-rg), start at least 1 and lower or equal to end, end lower than the curve order\n");
+    exit(-1);
+  }
+  this->rangeStart.Set(&rangeStart);
+  this->rangeEnd.Set(&rangeEnd);
+  rangeSize.Set(&rangeEnd);
+  rangeSize.Sub(&rangeStart);
+  rangeSize.AddOne();
+
+  // About sqrt(W.T/2) baby steps balance the table and the giant steps of
+  // T keys, power of 2 and not more than the range needs
+  double w = rangeSize.ToDouble();
+  if (babyBits > 0) {
+    m = (babyBits >= BSGS_MAX_BITS) ? 0xFFFFFFFFULL : (1ULL << babyBits);
+  } else {
+    int bits = (int)ceil(log2(sqrt(w * (double)keys.size() / 2.0)));
+    if (bits < 1)
+      bits = 1;
+    if (bits > BSGS_AUTO_BITS)
+      bits = BSGS_AUTO_BITS;
+    m = 1ULL << bits;
+  }
+  Int half(&rangeSize);
+  half.ShiftR(1);
+  half.AddOne();
+  if (half.GetBitLength() <= 32 && half.bits64[0] < m)
+    m = half.bits64[0];
+
+  // Giant steps covering the range, 2m+1 keys each
+  Int step((uint64_t)(2 * m + 1));
+  Int q(&rangeSize);
+  Int r;
+  q.Div(&step, &r);
+  if (!r.IsZero())
+    q.AddOne();
+  if (q.GetBitLength() > 62) {
+    printf("Error: range too large for 2^%.2f baby steps (more than 2^62 giant steps), use -bsgsm\n", log2((double)m));
+    exit(-1);
+  }
+  nbGiant = q.bits64[0];
+
+  tableMask = 1;
+  while (tableMask < 2 * m)
+    tableMask <<= 1;
+  tableMask--;
+
+}
+
+BSGS::~BSGS() {
+
+  freeTable();
+  delete[] found;
+
+}
+
+// ----------------------------------------------------------------------------
+
+bool BSGS::allocTable() {
+
+  // True when a complete table of the same size is found in the table file
+  uint64_t size = tableMask + 1;
+
+  if (tableFile.length() == 0) {
+    table = (uint64_t *)calloc(size, sizeof(uint64_t));
+    if (table == NULL) {
+      printf("Error: cannot allocate %.1f MB for the baby steps, use -bsgsm or -bsgsfile\n",
+        (double)(size * sizeof(uint64_t)) / (1024.0 * 1024.0));
+      exit(-1);
+    }
+    return false;
+  }
+
+  mappedSize = BSGS_HEADER_SIZE + size * sizeof(uint64_t);
+
+#ifdef WIN64
+
+  hFile = CreateFileA(tableFile.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS,
+    FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hFile == INVALID_HANDLE_VALUE) {
+    printf("Error: cannot open %s (error %d)\n", tableFile.c_str(), (int)GetLastError());
+    exit(-1);
+  }
+  LARGE_INTEGER fileSize;
+  GetFileSizeEx(hFile, &fileSize);
+  bool existing = fileSize.QuadPart > 0;
+  bool sameSize = (uint64_t)fileSize.QuadPart == (uint64_t)mappedSize;
+  if (!sameSize) {
+    // Truncated then extended, zero filled
+    LARGE_INTEGER pos;
+    pos.QuadPart = 0;
+    SetFilePointerEx(hFile, pos, NULL, FILE_BEGIN);
+    SetEndOfFile(hFile);
+    pos.QuadPart = (LONGLONG)mappedSize;
+    if (!SetFilePointerEx(hFile, pos, NULL, FILE_BEGIN) || !SetEndOfFile(hFile)) {
+      printf("Error: cannot resize %s (error %d)\n", tableFile.c_str(), (int)GetLastError());
+      exit(-1);
+    }
+  }
+  hMap = CreateFileMappingA(hFile, NULL, PAGE_READWRITE, (DWORD)(mappedSize >> 32), (DWORD)mappedSize, NULL);
+  if (hMap != NULL)
+    mapped = (uint8_t *)MapViewOfFile(hMap, FILE_MAP_ALL_ACCESS, 0, 0, mappedSize);
+  if (mapped == NULL) {
+    printf("Error: cannot map %s (error %d)\n", tableFile.c_str(), (int)GetLastError());
+    exit(-1);
+  }
+
+#else
+
+  fd = open(tableFile.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    printf("Error: cannot open %s: %s\n", tableFile.c_str(), strerror(errno));
+    exit(-1);
+  }
+  struct stat st;
+  bool existing = fstat(fd, &st) == 0 && st.st_size > 0;
+  bool sameSize = existing && (uint64_t)st.st_size == (uint64_t)mappedSize;
+  if (!sameSize) {
+    // Truncated then extended, zero filled
+    if (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)mappedSize) != 0) {
+      printf("Error: cannot resize %s: %s\n", tableFile.c_str(), strerror(errno));
+      exit(-1);
+    }
+  }
+  void *p = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) {
+    printf("Error: cannot map %s: %s\n", tableFile.c_str(), strerror(errno));
+    exit(-1);
+  }
+  mapped = (uint8_t *)p;
+
+#endif
+
+  table = (uint64_t *)(mapped + BSGS_HEADER_SIZE);
+  BSGS_HEADER *h = (BSGS_HEADER *)mapped;
+  if (sameSize && memcmp(h->magic, "VSBSGS", 6) == 0 && h->version == BSGS_VERSION &&
+      h->m == m && h->size == size && h->complete)
+    return true;
+
+  // Incomplete or other size, built again. The automatic size depends on
+  // the range and the keys, a table is reused with an explicit -bsgsm.
+  if (existing)
+    printf("Warning: %s holds other or incomplete baby steps, built again for 2^%.2f baby steps\n",
+      tableFile.c_str(), log2((double)m));
+  if (sameSize)
+    memset(mapped, 0, mappedSize);
+  memcpy(h->magic, "VSBSGS", 6);
+  h->version = BSGS_VERSION;
+  h->complete = 0;
+  h->m = m;
+  h->size = size;
+  return false;
+
+}
+
+void BSGS::freeTable() {
+
+  if (mapped == NULL) {
+    free(table);
+    table = NULL;
+    return;
+  }
+
+#ifdef WIN64
+  UnmapViewOfFile(mapped);
+  CloseHandle(hMap);
+  CloseHandle(hFile);
+#else
+  munmap(mapped, mappedSize);
+  close(fd);
+#endif
+  mapped = NULL;
+  table = NULL;
+
+}
+
+// ----------------------------------------------------------------------------
+
+void BSGS::insert(Int *x, uint32_t j) {
+
+  // Low 64 bits of x for the slot, the next 32 bits as fingerprint
+  uint64_t e = ((uint64_t)(uint32_t)x->bits64[1] << 32) | j;
+  uint64_t h = x->bits64[0] & tableMask;
+#ifdef WIN64
+  while (InterlockedCompareExchange64((volatile LONG64 *)(table + h), (LONG64)e, 0) != 0)
+#else
+  while (!__sync_bool_compare_and_swap(table + h, 0, e))
+#endif
+    h = (h + 1) & tableMask;
+
+}
+
+uint32_t BSGS::lookup(Int *x, uint64_t &h) {
+
+  // j of the next entry matching the fingerprint of x from slot h (first
+  // call with the slot of x), 0 at the end of the chain. h is moved after it.
+  uint32_t fp = (uint32_t)x->bits64[1];
+  uint64_t e;
+  while ((e = table[h]) != 0) {
+    h = (h + 1) & tableMask;
+    if ((uint32_t)(e >> 32) == fp)
+      return (uint32_t)e;
+  }
+  return 0;
+
+}
+
+// ----------------------------------------------------------------------------
+
+void BSGS::addGroup(Point *pts, int n, Point &s, Int *dx, IntGroup *grp) {
+
+  // pts[i] += s, one inversion for the group. A point equal to s is doubled,
+  // a point equal to -s becomes the point at infinity (cleared).
+  for (int i = 0; i < n; i++) {
+    dx[i].ModSub(&s.x, &pts[i].x);
+    if (dx[i].IsZero())
+      dx[i].SetInt32(1);
+  }
+  grp->ModInv();
+
+  Int dy;
+  Int _s;
+  Int _p;
+  for (int i = 0; i < n; i++) {
+
+    if (pts[i].x.IsEqual(&s.x)) {
+      if (pts[i].y.IsEqual(&s.y))
+        pts[i] = secp->DoubleDirect(s);
+      else
+        pts[i].Clear();
+      continue;
+    }
+
+    dy.ModSub(&s.y, &pts[i].y);
+    _s.ModMulK1(&dy, &dx[i]);       // s = (p2.y-p1.y)*inverse(p2.x-p1.x);
+    _p.ModSquareK1(&_s);            // _p = pow2(s)
+
+    pts[i].x.ModNeg();
+    pts[i].x.ModAdd(&_p);
+    pts[i].x.ModSub(&s.x);          // rx = pow2(s) - p1.x - p2.x;
+
+    pts[i].y.ModSub(&s.x, &pts[i].x);
+    pts[i].y.ModMulK1(&_s);
+    pts[i].y.ModSub(&s.y);          // ry = - p2.y - s*(ret.x-p2.x);
+
+  }
+
+}
+
+// ----------------------------------------------------------------------------
+
+void BSGS::getCenter(uint64_t i, Int &c) {
+
+  // c = a + m + i.(2m+1)
+  c.SetInt32(0);
+  c.Add((uint64_t)(2 * m + 1));
+  c.Mult(i);
+  c.Add(&rangeStart);
+  c.Add(m);
+
+}
+
+void BSGS::checkKey(int t, Int &k) {
+
+  if (k.IsLower(&rangeStart) || k.IsGreater(&rangeEnd))
+    return;
+  Point p = secp->ComputePublicKey(&k);
+  if (!p.x.IsEqual(&keys[t].x) || !p.y.IsEqual(&keys[t].y))
+    return;
+
+  // Reported once
+  if (found[t].exchange(true))
+    return;
+  writer->write(PUBKEY, secp->GetPublicKeyHex(compressed[t], keys[t]),
+    secp->GetPrivAddress(compressed[t], k), k.GetBase16(), false);
+  if (--nbLeft == 0)
+    endOfSearch = true;
+
+}
+
+void BSGS::checkCandidates(int t, Int &c, uint64_t d) {
+
+  // Same x for k = c + d and k = c - d
+  Int k(&c);
+  k.Add(d);
+  checkKey(t, k);
+  Int dd(d);
+  if (c.IsGreaterOrEqual(&dd)) {
+    k.Set(&c);
+    k.Sub(d);
+    checkKey(t, k);
+  }
+
+}
+
+// ----------------------------------------------------------------------------
+
+void BSGS::BabyThread(BSGS_PARAM *ph) {
+
+  // Baby steps j.G, start <= j < end, in n interleaved streams
+  uint64_t len = ph->end - ph->start;
+  int n = (len < BSGS_GRP_SIZE) ? (int)len : BSGS_GRP_SIZE;
+  if (n == 0) {
+    ph->isRunning = false;
+    return;
+  }
+
+  vector<Int> k(n);
+  vector<Point> pts;
+  for (int i = 0; i < n; i++) {
+    k[i].SetInt32(0);
+    k[i].Add(ph->start + i);
+  }
+  secp->ComputePublicKeys(k, pts);
+  Int ns((uint64_t)n);
+  Point s = secp->ComputePublicKey(&ns);
+
+  Int *dx = new Int[n];
+  IntGroup *grp = new IntGroup(n);
+  grp->Set(dx);
+
+  for (uint64_t base = ph->start; base < ph->end && !endOfSearch; base += n) {
+    int nb = (ph->end - base < (uint64_t)n) ? (int)(ph->end - base) : n;
+    for (int i = 0; i < nb; i++)
+      insert(&pts[i].x, (uint32_t)(base + i));
+    nbDone += nb;
+    if (base + n < ph->end)
+      addGroup(pts.data(), n, s, dx, grp);
+  }
+
+  delete grp;
+  delete[] dx;
+  ph->isRunning = false;
+
+}
+
+void BSGS::GiantThread(BSGS_PARAM *ph) {
+
+  // Giant steps [start,end) in nbStream interleaved streams per key, the
+  // points of all the keys added to -(nbStream.(2m+1)).G together
+  int nbKey = (int)keys.size();
+  uint64_t len = ph->end - ph->start;
+  int nbStream = BSGS_GRP_SIZE / nbKey;
+  if (nbStream < 1)
+    nbStream = 1;
+  if ((uint64_t)nbStream > len)
+    nbStream = (int)len;
+  if (nbStream == 0) {
+    ph->isRunning = false;
+    return;
+  }
+  int n = nbKey * nbStream;
+
+  // Q - c.G for the first center of each stream, a center equal to the key
+  // is checked here
+  vector<Int> c(nbStream);
+  vector<Point> cp;
+  for (int i = 0; i < nbStream; i++)
+    getCenter(ph->start + i, c[i]);
+  secp->ComputePublicKeys(c, cp);
+
+  Point *pts = new Point[n];
+  for (int t = 0; t < nbKey; t++) {
+    for (int i = 0; i < nbStream; i++) {
+      Point &p = pts[t * nbStream + i];
+      if (cp[i].x.IsEqual(&keys[t].x)) {
+        checkKey(t, c[i]);
+        if (cp[i].y.IsEqual(&keys[t].y))
+          p.Clear();
+        else
+          p = secp->DoubleDirect(keys[t]);
+      } else {
+        Point nc(cp[i]);
+        nc.y.ModNeg();
+        p = secp->AddDirect(keys[t], nc);
+      }
+    }
+  }
+
+  uint64_t stride = (uint64_t)nbStream * (2 * m + 1);
+  Int si(stride);
+  Point s = secp->ComputePublicKey(&si);
+  s.y.ModNeg();
+
+  Int *dx = new Int[n];
+  IntGroup *grp = new IntGroup(n);
+  grp->Set(dx);
+  Int center;
+
+  for (uint64_t base = ph->start; base < ph->end && !endOfSearch; base += nbStream) {
+
+    int nb = (ph->end - base < (uint64_t)nbStream) ? (int)(ph->end - base) : nbStream;
+
+    for (int t = 0; t < nbKey; t++) {
+
+      if (found[t])
+        continue;
+
+      for (int i = 0; i < nb; i++) {
+
+        Point &p = pts[t * nbStream + i];
+        uint64_t h = p.x.bits64[0] & tableMask;
+        uint32_t j;
+        while ((j = lookup(&p.x, h)) != 0) {
+          getCenter(base + i, center);
+          checkCandidates(t, center, j);
+        }
+
+        // Next center of the stream is the key
+        if (p.x.IsEqual(&s.x)) {
+          getCenter(base + i, center);
+          checkCandidates(t, center, stride);
+        }
+
+      }
+
+    }
+
+    nbDone += nb;
+    if (base + nbStream < ph->end)
+      addGroup(pts, n, s, dx, grp);
+
+  }
+
+  delete grp;
+  delete[] dx;
+  delete[] pts;
+  ph->isRunning = false;
+
+}
+
+// ----------------------------------------------------------------------------
+
+#ifdef WIN64
+DWORD WINAPI _BabyThread(LPVOID lpParam) {
+#else
+void *_BabyThread(void *lpParam) {
+#endif
+  BSGS_PARAM *p = (BSGS_PARAM *)lpParam;
+  p->obj->BabyThread(p);
+  return 0;
+}
+
+#ifdef WIN64
+DWORD WINAPI _GiantThread(LPVOID lpParam) {
+#else
+void *_GiantThread(void *lpParam) {
+#endif
+  BSGS_PARAM *p = (BSGS_PARAM *)lpParam;
+  p->obj->GiantThread(p);
+  return 0;
+}
+
+void BSGS::runThreads(int nbThread, uint64_t first, uint64_t total, bool baby) {
+
+  // [first,first+total) split between the threads, stats until they end
+  BSGS_PARAM *params = new BSGS_PARAM[nbThread];
+  vector<THREAD_HANDLE> th(nbThread);
+
+  nbDone = 0;
+  uint64_t part = total / nbThread;
+  uint64_t left = total % nbThread;
+  uint64_t pos = first;
+  for (int i = 0; i < nbThread; i++) {
+    params[i].obj = this;
+    params[i].threadId = i;
+    params[i].start = pos;
+    pos += part + (((uint64_t)i < left) ? 1 : 0);
+    params[i].end = pos;
+    params[i].isRunning = true;
+    th[i] = launchThread(baby ? _BabyThread : _GiantThread, (void *)(params + i));
+  }
+
+  double t0 = Timer::get_tick();
+  double tStats = t0;
+  uint64_t lastCount = 0;
+  bool running = true;
+  while (running) {
+
+    Timer::SleepMillis(50);
+    running = false;
+    for (int i = 0; i < nbThread; i++)
+      running = running || params[i].isRunning;
+
+    double t1 = Timer::get_tick();
+    if (t1 - tStats < statsInterval / 1000.0 && running)
+      continue;
+
+    uint64_t count = nbDone;
+    double rate = (double)(count - lastCount) / (t1 - tStats);
+    if (baby) {
+      printf("\r[Baby steps %.2f%%][%.2f Mstep/s]  ", 100.0 * (double)count / (double)total, rate / 1000000.0);
+    } else {
+      // Keys covered per giant step and key
+      double keyRate = rate * (double)(2 * m + 1);
+      printf("\r[%.2f Mgiant/s][2^%.2f key/s][Range %.2f%%][Found %d/%d]  ", rate / 1000000.0,
+        (keyRate > 0.0) ? log2(keyRate) : 0.0, 100.0 * (double)count / (double)total,
+        (int)keys.size() - (int)nbLeft, (int)keys.size());
+    }
+    fflush(stdout);
+    lastCount = count;
+    tStats = t1;
+
+  }
+
+  for (int i = 0; i < nbThread; i++)
+    joinThread(th[i]);
+  delete[] params;
+  printf("\n");
+
+}
+
+// ----------------------------------------------------------------------------
+
+// Called by the flush thread of the writer on SIGINT/SIGTERM
+static void _Interrupt(int sig, void *arg) {
+  BSGS *b = (BSGS *)arg;
+  b->Interrupt();
+}
+
+void BSGS::Interrupt() {
+  endOfSearch = true;
+}
+
+void BSGS::Search(int nbThread) {
+
+  if (nbThread < 1)
+    nbThread = 1;
+
+  uint64_t size = tableMask + 1;
+  printf("BSGS: %d key%s, range %s:%s (2^%.2f keys)\n", (int)keys.size(), (keys.size() > 1) ? "s" : "",
+    rangeStart.GetBase16().c_str(), rangeEnd.GetBase16().c_str(), log2(rangeSize.ToDouble()));
+  printf("BSGS: 2^%.2f baby steps (%.1f MB%s%s), 2^%.2f giant steps, %d thread%s\n", log2((double)m),
+    (double)(size * sizeof(uint64_t)) / (1024.0 * 1024.0), tableFile.length() > 0 ? " in " : "",
+    tableFile.c_str(), log2((double)nbGiant), nbThread, (nbThread > 1) ? "s" : "");
+
+  ResultWriter::setInterruptHandler(_Interrupt, (void *)this);
+
+  double t0 = Timer::get_tick();
+  if (allocTable()) {
+    printf("BSGS: baby steps read from %s\n", tableFile.c_str());
+  } else {
+    runThreads(nbThread, 1, m, true);
+    if (endOfSearch) {
+      // Incomplete table, built again by the next run
+      printf("BSGS: interrupted\n");
+      ResultWriter::setInterruptHandler(NULL, NULL);
+      writer->close();
+      return;
+    }
+    if (mapped) {
+      // Table written before it is marked complete
+#ifdef WIN64
+      FlushViewOfFile(mapped, mappedSize);
+      FlushFileBuffers(hFile);
+      ((BSGS_HEADER *)mapped)->complete = 1;
+      FlushViewOfFile(mapped, BSGS_HEADER_SIZE);
+#else
+      msync(mapped, mappedSize, MS_SYNC);
+      ((BSGS_HEADER *)mapped)->complete = 1;
+      msync(mapped, BSGS_HEADER_SIZE, MS_SYNC);
+#endif
+    }
+    printf("BSGS: baby steps done in %.1f s\n", Timer::get_tick() - t0);
+  }
+
+  t0 = Timer::get_tick();
+  runThreads(nbThread, 0, nbGiant, false);
+  printf("BSGS: %d/%d key%s found in %.1f s\n", (int)keys.size() - (int)nbLeft, (int)keys.size(),
+    (keys.size() > 1) ? "s" : "", Timer::get_tick() - t0);
+
+  ResultWriter::setInterruptHandler(NULL, NULL);
+  writer->close();
+
+}
@@ -0,0 +1,117 @@
+/*
+ * This file is part of the VanitySearch distribution (https://github.com/JeanLucPons/VanitySearch).
+ * Copyright (c) 2019 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BSGSH
+#define BSGSH
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+#include "SECP256k1.h"
+#include "IntGroup.h"
+#include "ResultWriter.h"
+#ifdef WIN64
+#include <Windows.h>
+#endif
+
+#define BSGS_VERSION 1
+#define BSGS_GRP_SIZE 256      // Points sharing one inversion
+#define BSGS_MAX_BITS 32       // Baby step index stored on 32 bits
+#define BSGS_AUTO_BITS 24      // Automatic size limit, 2^24 baby steps (256MB table)
+
+class BSGS;
+
+typedef struct {
+
+  BSGS *obj;
+  int threadId;
+  uint64_t start;          // Baby steps [start,end) or giant steps [start,end)
+  uint64_t end;
+  std::atomic<bool> isRunning;
+
+} BSGS_PARAM;
+
+// Baby-step giant-step search of known public keys in a range [a,b].
+// The table holds the x fingerprints of j.G, 1 <= j <= m, and giant steps
+// Q - c.G are taken at centers c = a + m + i.(2m+1), so that a match of
+// x(Q - c.G) = x(j.G) gives k = c +/- j. A center itself is checked when
+// the point is computed. Each key is verified before being reported.
+class BSGS {
+
+public:
+
+  // babyBits <= 0 for an automatic size. The table is kept in tableFile
+  // (memory mapped) when given, and reused by the next runs with the same size.
+  BSGS(Secp256K1 *secp, std::vector<std::string> &pubKeys, Int &rangeStart, Int &rangeEnd,
+       int babyBits, std::string tableFile, ResultWriter *writer, uint32_t statsInterval);
+  ~BSGS();
+
+  void Search(int nbThread);
+  void Interrupt();
+
+  void BabyThread(BSGS_PARAM *p);
+  void GiantThread(BSGS_PARAM *p);
+
+private:
+
+  bool allocTable();
+  void freeTable();
+  void insert(Int *x, uint32_t j);
+  uint32_t lookup(Int *x, uint64_t &h);
+  void addGroup(Point *pts, int n, Point &s, Int *dx, IntGroup *grp);
+  void checkKey(int t, Int &k);
+  void checkCandidates(int t, Int &c, uint64_t d);
+  void getCenter(uint64_t i, Int &c);
+  void runThreads(int nbThread, uint64_t first, uint64_t total, bool baby);
+
+  Secp256K1 *secp;
+  ResultWriter *writer;
+  uint32_t statsInterval;
+
+  // Targets
+  std::vector<Point> keys;
+  std::vector<bool> compressed;
+  std::atomic<bool> *found;
+  std::atomic<int> nbLeft;
+
+  // Range
+  Int rangeStart;
+  Int rangeEnd;
+  Int rangeSize;
+
+  // Baby steps and table, open addressing, entry = fingerprint << 32 | j
+  uint64_t m;
+  uint64_t nbGiant;
+  std::string tableFile;
+  uint64_t *table;
+  uint64_t tableMask;
+  uint8_t *mapped;       // File mapping (header + table)
+  size_t mappedSize;
+#ifdef WIN64
+  HANDLE hFile;
+  HANDLE hMap;
+#else
+  int fd;
+#endif
+
+  std::atomic<uint64_t> nbDone;     // Baby or giant steps done
+  std::atomic<bool> endOfSearch;
+
+};
+
+#endif // BSGSH
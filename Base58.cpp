@@ -16,6 +16,7 @@
 */
 
 #include "Base58.h"
+#include "Int.h"
 
 #include <algorithm>
 #include <string.h>
@@ -123,6 +124,138 @@ std::string EncodeBase58(const unsigned char* pbegin, const unsigned char* pend)
 
 }
 
+// 58^10 (largest power of 58 below 2^64) normalized: D = 58^10 << 5
+// Division by invariant integer (Moller-Granlund), V = floor((2^128-1)/D) - 2^64
+#define B58_SHIFT 5
+#define B58_D 0xBF50C498FF748000ULL
+#define B58_V 0x568DF8B76CBF212CULL
+
+// (u1:u0) / D, u1 < D
+static inline uint64_t divB58(uint64_t u1, uint64_t u0, uint64_t *r) {
+
+  uint64_t qh;
+  uint64_t ql = _umul128(B58_V, u1, &qh);
+  ql += u0;
+  qh += u1 + 1 + (ql < u0);
+  uint64_t rr = u0 - qh * B58_D;
+  if (rr > ql) {
+    qh--;
+    rr += B58_D;
+  }
+  if (rr >= B58_D) {
+    qh++;
+    rr -= B58_D;
+  }
+  *r = rr;
+  return qh;
+
+}
+
+// V / 58^10, V = 200 bits (4 x 64 bits limbs, big endian), returns V mod 58^10
+static inline uint64_t divStep(uint64_t *n) {
+
+  uint64_t r = 0;
+  uint64_t m[4];
+  m[0] = (n[0] << B58_SHIFT) | (n[1] >> (64 - B58_SHIFT));
+  m[1] = (n[1] << B58_SHIFT) | (n[2] >> (64 - B58_SHIFT));
+  m[2] = (n[2] << B58_SHIFT) | (n[3] >> (64 - B58_SHIFT));
+  m[3] = (n[3] << B58_SHIFT);
+  for (int i = 0; i < 4; i++)
+    n[i] = divB58(r, m[i], &r);
+  return r >> B58_SHIFT;
+
+}
+
+// V = 200 bits payload, 4 x 64 bits limbs (big endian)
+static inline void loadPayload(const unsigned char *payload, uint64_t *n) {
+
+  n[0] = payload[0];
+  for (int i = 0; i < 3; i++) {
+    uint64_t l = 0;
+    for (int j = 0; j < 8; j++)
+      l = (l << 8) | payload[1 + 8 * i + j];
+    n[i + 1] = l;
+  }
+
+}
+
+// Digits (little endian, radix 58^10 chunks) to string
+static inline int writeAddress(const unsigned char *payload, uint64_t *chunk, char *buff) {
+
+  // Each chunk is split in two 58^5 halves (32 bits arithmetic)
+  unsigned char digits[40];
+  for (int c = 0; c < 4; c++) {
+    uint32_t h[2];
+    h[0] = (uint32_t)(chunk[c] % 656356768ULL);
+    h[1] = (uint32_t)(chunk[c] / 656356768ULL);
+    for (int k = 0; k < 2; k++) {
+      uint32_t v = h[k];
+      for (int j = 0; j < 5; j++) {
+        digits[c * 10 + k * 5 + j] = (unsigned char)(v % 58);
+        v /= 58;
+      }
+    }
+  }
+
+  int length = 0;
+  int zeroes = 0;
+  while (zeroes < 25 && payload[zeroes] == 0) {
+    buff[length++] = '1';
+    zeroes++;
+  }
+
+  int top = 39;
+  while (top > 0 && digits[top] == 0)
+    top--;
+  // EncodeBase58() outputs one digit when nothing remains after the zeroes
+  for (int i = top; i >= 0; i--)
+    buff[length++] = pszBase58[digits[i]];
+  buff[length] = 0;
+
+  return length;
+
+}
+
+int EncodeBase58Address(const unsigned char *payload, char *buff) {
+
+  uint64_t n[4];
+  uint64_t chunk[4];
+
+  loadPayload(payload, n);
+
+  // 58^40 > 2^200, 4 divisions by 58^10
+  for (int c = 0; c < 4; c++)
+    chunk[c] = divStep(n);
+
+  return writeAddress(payload, chunk, buff);
+
+}
+
+void EncodeBase58Address(const unsigned char *p1, const unsigned char *p2, const unsigned char *p3, const unsigned char *p4,
+                         char *b1, char *b2, char *b3, char *b4) {
+
+  // No SIMD 64 bits multiplication, the 4 independent division chains
+  // are interleaved to overlap their latency
+  const unsigned char *p[4] = { p1,p2,p3,p4 };
+  char *b[4] = { b1,b2,b3,b4 };
+  uint64_t n[4][4];
+  uint64_t chunk[4][4];
+
+  for (int k = 0; k < 4; k++)
+    loadPayload(p[k], n[k]);
+
+  for (int c = 0; c < 4; c++) {
+    chunk[0][c] = divStep(n[0]);
+    chunk[1][c] = divStep(n[1]);
+    chunk[2][c] = divStep(n[2]);
+    chunk[3][c] = divStep(n[3]);
+  }
+
+  for (int k = 0; k < 4; k++)
+    writeAddress(p[k], chunk[k], b[k]);
+
+}
+
 std::string EncodeBase58(const std::vector<unsigned char>& vch)
 {
     return EncodeBase58(vch.data(), vch.data() + vch.size());
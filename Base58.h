@@ -32,6 +32,19 @@ std::string EncodeBase58(const unsigned char* pbegin, const unsigned char* pend)
  */
 std::string EncodeBase58(const std::vector<unsigned char>& vch);
 
+/**
+ * Encode a 25 bytes Base58Check payload (P2PKH/P2SH address) into buff
+ * (at least 36 bytes, null terminated) and return the string length.
+ * Same output as EncodeBase58().
+ */
+int EncodeBase58Address(const unsigned char *payload, char *buff);
+
+/**
+ * 4-way version of EncodeBase58Address()
+ */
+void EncodeBase58Address(const unsigned char *p1, const unsigned char *p2, const unsigned char *p3, const unsigned char *p4,
+                         char *b1, char *b2, char *b3, char *b4);
+
 /**
  * Decode a base58-encoded string (psz) into a byte vector (vchRet).
  * return true if decoding is successful.
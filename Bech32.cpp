@@ -35,6 +35,12 @@ uint32_t bech32_polymod_step(uint32_t pre) {
     (-((b >> 4) & 1) & 0x2a1462b3UL);
 }
 
+static uint32_t bech32_final_constant(bech32_encoding enc) {
+  if (enc == BECH32_ENCODING_BECH32) return 1;
+  if (enc == BECH32_ENCODING_BECH32M) return 0x2bc830a3;
+  return 0;
+}
+
 static const char* charset = "qpzry9x8gf2tvdw0s3jn54khce6mua7l";
 
 static const int8_t charset_rev[128] = {
@@ -48,7 +54,7 @@ static const int8_t charset_rev[128] = {
      1,  0,  3, 16, 11, 28, 12, 14,  6,  4,  2, -1, -1, -1, -1, -1
 };
 
-int bech32_encode(char *output, const char *hrp, const uint8_t *data, size_t data_len) {
+int bech32_encode(char *output, const char *hrp, const uint8_t *data, size_t data_len, bech32_encoding enc) {
   uint32_t chk = 1;
   size_t i = 0;
   while (hrp[i] != 0) {
@@ -76,7 +82,7 @@ int bech32_encode(char *output, const char *hrp, const uint8_t *data, size_t dat
   for (i = 0; i < 6; ++i) {
     chk = bech32_polymod_step(chk);
   }
-  chk ^= 1;
+  chk ^= bech32_final_constant(enc);
   for (i = 0; i < 6; ++i) {
     *(output++) = charset[(chk >> ((5 - i) * 5)) & 0x1f];
   }
@@ -119,14 +125,14 @@ int bech32_decode_nocheck(uint8_t *data, size_t *data_len, const char *input) {
 
 }
 
-int bech32_decode(char* hrp, uint8_t *data, size_t *data_len, const char *input) {
+bech32_encoding bech32_decode(char* hrp, uint8_t *data, size_t *data_len, const char *input) {
   uint32_t chk = 1;
   size_t i;
   size_t input_len = strlen(input);
   size_t hrp_len;
   int have_lower = 0, have_upper = 0;
   if (input_len < 8 || input_len > 90) {
-    return 0;
+    return BECH32_ENCODING_NONE;
   }
   *data_len = 0;
   while (*data_len < input_len && input[(input_len - 1) - *data_len] != '1') {
@@ -134,13 +140,13 @@ int bech32_decode(char* hrp, uint8_t *data, size_t *data_len, const char *input)
   }
   hrp_len = input_len - (1 + *data_len);
   if (1 + *data_len >= input_len || *data_len < 6) {
-    return 0;
+    return BECH32_ENCODING_NONE;
   }
   *(data_len) -= 6;
   for (i = 0; i < hrp_len; ++i) {
     int ch = input[i];
     if (ch < 33 || ch > 126) {
-      return 0;
+      return BECH32_ENCODING_NONE;
     }
     if (ch >= 'a' && ch <= 'z') {
       have_lower = 1;
@@ -162,7 +168,7 @@ int bech32_decode(char* hrp, uint8_t *data, size_t *data_len, const char *input)
     if (input[i] >= 'a' && input[i] <= 'z') have_lower = 1;
     if (input[i] >= 'A' && input[i] <= 'Z') have_upper = 1;
     if (v == -1) {
-      return 0;
+      return BECH32_ENCODING_NONE;
     }
     chk = bech32_polymod_step(chk) ^ v;
     if (i + 6 < input_len) {
@@ -171,9 +177,15 @@ int bech32_decode(char* hrp, uint8_t *data, size_t *data_len, const char *input)
     ++i;
   }
   if (have_lower && have_upper) {
-    return 0;
+    return BECH32_ENCODING_NONE;
+  }
+  if (chk == bech32_final_constant(BECH32_ENCODING_BECH32)) {
+    return BECH32_ENCODING_BECH32;
+  } else if (chk == bech32_final_constant(BECH32_ENCODING_BECH32M)) {
+    return BECH32_ENCODING_BECH32M;
+  } else {
+    return BECH32_ENCODING_NONE;
   }
-  return chk == 1;
 }
 
 static int convert_bits(uint8_t* out, size_t* outlen, int outbits, const uint8_t* in, size_t inlen, int inbits, int pad) {
@@ -207,17 +219,20 @@ int segwit_addr_encode(char *output, const char *hrp, int witver, const uint8_t
   data[0] = witver;
   convert_bits(data + 1, &datalen, 5, witprog, witprog_len, 8, 1);
   ++datalen;
-  return bech32_encode(output, hrp, data, datalen);
+  return bech32_encode(output, hrp, data, datalen, (witver == 0) ? BECH32_ENCODING_BECH32 : BECH32_ENCODING_BECH32M);
 }
 
 int segwit_addr_decode(int* witver, uint8_t* witdata, size_t* witdata_len, const char* hrp, const char* addr) {
   uint8_t data[84];
   char hrp_actual[84];
   size_t data_len;
-  if (!bech32_decode(hrp_actual, data, &data_len, addr)) return 0;
+  bech32_encoding enc = bech32_decode(hrp_actual, data, &data_len, addr);
+  if (enc == BECH32_ENCODING_NONE) return 0;
   if (data_len == 0 || data_len > 65) return 0;
   if (strncmp(hrp, hrp_actual, 84) != 0) return 0;
   if (data[0] > 16) return 0;
+  if (data[0] == 0 && enc != BECH32_ENCODING_BECH32) return 0;
+  if (data[0] != 0 && enc != BECH32_ENCODING_BECH32M) return 0;
   *witdata_len = 0;
   if (!convert_bits(witdata, witdata_len, 8, data + 1, data_len - 1, 5, 0)) return 0;
   if (*witdata_len < 2 || *witdata_len > 40) return 0;
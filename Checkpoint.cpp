@@ -0,0 +1,284 @@
+/*
+ * This file is part of the VanitySearch distribution (https://github.com/JeanLucPons/VanitySearch).
+ * Copyright (c) 2019 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Checkpoint.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <map>
+#ifdef WIN64
+#include <Windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// ----------------------------------------------------------------------------
+
+ChunkSet::ChunkSet() {
+  base = 0;
+}
+
+void ChunkSet::clear() {
+  base = 0;
+  others.clear();
+}
+
+bool ChunkSet::add(uint64_t c) {
+
+  if (has(c))
+    return false;
+  if (c == base) {
+    // The following chunks already in the set join the first ones
+    base++;
+    while (others.erase(base) > 0)
+      base++;
+  } else {
+    others.insert(c);
+  }
+  return true;
+
+}
+
+// ----------------------------------------------------------------------------
+
+Checkpoint::Checkpoint() {
+
+  nbTarget = 0;
+  searchMode = 0;
+  searchType = 0;
+  caseSensitive = true;
+  stop = false;
+  startPubKey = "-";
+  range = "-";
+  rangeStrict = false;
+  rangeRandom = false;
+  rekey = 0;
+  baseKey.SetInt32(0);
+  keys = 0;
+  rangeKeys = 0;
+  nbFoundKey = 0;
+  chunkSize.SetInt32(0);
+  nbChunk = 0;
+  chunkCursor = 0;
+
+}
+
+// ----------------------------------------------------------------------------
+
+bool Checkpoint::Save(string fileName) {
+
+  string tmpName = fileName + ".tmp";
+  FILE *f = fopen(tmpName.c_str(), "w");
+  if (f == NULL) {
+    printf("\nCannot open %s for writing\n", tmpName.c_str());
+    return false;
+  }
+
+  fprintf(f, "VanitySearch checkpoint %d\n", CHECKPOINT_VERSION);
+  fprintf(f, "targets %d %s\n", nbTarget, targets.c_str());
+  fprintf(f, "search %d %d %d %d\n", searchMode, searchType, caseSensitive, stop);
+  fprintf(f, "startPubKey %s\n", startPubKey.c_str());
+  fprintf(f, "range %s %d %d\n", range.c_str(), rangeStrict, rangeRandom);
+  fprintf(f, "rekey %" PRIu64 "\n", rekey);
+  fprintf(f, "gpu %s\n", gpu.length() ? gpu.c_str() : "-");
+
+  fprintf(f, "baseKey %s\n", baseKey.GetBase16().c_str());
+  fprintf(f, "keys %" PRIu64 " %" PRIu64 "\n", keys, rangeKeys);
+  fprintf(f, "foundKeys %d\n", nbFoundKey);
+  for (int i = 0; i < (int)found.size(); i++)
+    fprintf(f, "found %s\n", found[i].c_str());
+  for (int i = 0; i < (int)cpuKeys.size(); i++)
+    fprintf(f, "cpu %d %s\n", cpuSlots[i], cpuKeys[i].GetBase16().c_str());
+  for (int i = 0; i < (int)gpuSteps.size(); i++)
+    fprintf(f, "gpuSteps %d %" PRIu64 "\n", i, gpuSteps[i]);
+
+  if (nbChunk > 0) {
+    fprintf(f, "chunks %s %" PRIu64 " %" PRIu64 "\n", chunkSize.GetBase16().c_str(), nbChunk, chunkCursor);
+    // Chunks completed after the first ones, grouped by 64
+    fprintf(f, "doneBase %" PRIu64 "\n", chunkDone.base);
+    map<uint64_t, uint64_t> words;
+    for (auto it = chunkDone.others.begin(); it != chunkDone.others.end(); it++)
+      words[*it / 64] |= 1ULL << (*it % 64);
+    for (auto it = words.begin(); it != words.end(); it++)
+      fprintf(f, "done %" PRIu64 " %016" PRIx64 "\n", it->first, it->second);
+    for (int i = 0; i < (int)pieces.size(); i++)
+      fprintf(f, "piece %" PRIu64 " %s %s\n", pieces[i].chunk, pieces[i].start.GetBase16().c_str(),
+        pieces[i].end.GetBase16().c_str());
+  }
+
+  fprintf(f, "end\n");
+
+  bool ok = !ferror(f);
+  fflush(f);
+#ifdef WIN64
+  _commit(_fileno(f));
+#else
+  fsync(fileno(f));
+#endif
+  fclose(f);
+
+  if (!ok) {
+    printf("\nError while writing %s\n", tmpName.c_str());
+    remove(tmpName.c_str());
+    return false;
+  }
+
+#ifdef WIN64
+  ok = MoveFileExA(tmpName.c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+  ok = rename(tmpName.c_str(), fileName.c_str()) == 0;
+#endif
+  if (!ok)
+    printf("\nCannot rename %s to %s\n", tmpName.c_str(), fileName.c_str());
+
+  return ok;
+
+}
+
+// ----------------------------------------------------------------------------
+
+bool Checkpoint::Load(string fileName) {
+
+  FILE *f = fopen(fileName.c_str(), "r");
+  if (f == NULL)
+    return false;
+
+  char line[1024];
+  char name[64];
+  char s1[512];
+  char s2[512];
+  int version = 0;
+  bool ended = false;
+  bool ok = true;
+
+  if (fgets(line, sizeof(line), f) == NULL || sscanf(line, "VanitySearch checkpoint %d", &version) != 1 ||
+      version != CHECKPOINT_VERSION) {
+    fclose(f);
+    return false;
+  }
+
+  while (ok && !ended && fgets(line, sizeof(line), f)) {
+
+    line[strcspn(line, "\r\n")] = 0;
+    if (sscanf(line, "%63s", name) != 1)
+      continue;
+
+    if (strcmp(name, "targets") == 0) {
+      ok = sscanf(line, "targets %d %511s", &nbTarget, s1) == 2;
+      targets = string(s1);
+    } else if (strcmp(name, "search") == 0) {
+      int cs, st;
+      ok = sscanf(line, "search %d %d %d %d", &searchMode, &searchType, &cs, &st) == 4;
+      caseSensitive = cs != 0;
+      stop = st != 0;
+    } else if (strcmp(name, "startPubKey") == 0) {
+      ok = sscanf(line, "startPubKey %511s", s1) == 1;
+      startPubKey = string(s1);
+    } else if (strcmp(name, "range") == 0) {
+      int strict;
+      int random = 0;
+      ok = sscanf(line, "range %511s %d %d", s1, &strict, &random) >= 2;
+      range = string(s1);
+      rangeStrict = strict != 0;
+      rangeRandom = random != 0;
+    } else if (strcmp(name, "rekey") == 0) {
+      ok = sscanf(line, "rekey %" SCNu64, &rekey) == 1;
+    } else if (strcmp(name, "gpu") == 0) {
+      ok = sscanf(line, "gpu %511s", s1) == 1;
+      gpu = (strcmp(s1, "-") == 0) ? "" : string(s1);
+    } else if (strcmp(name, "gpuSteps") == 0) {
+      int id;
+      uint64_t steps;
+      ok = sscanf(line, "gpuSteps %d %" SCNu64, &id, &steps) == 2 && id == (int)gpuSteps.size();
+      gpuSteps.push_back(steps);
+    } else if (strcmp(name, "baseKey") == 0) {
+      ok = sscanf(line, "baseKey %511s", s1) == 1;
+      baseKey.SetBase16(s1);
+    } else if (strcmp(name, "keys") == 0) {
+      ok = sscanf(line, "keys %" SCNu64 " %" SCNu64, &keys, &rangeKeys) == 2;
+    } else if (strcmp(name, "foundKeys") == 0) {
+      ok = sscanf(line, "foundKeys %d", &nbFoundKey) == 1;
+    } else if (strcmp(name, "found") == 0) {
+      ok = strlen(line) > 6;
+      if (ok) found.push_back(string(line + 6));
+    } else if (strcmp(name, "cpu") == 0) {
+      int slot;
+      ok = sscanf(line, "cpu %d %511s", &slot, s1) == 2;
+      Int k;
+      k.SetBase16(s1);
+      cpuSlots.push_back(slot);
+      cpuKeys.push_back(k);
+    } else if (strcmp(name, "chunks") == 0) {
+      ok = sscanf(line, "chunks %511s %" SCNu64 " %" SCNu64, s1, &nbChunk, &chunkCursor) == 3;
+      chunkSize.SetBase16(s1);
+      chunkDone.clear();
+    } else if (strcmp(name, "doneBase") == 0) {
+      uint64_t b;
+      ok = sscanf(line, "doneBase %" SCNu64, &b) == 1 && b <= nbChunk && chunkDone.size() == 0;
+      if (ok) chunkDone.base = b;
+    } else if (strcmp(name, "done") == 0) {
+      uint64_t i;
+      uint64_t w;
+      ok = sscanf(line, "done %" SCNu64 " %" SCNx64, &i, &w) == 2 && i < (nbChunk + 63) / 64;
+      for (int j = 0; ok && j < 64; j++)
+        if ((w >> j) & 1 && i * 64 + j < nbChunk)
+          chunkDone.add(i * 64 + j);
+    } else if (strcmp(name, "piece") == 0) {
+      CKPT_PIECE p;
+      ok = sscanf(line, "piece %" SCNu64 " %511s %511s", &p.chunk, s1, s2) == 3 && p.chunk < nbChunk;
+      p.start.SetBase16(s1);
+      p.end.SetBase16(s2);
+      pieces.push_back(p);
+    } else if (strcmp(name, "end") == 0) {
+      ended = true;
+    }
+
+  }
+
+  fclose(f);
+  return ok && ended;
+
+}
+
+// ----------------------------------------------------------------------------
+
+string Checkpoint::Compare(Checkpoint &c) {
+
+  if (nbTarget != c.nbTarget || targets != c.targets)
+    return "target list";
+  if (searchMode != c.searchMode)
+    return "search mode (compressed/uncompressed)";
+  if (searchType != c.searchType)
+    return "address type";
+  if (caseSensitive != c.caseSensitive)
+    return "case sensitivity (-c)";
+  if (stop != c.stop)
+    return "stop mode (-stop)";
+  if (startPubKey != c.startPubKey)
+    return "start public key (-sp)";
+  if (range != c.range || rangeStrict != c.rangeStrict || rangeRandom != c.rangeRandom)
+    return "range or range split (-rg, -strict, -random, -t, GPUs)";
+  if (rekey != c.rekey)
+    return "rekey (-r)";
+  if (gpu != c.gpu)
+    return "GPU ids and grid sizes (-gpuId, -g)";
+  return "";
+
+}
@@ -0,0 +1,105 @@
+/*
+ * This file is part of the VanitySearch distribution (https://github.com/JeanLucPons/VanitySearch).
+ * Copyright (c) 2019 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CHECKPOINTH
+#define CHECKPOINTH
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <stdint.h>
+#include "Int.h"
+
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_INTERVAL 60   // Default interval between two checkpoints (s)
+
+// Part of a range chunk left to search
+typedef struct {
+
+  uint64_t chunk;
+  Int start;
+  Int end;         // Inclusive
+
+} CKPT_PIECE;
+
+// Set of chunks, the chunks below base and a hashed set of the other ones,
+// small when chunks are completed in order and sparse for large ranges
+class ChunkSet {
+
+public:
+
+  ChunkSet();
+  void clear();
+
+  // False if c is already in the set
+  bool add(uint64_t c);
+  inline bool has(uint64_t c) { return c < base || others.count(c) > 0; }
+  inline uint64_t size() { return base + (uint64_t)others.size(); }
+
+  uint64_t base;
+  std::unordered_set<uint64_t> others;
+
+};
+
+// Search progress, written to a temporary file renamed over the previous
+// checkpoint so that a checkpoint file is always complete
+class Checkpoint {
+
+public:
+
+  Checkpoint();
+
+  bool Save(std::string fileName);
+
+  // False if the file is missing or invalid
+  bool Load(std::string fileName);
+
+  // Name of the first search parameter differing from c, empty if none
+  std::string Compare(Checkpoint &c);
+
+  // Search parameters, checked on resume
+  int nbTarget;
+  std::string targets;        // SHA256 of the sorted target list
+  int searchMode;
+  int searchType;
+  bool caseSensitive;
+  bool stop;
+  std::string startPubKey;    // x:y hex, "-" if none
+  std::string range;          // start:end hex and CPU chunks, "-" if none
+  bool rangeStrict;
+  bool rangeRandom;           // Chunks sampled in random order
+  uint64_t rekey;
+  std::string gpu;            // GPU ids and grid sizes
+
+  // Progress
+  Int baseKey;
+  uint64_t keys;
+  uint64_t rangeKeys;
+  int nbFoundKey;
+  std::vector<std::string> found;          // Found targets
+  std::vector<int> cpuSlots;               // CPU threads positions (next key to check)
+  std::vector<Int> cpuKeys;
+  std::vector<uint64_t> gpuSteps;          // Kernel calls done by each GPU
+  Int chunkSize;
+  uint64_t nbChunk;
+  uint64_t chunkCursor;
+  ChunkSet chunkDone;                      // Completed chunks
+  std::vector<CKPT_PIECE> pieces;
+
+};
+
+#endif // CHECKPOINTH
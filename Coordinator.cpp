@@ -0,0 +1,349 @@
+/*
+ * This file is part of the VanitySearch distribution (https://github.com/JeanLucPons/VanitySearch).
+ * Copyright (c) 2019 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Coordinator.h"
+#include "WorkerLink.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace std;
+
+// ----------------------------------------------------------------------------
+
+#ifdef WIN64
+DWORD WINAPI _CoordAccept(LPVOID lpParam) {
+#else
+void *_CoordAccept(void *lpParam) {
+#endif
+  Coordinator *c = (Coordinator *)lpParam;
+  c->Accept();
+  return 0;
+}
+
+#ifdef WIN64
+DWORD WINAPI _CoordClient(LPVOID lpParam) {
+#else
+void *_CoordClient(void *lpParam) {
+#endif
+  COORD_CLIENT *c = (COORD_CLIENT *)lpParam;
+  c->obj->Client(c->s);
+  delete c;
+  return 0;
+}
+
+static bool parsePiece(string &s, uint64_t chunk, CKPT_PIECE &pc) {
+
+  // start:end hex
+  size_t sep = s.find(':');
+  if (sep == string::npos || sep == 0 || sep + 1 >= s.length())
+    return false;
+  string start = s.substr(0, sep);
+  string end = s.substr(sep + 1);
+  pc.chunk = chunk;
+  pc.start.SetBase16((char *)start.c_str());
+  pc.end.SetBase16((char *)end.c_str());
+  return true;
+
+}
+
+// ----------------------------------------------------------------------------
+
+Coordinator::Coordinator(VanitySearch *v, string addr, uint32_t leaseTimeout) {
+
+  this->v = v;
+  this->addr = addr;
+  this->leaseTimeout = leaseTimeout;
+  this->server = NULL;
+
+}
+
+bool Coordinator::Listen() {
+
+  server = NetSocket::Listen(addr);
+  return server != NULL;
+
+}
+
+void Coordinator::Start() {
+
+  printf("Coordinator listening on %s, lease timeout %ds\n", addr.c_str(), leaseTimeout);
+  detachThread(launchThread(_CoordAccept, (void *)this));
+
+}
+
+void Coordinator::Close() {
+
+  server->Close();
+
+}
+
+void Coordinator::Accept() {
+
+  NetSocket *s;
+  while ((s = server->Accept()) != NULL) {
+    COORD_CLIENT *c = new COORD_CLIENT;
+    c->obj = this;
+    c->s = s;
+    detachThread(launchThread(_CoordClient, (void *)c));
+  }
+
+}
+
+// ----------------------------------------------------------------------------
+
+void Coordinator::releaseLeases(int worker, double before) {
+
+  // Range lock held, leases of a worker (or expired ones when worker < 0)
+  // go back to the free pieces
+  for (auto it = leases.begin(); it != leases.end();) {
+    if ((worker >= 0 && it->second.worker == worker) || (worker < 0 && it->second.expiry < before)) {
+      v->releasePieces(it->second.pieces);
+      freeOwner[it->first] = it->second.worker;
+      it = leases.erase(it);
+    } else {
+      it++;
+    }
+  }
+
+}
+
+void Coordinator::ExpireLeases(double now) {
+
+  releaseLeases(-1, now);
+
+}
+
+void Coordinator::GetStats(int &nbWorker, double &keyRate, uint64_t &keys, int &nbLease) {
+
+  nbWorker = 0;
+  keyRate = 0.0;
+  keys = 0;
+  for (int i = 0; i < (int)workerInfo.size(); i++) {
+    if (workerInfo[i].connected) {
+      nbWorker++;
+      keyRate += workerInfo[i].keyRate;
+    }
+    keys += workerInfo[i].keys;
+  }
+  nbLease = (int)leases.size();
+
+}
+
+void Coordinator::GetLeasedPieces(vector<CKPT_PIECE> &pieces) {
+
+  for (auto it = leases.begin(); it != leases.end(); it++)
+    pieces.insert(pieces.end(), it->second.pieces.begin(), it->second.pieces.end());
+
+}
+
+void Coordinator::TargetFound(int i) {
+
+  v->lockRange();
+  found.push_back(i);
+  v->unlockRange();
+
+}
+
+// ----------------------------------------------------------------------------
+
+void Coordinator::Client(NetSocket *s) {
+
+  int id = -1;
+  bool pendingFound = false;
+  string jobId = v->getJobId();
+  string line;
+
+  while (s->ReadLine(line)) {
+
+    vector<string> f = NetSocket::Split(line);
+    string reply = "ok";
+    double now = Timer::get_tick();
+
+    // Results are on disk before the progress that covers them is accepted
+    if (pendingFound && f[0] != "found") {
+      v->flushResults();
+      pendingFound = false;
+    }
+
+    if (f[0] == "hello") {
+
+      if (f.size() != 3 || f[1] != to_string(COORD_PROTOCOL)) {
+        s->SendLine("error different protocol version");
+        break;
+      }
+      if (f[2] != jobId) {
+        s->SendLine("error different targets or search options (prefixes, -c, -u, -b, -sp, -strict)");
+        break;
+      }
+      WORKER_INFO w;
+      w.peer = s->peer;
+      w.connected = true;
+      w.keys = 0;
+      w.keyRate = 0.0;
+      Int start;
+      Int end;
+      Int size;
+      uint64_t nbChunk;
+      v->getJob(start, end, size, nbChunk);
+      v->lockRange();
+      id = (int)workerInfo.size();
+      workerInfo.push_back(w);
+      v->unlockRange();
+      reply = "job " + start.GetBase16() + " " + end.GetBase16() + " " + size.GetBase16() + " " +
+        to_string(nbChunk) + " " + to_string(id);
+      printf("\nWorker %d connected from %s\n", id, s->peer.c_str());
+
+    } else if (id < 0) {
+
+      s->SendLine("error hello expected");
+      break;
+
+    } else if (f[0] == "get" && f.size() == 2) {
+
+      // Free pieces first (whole chunks stay with one worker), then new chunks
+      uint64_t nb = strtoull(f[1].c_str(), NULL, 10);
+      reply = "";
+      v->lockRange();
+      if (v->isJobDone()) {
+        reply = "end";
+      } else {
+        for (uint64_t i = 0; i < nb; i++) {
+          vector<CKPT_PIECE> got;
+          if (!v->takePieces(got))
+            break;
+          freeOwner.erase(got[0].chunk);
+          LEASE &l = leases[got[0].chunk];
+          l.worker = id;
+          l.expiry = now + leaseTimeout;
+          l.pieces = got;
+          for (int j = 0; j < (int)got.size(); j++)
+            reply += "lease " + to_string(got[j].chunk) + " " + got[j].start.GetBase16() + " " + got[j].end.GetBase16() + "\n";
+        }
+        reply += "ok";
+      }
+      v->unlockRange();
+
+    } else if (f[0] == "found" && f.size() == 5) {
+
+      int type = atoi(f[1].c_str());
+      string wif;
+      if (v->checkResult(type, f[2], f[4], wif)) {
+        v->addResult(type, f[2], wif, f[4]);
+        pendingFound = true;
+      } else {
+        printf("\nWarning, wrong result from worker %d: %s\n", id, f[2].c_str());
+      }
+
+    } else if (f[0] == "complete" && f.size() == 2) {
+
+      // Accepted from the lease holder, or from the last one if the lease
+      // expired and the chunk was not leased again
+      uint64_t c = strtoull(f[1].c_str(), NULL, 10);
+      v->lockRange();
+      auto it = leases.find(c);
+      auto ow = freeOwner.find(c);
+      bool holder = (it != leases.end()) ? it->second.worker == id : (ow != freeOwner.end() && ow->second == id);
+      if (holder && v->completeChunk(c)) {
+        leases.erase(c);
+        freeOwner.erase(c);
+      }
+      v->unlockRange();
+
+    } else if (f[0] == "progress" && f.size() >= 3) {
+
+      uint64_t c = strtoull(f[1].c_str(), NULL, 10);
+      vector<CKPT_PIECE> pieces;
+      for (int j = 2; j < (int)f.size(); j++) {
+        CKPT_PIECE pc;
+        if (parsePiece(f[j], c, pc))
+          pieces.push_back(pc);
+      }
+      v->lockRange();
+      auto it = leases.find(c);
+      auto ow = freeOwner.find(c);
+      if (it != leases.end() && it->second.worker == id) {
+        it->second.pieces = pieces;
+      } else if (it == leases.end() && ow != freeOwner.end() && ow->second == id) {
+        // Expired but not leased again, taken back by its worker
+        v->dropPieces(c);
+        freeOwner.erase(ow);
+        LEASE &l = leases[c];
+        l.worker = id;
+        l.expiry = now + leaseTimeout;
+        l.pieces = pieces;
+      } else {
+        reply = "revoke " + f[1];
+      }
+      v->unlockRange();
+
+    } else if (f[0] == "beat" && f.size() == 3) {
+
+      // Job progress, end of the job and the targets found since the last beat
+      uint64_t keys = strtoull(f[1].c_str(), NULL, 10);
+      size_t known = (size_t)strtoull(f[2].c_str(), NULL, 10);
+      uint64_t nbDone;
+      uint64_t nbChunk;
+      char tmp[64];
+      v->lockRange();
+      WORKER_INFO &w = workerInfo[id];
+      if (keys > w.keys)
+        w.keyRate = (double)(keys - w.keys) / (LINK_REPORT_MS / 1000.0);
+      w.keys = keys;
+      for (auto it = leases.begin(); it != leases.end(); it++)
+        if (it->second.worker == id)
+          it->second.expiry = now + leaseTimeout;
+      v->getJobProgress(nbDone, nbChunk);
+      sprintf(tmp, "ok %.0f %.0f %d ", (double)nbDone, (double)nbChunk, v->isJobDone() ? 1 : 0);
+      reply = string(tmp);
+      for (size_t j = known; j < found.size(); j++)
+        reply += (j > known ? "," : "") + to_string(found[j]);
+      if (known >= found.size())
+        reply += "-";
+      v->unlockRange();
+
+    } else if (f[0] == "bye") {
+
+      break;
+
+    } else {
+
+      reply = "error unknown command";
+
+    }
+
+    if (!s->SendLine(reply))
+      break;
+
+  }
+
+  if (pendingFound)
+    v->flushResults();
+
+  if (id >= 0) {
+    // Pieces left go back to the free pieces, from the last progress report
+    v->lockRange();
+    releaseLeases(id, 0.0);
+    workerInfo[id].connected = false;
+    workerInfo[id].keyRate = 0.0;
+    v->unlockRange();
+    printf("\nWorker %d disconnected\n", id);
+  }
+  s->Close();
+  delete s;
+
+}
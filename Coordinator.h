@@ -0,0 +1,103 @@
+/*
+ * This file is part of the VanitySearch distribution (https://github.com/JeanLucPons/VanitySearch).
+ * Copyright (c) 2019 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COORDINATORH
+#define COORDINATORH
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "Vanity.h"
+#include "Net.h"
+
+#define COORD_PROTOCOL   2
+#define LEASE_TIMEOUT    60      // Seconds without heartbeat before the leases of a worker expire
+
+// Chunk leased to a worker by the coordinator
+typedef struct {
+
+  int worker;
+  double expiry;                    // Renewed by the heartbeats of the worker
+  std::vector<CKPT_PIECE> pieces;   // Parts of the chunk left, from the last progress report
+
+} LEASE;
+
+typedef struct {
+
+  std::string peer;
+  bool connected;
+  uint64_t keys;
+  double keyRate;
+
+} WORKER_INFO;
+
+class Coordinator;
+
+typedef struct {
+
+  Coordinator *obj;
+  NetSocket *s;
+
+} COORD_CLIENT;
+
+// Leases the chunks of the range pool of a search to its workers, one line per request:
+//   hello <protocol> <job id>  -> job <start> <end> <chunk size> <chunks> <worker id>
+//   get <n>                    -> lease <chunk> <start> <end> lines, then ok (or end)
+//   found <type> <addr> <wif> <hex>, checked again
+//   complete <chunk>
+//   progress <chunk> <start>:<end>...  -> ok, or revoke <chunk> if leased to another worker
+//   beat <keys> <targets known>  -> ok <chunks done> <chunks> <end> <targets found since>
+//   bye
+// The leases and the workers are under the range lock of the search.
+class Coordinator {
+
+public:
+
+  Coordinator(VanitySearch *v, std::string addr, uint32_t leaseTimeout);
+
+  // False on failure, an error is printed. Workers are accepted once started.
+  bool Listen();
+  void Start();
+  void Close();
+
+  void Accept();
+  void Client(NetSocket *s);
+
+  // Range lock held
+  void ExpireLeases(double now);
+  void GetStats(int &nbWorker, double &keyRate, uint64_t &keys, int &nbLease);
+  void GetLeasedPieces(std::vector<CKPT_PIECE> &pieces);
+
+  // Sent to the workers with their next heartbeat
+  void TargetFound(int i);
+
+private:
+
+  void releaseLeases(int worker, double before);
+
+  VanitySearch *v;
+  std::string addr;
+  uint32_t leaseTimeout;
+  NetSocket *server;
+  std::unordered_map<uint64_t, LEASE> leases;      // Leased chunks
+  std::vector<WORKER_INFO> workerInfo;             // Workers by id
+  std::unordered_map<uint64_t, int> freeOwner;     // Last worker of the released chunks
+  std::vector<int> found;                          // Targets found, in order
+
+};
+
+#endif // COORDINATORH
@@ -209,11 +209,51 @@ __device__ __noinline__ void CheckHashP2SHUncomp(prefix_t *prefix, uint64_t *px,
 
 }
 
+// -----------------------------------------------------------------------------------------
+// Range-strict mode, only the key of the point is in the range
+
+__device__ __noinline__ void CheckHashStrict(uint32_t mode, prefix_t *prefix, uint64_t *px, uint64_t *py, int32_t incr,
+                                             uint32_t *lookup32, uint32_t maxFound, uint32_t *out) {
+
+  uint32_t   h[5];
+
+  if (mode != SEARCH_UNCOMPRESSED) {
+    _GetHash160Comp(px, (uint8_t)(py[0] & 1), (uint8_t *)h);
+    CHECK_POINT(h, incr, 0, true);
+  }
+  if (mode != SEARCH_COMPRESSED) {
+    _GetHash160(px, py, (uint8_t *)h);
+    CHECK_POINT(h, incr, 0, false);
+  }
+
+}
+
+__device__ __noinline__ void CheckP2SHHashStrict(uint32_t mode, prefix_t *prefix, uint64_t *px, uint64_t *py, int32_t incr,
+                                                 uint32_t *lookup32, uint32_t maxFound, uint32_t *out) {
+
+  uint32_t   h[5];
+
+  if (mode != SEARCH_UNCOMPRESSED) {
+    _GetHash160P2SHComp(px, (uint8_t)(py[0] & 1), (uint8_t *)h);
+    CHECK_POINT_P2SH(h, incr, 0, true);
+  }
+  if (mode != SEARCH_COMPRESSED) {
+    _GetHash160P2SHUncomp(px, py, (uint8_t *)h);
+    CHECK_POINT_P2SH(h, incr, 0, false);
+  }
+
+}
+
 // -----------------------------------------------------------------------------------------
 
 __device__ __noinline__ void CheckHash(uint32_t mode, prefix_t *prefix, uint64_t *px, uint64_t *py, int32_t incr,
                                        uint32_t *lookup32, uint32_t maxFound, uint32_t *out) {
 
+  if (mode & SEARCH_STRICT) {
+    CheckHashStrict(mode & ~SEARCH_STRICT, prefix, px, py, incr, lookup32, maxFound, out);
+    return;
+  }
+
   switch (mode) {
   case SEARCH_COMPRESSED:
     CheckHashComp(prefix, px, (uint8_t)(py[0] & 1), incr, lookup32, maxFound, out);
@@ -232,6 +272,11 @@ __device__ __noinline__ void CheckHash(uint32_t mode, prefix_t *prefix, uint64_t
 __device__ __noinline__ void CheckP2SHHash(uint32_t mode, prefix_t *prefix, uint64_t *px, uint64_t *py, int32_t incr,
   uint32_t *lookup32, uint32_t maxFound, uint32_t *out) {
 
+  if (mode & SEARCH_STRICT) {
+    CheckP2SHHashStrict(mode & ~SEARCH_STRICT, prefix, px, py, incr, lookup32, maxFound, out);
+    return;
+  }
+
   switch (mode) {
   case SEARCH_COMPRESSED:
     CheckHashP2SHComp(prefix, px, (uint8_t)(py[0] & 1), incr, lookup32, maxFound, out);
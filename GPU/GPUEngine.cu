@@ -292,6 +292,7 @@ GPUEngine::GPUEngine(int nbThreadGroup, int nbThreadPerGroup, int gpuId, uint32_
   }
 
   searchMode = SEARCH_COMPRESSED;
+  rangeStrict = false;
   searchType = P2PKH;
   initialised = true;
   pattern = "";
@@ -304,6 +305,15 @@ int GPUEngine::GetGroupSize() {
   return GRP_SIZE;
 }
 
+std::string GPUEngine::GetPCIBusId(int gpuId) {
+
+  char busId[64];
+  if (cudaDeviceGetPCIBusId(busId, sizeof(busId), gpuId) != cudaSuccess)
+    return "";
+  return std::string(busId);
+
+}
+
 void GPUEngine::PrintCudaInfo() {
 
   cudaError_t err;
@@ -370,12 +380,35 @@ void GPUEngine::SetSearchMode(int searchMode) {
   this->searchMode = searchMode;
 }
 
+void GPUEngine::SetRangeStrict(bool strict) {
+  this->rangeStrict = strict;
+}
+
 void GPUEngine::SetSearchType(int searchType) {
   this->searchType = searchType;
 }
 
+bool GPUEngine::allocPrefixPinned() {
+
+  // Pinned memory is released after each upload, the lookup may be uploaded again
+  // when found prefixes are removed
+  if (inputPrefixPinned == NULL) {
+    cudaError_t err = cudaHostAlloc(&inputPrefixPinned, _64K * 2, cudaHostAllocWriteCombined | cudaHostAllocMapped);
+    if (err != cudaSuccess) {
+      printf("GPUEngine: Allocate prefix pinned memory: %s\n", cudaGetErrorString(err));
+      inputPrefixPinned = NULL;
+      return false;
+    }
+  }
+  return true;
+
+}
+
 void GPUEngine::SetPrefix(std::vector<prefix_t> prefixes) {
 
+  if (!allocPrefixPinned())
+    return;
+
   memset(inputPrefixPinned, 0, _64K * 2);
   for(int i=0;i<(int)prefixes.size();i++)
     inputPrefixPinned[prefixes[i]]=1;
@@ -418,7 +451,14 @@ void GPUEngine::SetPattern(const char *pattern) {
 
 void GPUEngine::SetPrefix(std::vector<LPREFIX> prefixes, uint32_t totalPrefix) {
 
+  if (!allocPrefixPinned())
+    return;
+
   // Allocate memory for the second level of lookup tables
+  if (inputPrefixLookUp) {
+    cudaFree(inputPrefixLookUp);
+    inputPrefixLookUp = NULL;
+  }
   cudaError_t err = cudaMalloc((void **)&inputPrefixLookUp, (_64K+totalPrefix) * 4);
   if (err != cudaSuccess) {
     printf("GPUEngine: Allocate prefix lookup memory: %s\n", cudaGetErrorString(err));
@@ -470,15 +510,18 @@ bool GPUEngine::callKernel() {
   // Reset nbFound
   cudaMemset(outputPrefix,0,4);
 
+  // Range-strict flag goes with the search mode
+  uint32_t mode = searchMode | (rangeStrict ? SEARCH_STRICT : 0);
+
   // Call the kernel (Perform STEP_SIZE keys per thread)
   if (searchType == P2SH) {
 
     if (hasPattern) {
       comp_keys_p2sh_pattern << < nbThread / nbThreadPerGroup, nbThreadPerGroup >> >
-        (searchMode, inputPrefix, inputKey, maxFound, outputPrefix);
+        (mode, inputPrefix, inputKey, maxFound, outputPrefix);
     } else {
       comp_keys_p2sh << < nbThread / nbThreadPerGroup, nbThreadPerGroup >> >
-        (searchMode, inputPrefix, inputPrefixLookUp, inputKey, maxFound, outputPrefix);
+        (mode, inputPrefix, inputPrefixLookUp, inputKey, maxFound, outputPrefix);
     }
 
   } else {
@@ -491,14 +534,14 @@ bool GPUEngine::callKernel() {
         return false;
       }
       comp_keys_pattern << < nbThread / nbThreadPerGroup, nbThreadPerGroup >> >
-        (searchMode, inputPrefix, inputKey, maxFound, outputPrefix);
+        (mode, inputPrefix, inputKey, maxFound, outputPrefix);
     } else {
-      if (searchMode == SEARCH_COMPRESSED) {
+      if (searchMode == SEARCH_COMPRESSED && !rangeStrict) {
         comp_keys_comp << < nbThread / nbThreadPerGroup, nbThreadPerGroup >> >
           (inputPrefix, inputPrefixLookUp, inputKey, maxFound, outputPrefix);
       } else {
         comp_keys << < nbThread / nbThreadPerGroup, nbThreadPerGroup >> >
-          (searchMode, inputPrefix, inputPrefixLookUp, inputKey, maxFound, outputPrefix);
+          (mode, inputPrefix, inputPrefixLookUp, inputKey, maxFound, outputPrefix);
       }
     }
 
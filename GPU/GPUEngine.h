@@ -25,6 +25,9 @@
 #define SEARCH_UNCOMPRESSED 1
 #define SEARCH_BOTH 2
 
+// Kernel mode flag, only the point itself is checked (no endomorphism nor symmetry)
+#define SEARCH_STRICT 4
+
 static const char *searchModes[] = {"Compressed","Uncompressed","Compressed or Uncompressed"};
 
 // Number of key per thread (must be a multiple of GRP_SIZE) per kernel call
@@ -63,6 +66,7 @@ public:
   bool SetKeys(Point *p);
   void SetSearchMode(int searchMode);
   void SetSearchType(int searchType);
+  void SetRangeStrict(bool strict);
   void SetPattern(const char *pattern);
   bool Launch(std::vector<ITEM> &prefixFound,bool spinWait=false);
   int GetNbThread();
@@ -72,10 +76,13 @@ public:
   std::string deviceName;
 
   static void PrintCudaInfo();
+  static std::string GetPCIBusId(int gpuId);
   static void GenerateCode(Secp256K1 *secp, int size);
 
 private:
 
+  bool allocPrefixPinned();
+
   bool callKernel();
   static void ComputeIndex(std::vector<int> &s, int depth, int n);
   static void Browse(FILE *f,int depth, int max, int s);
@@ -94,6 +101,7 @@ private:
   bool initialised;
   uint32_t searchMode;
   uint32_t searchType;
+  bool rangeStrict;
   bool littleEndian;
   bool lostWarning;
   bool rekey;
@@ -0,0 +1,88 @@
+/*
+ * This file is part of the VanitySearch distribution (https://github.com/JeanLucPons/VanitySearch).
+ * Copyright (c) 2019 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "HitQueue.h"
+
+// ----------------------------------------------------------------------------
+
+HitQueue::HitQueue(int size) {
+
+  slots = new HIT_SLOT[size];
+  mask = (uint64_t)size - 1;
+  for (int i = 0; i < size; i++)
+    slots[i].seq.store(i, std::memory_order_relaxed);
+  head.store(0);
+  tail = 0;
+
+}
+
+HitQueue::~HitQueue() {
+  delete[] slots;
+}
+
+// ----------------------------------------------------------------------------
+
+bool HitQueue::push(HIT_ITEM &it) {
+
+  HIT_SLOT *s;
+  uint64_t pos = head.load(std::memory_order_relaxed);
+
+  for (;;) {
+
+    s = &slots[pos & mask];
+    uint64_t seq = s->seq.load(std::memory_order_acquire);
+    int64_t dif = (int64_t)seq - (int64_t)pos;
+
+    if (dif == 0) {
+      // Free slot, claim it
+      if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        break;
+    } else if (dif < 0) {
+      // Not yet consumed since the previous round
+      return false;
+    } else {
+      // Claimed by another producer
+      pos = head.load(std::memory_order_relaxed);
+    }
+
+  }
+
+  s->item = it;
+  s->seq.store(pos + 1, std::memory_order_release);
+  return true;
+
+}
+
+// ----------------------------------------------------------------------------
+
+bool HitQueue::pop(HIT_ITEM &it) {
+
+  HIT_SLOT *s = &slots[tail & mask];
+  uint64_t seq = s->seq.load(std::memory_order_acquire);
+  if ((int64_t)seq - (int64_t)(tail + 1) < 0)
+    return false;
+
+  it = s->item;
+  s->seq.store(tail + mask + 1, std::memory_order_release);
+  tail++;
+  return true;
+
+}
+
+uint64_t HitQueue::getPushed() {
+  return head.load();
+}
@@ -0,0 +1,72 @@
+/*
+ * This file is part of the VanitySearch distribution (https://github.com/JeanLucPons/VanitySearch).
+ * Copyright (c) 2019 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HITQUEUEH
+#define HITQUEUEH
+
+#include <atomic>
+#include <stdint.h>
+#include "Int.h"
+
+// Unverified hit, the private key is rebuilt from the group key by the verifier
+typedef struct {
+
+  int type;
+  bool mode;
+  int32_t incr;
+  int endomorphism;
+  Int key;              // Group base key
+  char addr[136];       // Address (or public key hex) reported by the search thread
+
+} HIT_ITEM;
+
+typedef struct {
+
+  std::atomic<uint64_t> seq;
+  HIT_ITEM item;
+
+} HIT_SLOT;
+
+// Bounded lock-free queue, multiple producers (search threads) and a single consumer
+// (verifier thread). Each slot carries a sequence number telling whether it is free
+// for the producer at position pos (seq == pos) or ready for the consumer (seq == pos+1).
+class HitQueue {
+
+public:
+
+  HitQueue(int size);  // size must be a power of 2
+  ~HitQueue();
+
+  // Returns false when the queue is full
+  bool push(HIT_ITEM &it);
+
+  // Returns false when the queue is empty, consumer thread only
+  bool pop(HIT_ITEM &it);
+
+  // Number of items pushed (or being pushed) so far
+  uint64_t getPushed();
+
+private:
+
+  HIT_SLOT *slots;
+  uint64_t mask;
+  std::atomic<uint64_t> head;   // Next position to write
+  uint64_t tail;                // Next position to read
+
+};
+
+#endif // HITQUEUEH
@@ -1080,7 +1080,7 @@ void Int::Div(Int *a,Int *mod) {
     if (!skipCorrection) { 
 
       // Correct qhat
-      uint64_t nl = rem.bits64[sb-j-1];
+      uint64_t nl = (sb-j-1 >= 0) ? rem.bits64[sb-j-1] : 0;
 
       uint64_t estProH;
       uint64_t estProL = _umul128(_dl,qhat,&estProH);
@@ -0,0 +1,314 @@
+/*
+ * This file is part of the VanitySearch distribution (https://github.com/JeanLucPons/VanitySearch).
+ * Copyright (c) 2019 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef WIN64
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#define CLOSE_SOCKET closesocket
+#define BAD_SOCKET INVALID_SOCKET
+#else
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#define CLOSE_SOCKET close
+#define BAD_SOCKET -1
+#endif
+#include "Net.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+using namespace std;
+
+#define NET_READ_SIZE 4096
+
+// ----------------------------------------------------------------------------
+
+NetSocket::NetSocket(SOCKET_T fd) {
+  this->fd = fd;
+  this->isUnix = false;
+}
+
+bool NetSocket::Init() {
+
+#ifdef WIN64
+  static bool initDone = false;
+  if (!initDone) {
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+      printf("Error: cannot initialize sockets\n");
+      return false;
+    }
+    initDone = true;
+  }
+#endif
+  return true;
+
+}
+
+// ----------------------------------------------------------------------------
+
+static bool splitAddress(string &addr, string &host, string &port) {
+
+  size_t sep = addr.rfind(':');
+  if (sep == string::npos || sep + 1 >= addr.length()) {
+    printf("Error: invalid address %s, host:port expected\n", addr.c_str());
+    return false;
+  }
+  host = addr.substr(0, sep);
+  port = addr.substr(sep + 1);
+  if (host.length() == 0)
+    host = "0.0.0.0";
+  return true;
+
+}
+
+#ifndef WIN64
+static bool unixAddress(string &addr, struct sockaddr_un &sa) {
+
+  string path = addr.substr(5);
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  if (path.length() == 0 || path.length() >= sizeof(sa.sun_path)) {
+    printf("Error: invalid unix socket path %s\n", path.c_str());
+    return false;
+  }
+  strcpy(sa.sun_path, path.c_str());
+  return true;
+
+}
+#endif
+
+NetSocket *NetSocket::Listen(string addr) {
+
+  if (!Init())
+    return NULL;
+
+#ifndef WIN64
+  if (addr.compare(0, 5, "unix:") == 0) {
+    struct sockaddr_un sa;
+    if (!unixAddress(addr, sa))
+      return NULL;
+    unlink(sa.sun_path);
+    SOCKET_T s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s == BAD_SOCKET || bind(s, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(s, 64) != 0) {
+      printf("Error: cannot listen on %s\n", addr.c_str());
+      if (s != BAD_SOCKET) CLOSE_SOCKET(s);
+      return NULL;
+    }
+    NetSocket *n = new NetSocket(s);
+    n->isUnix = true;
+    n->unixPath = string(sa.sun_path);
+    n->peer = addr;
+    return n;
+  }
+#endif
+
+  string host, port;
+  if (!splitAddress(addr, host, port))
+    return NULL;
+
+  struct addrinfo hints;
+  struct addrinfo *res = NULL;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0 || res == NULL) {
+    printf("Error: cannot resolve %s\n", addr.c_str());
+    return NULL;
+  }
+
+  SOCKET_T s = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+  int one = 1;
+  if (s != BAD_SOCKET)
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char *)&one, sizeof(one));
+  if (s == BAD_SOCKET || bind(s, res->ai_addr, (int)res->ai_addrlen) != 0 || listen(s, 64) != 0) {
+    printf("Error: cannot listen on %s\n", addr.c_str());
+    if (s != BAD_SOCKET) CLOSE_SOCKET(s);
+    freeaddrinfo(res);
+    return NULL;
+  }
+  freeaddrinfo(res);
+
+  NetSocket *n = new NetSocket(s);
+  n->peer = addr;
+  return n;
+
+}
+
+NetSocket *NetSocket::Connect(string addr) {
+
+  if (!Init())
+    return NULL;
+
+#ifndef WIN64
+  if (addr.compare(0, 5, "unix:") == 0) {
+    struct sockaddr_un sa;
+    if (!unixAddress(addr, sa))
+      return NULL;
+    SOCKET_T s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s == BAD_SOCKET || connect(s, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+      printf("Error: cannot connect to %s\n", addr.c_str());
+      if (s != BAD_SOCKET) CLOSE_SOCKET(s);
+      return NULL;
+    }
+    NetSocket *n = new NetSocket(s);
+    n->isUnix = true;
+    n->peer = addr;
+    return n;
+  }
+#endif
+
+  string host, port;
+  if (!splitAddress(addr, host, port))
+    return NULL;
+
+  struct addrinfo hints;
+  struct addrinfo *res = NULL;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0 || res == NULL) {
+    printf("Error: cannot resolve %s\n", addr.c_str());
+    return NULL;
+  }
+
+  SOCKET_T s = BAD_SOCKET;
+  for (struct addrinfo *r = res; r != NULL && s == BAD_SOCKET; r = r->ai_next) {
+    s = socket(r->ai_family, r->ai_socktype, r->ai_protocol);
+    if (s != BAD_SOCKET && connect(s, r->ai_addr, (int)r->ai_addrlen) != 0) {
+      CLOSE_SOCKET(s);
+      s = BAD_SOCKET;
+    }
+  }
+  freeaddrinfo(res);
+  if (s == BAD_SOCKET) {
+    printf("Error: cannot connect to %s\n", addr.c_str());
+    return NULL;
+  }
+
+  // Small request/reply messages
+  int one = 1;
+  setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char *)&one, sizeof(one));
+
+  NetSocket *n = new NetSocket(s);
+  n->peer = addr;
+  return n;
+
+}
+
+NetSocket *NetSocket::Accept() {
+
+  struct sockaddr_storage sa;
+  socklen_t len = sizeof(sa);
+  SOCKET_T s = accept(fd, (struct sockaddr *)&sa, &len);
+  if (s == BAD_SOCKET)
+    return NULL;
+
+  NetSocket *n = new NetSocket(s);
+  if (isUnix) {
+    n->isUnix = true;
+    n->peer = "unix";
+  } else {
+    int one = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char *)&one, sizeof(one));
+    char host[NI_MAXHOST];
+    char port[NI_MAXSERV];
+    if (getnameinfo((struct sockaddr *)&sa, len, host, sizeof(host), port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) == 0)
+      n->peer = string(host) + ":" + string(port);
+  }
+  return n;
+
+}
+
+// ----------------------------------------------------------------------------
+
+bool NetSocket::SendLine(string line) {
+
+  line.append("\n");
+  const char *p = line.c_str();
+  size_t left = line.length();
+  while (left > 0) {
+    int n = (int)send(fd, p, (int)left, MSG_NOSIGNAL);
+    if (n <= 0)
+      return false;
+    p += n;
+    left -= n;
+  }
+  return true;
+
+}
+
+bool NetSocket::ReadLine(string &line) {
+
+  size_t eol;
+  while ((eol = buffer.find('\n')) == string::npos) {
+    if (buffer.length() > NET_MAX_LINE)
+      return false;
+    char tmp[NET_READ_SIZE];
+    int n = (int)recv(fd, tmp, NET_READ_SIZE, 0);
+    if (n <= 0)
+      return false;
+    buffer.append(tmp, n);
+  }
+
+  line = buffer.substr(0, eol);
+  buffer.erase(0, eol + 1);
+  if (line.length() > 0 && line[line.length() - 1] == '\r')
+    line.erase(line.length() - 1);
+  return true;
+
+}
+
+void NetSocket::Close() {
+
+#ifdef WIN64
+  shutdown(fd, SD_BOTH);
+#else
+  shutdown(fd, SHUT_RDWR);
+#endif
+  CLOSE_SOCKET(fd);
+#ifndef WIN64
+  if (unixPath.length() > 0)
+    unlink(unixPath.c_str());
+#endif
+
+}
+
+vector<string> NetSocket::Split(string &line) {
+
+  vector<string> f;
+  size_t pos = 0;
+  size_t sep;
+  while ((sep = line.find(' ', pos)) != string::npos) {
+    f.push_back(line.substr(pos, sep - pos));
+    pos = sep + 1;
+  }
+  f.push_back(line.substr(pos));
+  return f;
+
+}
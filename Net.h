@@ -0,0 +1,66 @@
+/*
+ * This file is part of the VanitySearch distribution (https://github.com/JeanLucPons/VanitySearch).
+ * Copyright (c) 2019 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NETH
+#define NETH
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#ifdef WIN64
+typedef uintptr_t SOCKET_T;  // SOCKET, winsock2.h is only included by Net.cpp
+#else
+typedef int SOCKET_T;
+#endif
+
+#define NET_MAX_LINE (1 << 20)  // Longest line read
+
+// Line oriented stream socket, TCP (host:port) or unix domain (unix:path)
+class NetSocket {
+
+public:
+
+  // NULL on failure, an error is printed
+  static NetSocket *Listen(std::string addr);
+  static NetSocket *Connect(std::string addr);
+  NetSocket *Accept();
+
+  // Lines are sent and read without their '\n', ReadLine fails on a line
+  // longer than NET_MAX_LINE
+  bool SendLine(std::string line);
+  bool ReadLine(std::string &line);
+  void Close();
+
+  // Fields of a line separated by single spaces, empty fields kept
+  static std::vector<std::string> Split(std::string &line);
+
+  std::string peer;
+
+private:
+
+  NetSocket(SOCKET_T fd);
+  static bool Init();
+
+  SOCKET_T fd;
+  bool isUnix;
+  std::string unixPath;     // Removed by the listening socket when closed
+  std::string buffer;       // Received bytes not read yet
+
+};
+
+#endif // NETH
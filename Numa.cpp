@@ -0,0 +1,197 @@
+/*
+ * This file is part of the VanitySearch distribution (https://github.com/JeanLucPons/VanitySearch).
+ * Copyright (c) 2019 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Numa.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+#ifdef WIN64
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#endif
+
+using namespace std;
+
+vector< vector<int> > Numa::nodes;
+vector<int> Numa::nodeIds;
+
+#ifndef WIN64
+
+// Parses a cpu list ("0-3,8,10-11")
+static void parseCpuList(const char *str, vector<int> &cpus) {
+
+  const char *s = str;
+  while (*s) {
+    while (*s && !isdigit(*s)) s++;
+    if (!*s) break;
+    int a = (int)strtol(s, (char **)&s, 10);
+    int b = a;
+    if (*s == '-') {
+      s++;
+      b = (int)strtol(s, (char **)&s, 10);
+    }
+    for (int i = a; i <= b; i++)
+      cpus.push_back(i);
+  }
+
+}
+
+static bool readLine(string fileName, char *line, int size) {
+
+  FILE *f = fopen(fileName.c_str(), "r");
+  if (f == NULL)
+    return false;
+  bool ok = (fgets(line, size, f) != NULL);
+  fclose(f);
+  return ok;
+
+}
+
+#endif
+
+// ----------------------------------------------------------------------------
+
+void Numa::Init() {
+
+  // Nodes without allowed cpus are left out, indexes and system ids differ
+  nodes.clear();
+  nodeIds.clear();
+
+#ifdef WIN64
+
+  ULONG highest;
+  if (GetNumaHighestNodeNumber(&highest)) {
+    DWORD_PTR procMask, sysMask;
+    GetProcessAffinityMask(GetCurrentProcess(), &procMask, &sysMask);
+    for (ULONG n = 0; n <= highest; n++) {
+      ULONGLONG mask;
+      vector<int> cpus;
+      if (GetNumaNodeProcessorMask((UCHAR)n, &mask))
+        for (int i = 0; i < 64; i++)
+          if ((mask & procMask) & (1ULL << i))
+            cpus.push_back(i);
+      if (cpus.size() > 0) {
+        nodes.push_back(cpus);
+        nodeIds.push_back((int)n);
+      }
+    }
+  }
+
+#else
+
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  sched_getaffinity(0, sizeof(allowed), &allowed);
+
+  DIR *dir = opendir("/sys/devices/system/node");
+  if (dir) {
+    vector<int> ids;
+    struct dirent *e;
+    while ((e = readdir(dir)) != NULL)
+      if (strncmp(e->d_name, "node", 4) == 0 && isdigit(e->d_name[4]))
+        ids.push_back(atoi(e->d_name + 4));
+    closedir(dir);
+    sort(ids.begin(), ids.end());
+    for (int i = 0; i < (int)ids.size(); i++) {
+      char line[4096];
+      vector<int> all;
+      vector<int> cpus;
+      if (!readLine("/sys/devices/system/node/node" + to_string(ids[i]) + "/cpulist", line, sizeof(line)))
+        continue;
+      parseCpuList(line, all);
+      for (int j = 0; j < (int)all.size(); j++)
+        if (all[j] < CPU_SETSIZE && CPU_ISSET(all[j], &allowed))
+          cpus.push_back(all[j]);
+      if (cpus.size() > 0) {
+        nodes.push_back(cpus);
+        nodeIds.push_back(ids[i]);
+      }
+    }
+  }
+
+  if (nodes.size() == 0) {
+    vector<int> cpus;
+    for (int i = 0; i < CPU_SETSIZE; i++)
+      if (CPU_ISSET(i, &allowed))
+        cpus.push_back(i);
+    if (cpus.size() > 0) {
+      nodes.push_back(cpus);
+      nodeIds.push_back(-1);
+    }
+  }
+
+#endif
+
+  if (nodes.size() == 0) {
+    nodes.push_back(vector<int>(1, 0));
+    nodeIds.push_back(-1);
+  }
+
+}
+
+int Numa::GetNbNode() {
+  return (int)nodes.size();
+}
+
+vector<int> &Numa::GetCpus(int node) {
+  return nodes[node];
+}
+
+// ----------------------------------------------------------------------------
+
+int Numa::GetDeviceNode(string pciBusId) {
+
+#ifdef WIN64
+  return -1;
+#else
+  transform(pciBusId.begin(), pciBusId.end(), pciBusId.begin(), ::tolower);
+  char line[64];
+  if (!readLine("/sys/bus/pci/devices/" + pciBusId + "/numa_node", line, sizeof(line)))
+    return -1;
+  int id = atoi(line);
+  if (id < 0)
+    return -1;
+  for (int i = 0; i < (int)nodeIds.size(); i++)
+    if (nodeIds[i] == id)
+      return i;
+  return -1;
+#endif
+
+}
+
+bool Numa::PinThread(vector<int> &cpus) {
+
+#ifdef WIN64
+  DWORD_PTR mask = 0;
+  for (int i = 0; i < (int)cpus.size(); i++)
+    if (cpus[i] < 64)
+      mask |= (DWORD_PTR)1 << cpus[i];
+  return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int i = 0; i < (int)cpus.size(); i++)
+    CPU_SET(cpus[i], &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+
+}
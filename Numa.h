@@ -0,0 +1,51 @@
+/*
+ * This file is part of the VanitySearch distribution (https://github.com/JeanLucPons/VanitySearch).
+ * Copyright (c) 2019 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NUMAH
+#define NUMAH
+
+#include <string>
+#include <vector>
+
+// NUMA topology and thread placement
+class Numa {
+
+public:
+
+  // Reads the node topology (a single node holding all cpus when unknown)
+  static void Init();
+
+  static int GetNbNode();
+
+  // Cpus of a node the process is allowed to run on
+  static std::vector<int> &GetCpus(int node);
+
+  // Node index of a PCI device ("0000:3b:00.0"), -1 if unknown or if the
+  // process is not allowed to run on the cpus of its node
+  static int GetDeviceNode(std::string pciBusId);
+
+  // Sets the affinity of the calling thread, returns false on failure
+  static bool PinThread(std::vector<int> &cpus);
+
+private:
+
+  static std::vector< std::vector<int> > nodes;
+  static std::vector<int> nodeIds;   // System node id of each node, -1 if unknown
+
+};
+
+#endif // NUMAH
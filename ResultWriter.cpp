@@ -0,0 +1,424 @@
+/*
+ * This file is part of the VanitySearch distribution (https://github.com/JeanLucPons/VanitySearch).
+ * Copyright (c) 2019 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ResultWriter.h"
+#include "SECP256k1.h"
+#include "Timer.h"
+#include <signal.h>
+#include <stdlib.h>
+#include <atomic>
+#ifdef WIN64
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static vector<ResultWriter *> writers;
+static volatile sig_atomic_t signaled = 0;
+static volatile sig_atomic_t nbSignal = 0;
+static std::atomic<int> nbHandled(0);
+static void (*interruptHandler)(int sig, void *arg) = NULL;
+static void *interruptArg = NULL;
+
+#ifdef WIN64
+static HANDLE writersMutex = CreateMutex(NULL, FALSE, NULL);
+#else
+static pthread_mutex_t writersMutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void onSignal(int sig) {
+  // Handled by the flush threads
+  signaled = sig;
+  nbSignal = nbSignal + 1;
+}
+
+#ifdef WIN64
+DWORD WINAPI _FlushThread(LPVOID lpParam) {
+#else
+void *_FlushThread(void *lpParam) {
+#endif
+  ResultWriter *w = (ResultWriter *)lpParam;
+  w->FlushThread();
+  return 0;
+}
+
+// ----------------------------------------------------------------------------
+
+ResultWriter::ResultWriter(string fileName, int format, int syncMode, uint32_t syncValue, bool binary) {
+
+  this->fileName = fileName;
+  this->addrLabel = "PubAddress: ";
+  this->format = format;
+  this->syncMode = syncMode;
+  this->syncValue = syncValue;
+  f = NULL;
+  nbPending = 0;
+  nbUnsynced = 0;
+  lastSync = Timer::get_tick();
+  empty = true;
+  stopFlush = false;
+  flushRunning = false;
+
+#ifdef WIN64
+  bufferMutex = CreateMutex(NULL, FALSE, NULL);
+  fileMutex = CreateMutex(NULL, FALSE, NULL);
+#else
+  pthread_mutex_init(&bufferMutex, NULL);
+  pthread_mutex_init(&fileMutex, NULL);
+#endif
+
+  if (fileName.length() == 0)
+    return;
+
+  // Persistent handle, records are buffered in memory and written by the flush thread
+  f = fopen(fileName.c_str(), binary ? "ab" : "a");
+  if (f == NULL) {
+    printf("Cannot open %s for writing\n", fileName.c_str());
+    exit(-1);
+  }
+  fseek(f, 0, SEEK_END);
+  empty = (ftell(f) == 0);
+
+#ifdef WIN64
+  WaitForSingleObject(writersMutex, INFINITE);
+#else
+  pthread_mutex_lock(&writersMutex);
+#endif
+  if (writers.size() == 0) {
+    atexit(ResultWriter::closeAll);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+  }
+  writers.push_back(this);
+#ifdef WIN64
+  ReleaseMutex(writersMutex);
+#else
+  pthread_mutex_unlock(&writersMutex);
+#endif
+
+  flushRunning = true;
+#ifdef WIN64
+  DWORD thread_id;
+  flushThread = CreateThread(NULL, 0, _FlushThread, (void*)this, 0, &thread_id);
+#else
+  pthread_create(&flushThread, NULL, &_FlushThread, (void*)this);
+#endif
+
+}
+
+ResultWriter::~ResultWriter() {
+  close();
+}
+
+// ----------------------------------------------------------------------------
+
+void ResultWriter::lock() {
+#ifdef WIN64
+  WaitForSingleObject(bufferMutex, INFINITE);
+#else
+  pthread_mutex_lock(&bufferMutex);
+#endif
+}
+
+void ResultWriter::unlock() {
+#ifdef WIN64
+  ReleaseMutex(bufferMutex);
+#else
+  pthread_mutex_unlock(&bufferMutex);
+#endif
+}
+
+string ResultWriter::getFileName() {
+  return fileName;
+}
+
+int ResultWriter::getFormat() {
+  return format;
+}
+
+void ResultWriter::setAddressLabel(string label) {
+  addrLabel = label;
+}
+
+bool ResultWriter::isEmpty() {
+  return empty;
+}
+
+// ----------------------------------------------------------------------------
+
+void ResultWriter::write(int type, string addr, string wif, string hex, bool partial) {
+
+  string r;
+
+  switch (format) {
+
+  case RESULT_JSONL:
+    r = "{\"address\":\"" + addr + "\",\"type\":\"" + addressTypes[type] + "\",\"wif\":\"" + wif +
+        "\",\"hex\":\"" + hex + "\",\"partial\":" + (partial ? "true" : "false") + "}\n";
+    break;
+
+  case RESULT_CSV:
+    if (empty && nbPending == 0)
+      r = "address,type,wif,hex\n";
+    r += addr + "," + addressTypes[type] + "," + wif + "," + hex + "\n";
+    break;
+
+  default:
+    if (type == PUBKEY)
+      r = "PubKey: " + addr + "\n";
+    else
+      r = addrLabel + addr + "\n";
+    if (partial) {
+      r += "PartialPriv: " + wif + "\n";
+    } else {
+      switch (type) {
+      case PUBKEY:
+      case P2PKH:
+        r += "Priv (WIF): p2pkh:" + wif + "\n";
+        break;
+      case P2SH:
+        r += "Priv (WIF): p2wpkh-p2sh:" + wif + "\n";
+        break;
+      case BECH32:
+        r += "Priv (WIF): p2wpkh:" + wif + "\n";
+        break;
+      case P2TR:
+        // Key of the output key itself, wallets tweak an imported key (BIP86)
+        r += "Priv (WIF): " + wif + " (untweaked key, not importable as BIP86)\n";
+        break;
+      }
+      r += "Priv (HEX): 0x" + hex + "\n";
+    }
+    break;
+
+  }
+
+  if (f == NULL) {
+    // Console
+    lock();
+    printf("\n%s", r.c_str());
+    unlock();
+    return;
+  }
+
+  writeRaw(r.c_str(), r.length(), 1);
+
+}
+
+void ResultWriter::writeRaw(const void *data, size_t length, uint32_t nbRecord) {
+
+  lock();
+  buffer.append((const char *)data, length);
+  nbPending += nbRecord;
+  bool needFlush = buffer.length() >= WRITER_BUFFER_SIZE ||
+                   (syncMode == FSYNC_RECORDS && nbUnsynced + nbPending >= syncValue);
+  unlock();
+
+  if (needFlush)
+    flush();
+
+}
+
+// ----------------------------------------------------------------------------
+
+void ResultWriter::sync() {
+
+  fflush(f);
+#ifdef WIN64
+  _commit(_fileno(f));
+#else
+  fsync(fileno(f));
+#endif
+  nbUnsynced = 0;
+  lastSync = Timer::get_tick();
+
+}
+
+void ResultWriter::flush(bool forceSync) {
+
+  // Buffers are swapped so that writers are not blocked by the file I/O
+  string data;
+  uint32_t nbRecord;
+
+#ifdef WIN64
+  WaitForSingleObject(fileMutex, INFINITE);
+#else
+  pthread_mutex_lock(&fileMutex);
+#endif
+
+  if (f == NULL) {
+#ifdef WIN64
+    ReleaseMutex(fileMutex);
+#else
+    pthread_mutex_unlock(&fileMutex);
+#endif
+    return;
+  }
+
+  lock();
+  data.swap(buffer);
+  nbRecord = nbPending;
+  nbPending = 0;
+  unlock();
+
+  if (data.length() > 0) {
+    fwrite(data.c_str(), 1, data.length(), f);
+    fflush(f);
+    nbUnsynced += nbRecord;
+    empty = false;
+  }
+
+  switch (syncMode) {
+  case FSYNC_RECORDS:
+    if (nbUnsynced >= syncValue)
+      sync();
+    break;
+  case FSYNC_TIME:
+    if (nbUnsynced > 0 && (Timer::get_tick() - lastSync) * 1000.0 >= syncValue)
+      sync();
+    break;
+  }
+  if (forceSync && nbUnsynced > 0)
+    sync();
+
+#ifdef WIN64
+  ReleaseMutex(fileMutex);
+#else
+  pthread_mutex_unlock(&fileMutex);
+#endif
+
+}
+
+// ----------------------------------------------------------------------------
+
+void ResultWriter::FlushThread() {
+
+  uint32_t period = WRITER_FLUSH_MS;
+  if (syncMode == FSYNC_TIME && syncValue < period)
+    period = (syncValue > 0) ? syncValue : 1;
+
+  while (!stopFlush) {
+
+    Timer::SleepMillis(period);
+    flush();
+
+    if (nbSignal != nbHandled)
+      interrupt();
+
+  }
+
+}
+
+void ResultWriter::interrupt() {
+
+  // Each signal is handled once, by the first flush thread seeing it
+  int n = nbSignal;
+  int h = nbHandled.exchange(n);
+  if (h == n)
+    return;
+
+  if (h == 0 && interruptHandler) {
+    interruptHandler(signaled, interruptArg);
+    return;
+  }
+
+  // No search to stop, or stop already asked: nothing must be lost
+#ifdef WIN64
+  WaitForSingleObject(writersMutex, INFINITE);
+#else
+  pthread_mutex_lock(&writersMutex);
+#endif
+  for (int i = 0; i < (int)writers.size(); i++)
+    writers[i]->flush(true);
+#ifdef WIN64
+  ReleaseMutex(writersMutex);
+#else
+  pthread_mutex_unlock(&writersMutex);
+#endif
+  fflush(stdout);
+  signal(signaled, SIG_DFL);
+  raise(signaled);
+
+}
+
+void ResultWriter::setInterruptHandler(void (*handler)(int sig, void *arg), void *arg) {
+
+  interruptArg = arg;
+  interruptHandler = handler;
+
+}
+
+int ResultWriter::getSignal() {
+  return signaled;
+}
+
+void ResultWriter::close() {
+
+  if (f == NULL)
+    return;
+
+  stopFlush = true;
+  if (flushRunning) {
+#ifdef WIN64
+    WaitForSingleObject(flushThread, INFINITE);
+    CloseHandle(flushThread);
+#else
+    pthread_join(flushThread, NULL);
+#endif
+    flushRunning = false;
+  }
+
+  flush();
+
+#ifdef WIN64
+  WaitForSingleObject(fileMutex, INFINITE);
+#else
+  pthread_mutex_lock(&fileMutex);
+#endif
+  if (syncMode != FSYNC_NONE)
+    sync();
+  fclose(f);
+  f = NULL;
+#ifdef WIN64
+  ReleaseMutex(fileMutex);
+#else
+  pthread_mutex_unlock(&fileMutex);
+#endif
+
+}
+
+void ResultWriter::closeAll() {
+
+  // Closed outside of the lock, a flush thread handling a signal may need it
+#ifdef WIN64
+  WaitForSingleObject(writersMutex, INFINITE);
+#else
+  pthread_mutex_lock(&writersMutex);
+#endif
+  vector<ResultWriter *> all = writers;
+#ifdef WIN64
+  ReleaseMutex(writersMutex);
+#else
+  pthread_mutex_unlock(&writersMutex);
+#endif
+
+  for (int i = 0; i < (int)all.size(); i++)
+    all[i]->close();
+
+}
@@ -0,0 +1,120 @@
+/*
+ * This file is part of the VanitySearch distribution (https://github.com/JeanLucPons/VanitySearch).
+ * Copyright (c) 2019 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RESULTWRITERH
+#define RESULTWRITERH
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdint.h>
+#ifdef WIN64
+#include <Windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// Record formats
+#define RESULT_TEXT  0   // PubAddress/Priv lines
+#define RESULT_JSONL 1   // One JSON object per line
+#define RESULT_CSV   2   // address,type,wif,hex
+
+// Durability policy
+#define FSYNC_NONE    0
+#define FSYNC_RECORDS 1  // fsync every N records
+#define FSYNC_TIME    2  // fsync every T ms
+
+#define WRITER_FLUSH_MS 100        // Background flush period
+#define WRITER_BUFFER_SIZE (4<<20) // Writers flush themselves above this size
+
+class ResultWriter {
+
+public:
+
+  // An empty fileName writes text records to stdout, unbuffered
+  ResultWriter(std::string fileName, int format, int syncMode, uint32_t syncValue, bool binary);
+  ~ResultWriter();
+
+  // Formats and queues a result
+  void write(int type, std::string addr, std::string wif, std::string hex, bool partial);
+
+  // Queues already formatted records (harvest mode)
+  void writeRaw(const void *data, size_t length, uint32_t nbRecord);
+
+  // Address label of the text records, "PubAddress: " by default (read back by -rp)
+  void setAddressLabel(std::string label);
+
+  // True if nothing has been written in the file yet (CSV header)
+  bool isEmpty();
+
+  // Writes the buffered records to the file, fsync according to the policy
+  // or forced (checkpoints)
+  void flush(bool forceSync = false);
+
+  // Final flush, fsync and close
+  void close();
+
+  // Closes all writers (normal exit)
+  static void closeAll();
+
+  // Called by a flush thread on the first SIGINT/SIGTERM, the search stops
+  // and closes its writer. Without handler, or on the next signal, the
+  // records are written and the process is killed by the signal.
+  static void setInterruptHandler(void (*handler)(int sig, void *arg), void *arg);
+
+  // Signal received, 0 if none
+  static int getSignal();
+
+  void FlushThread();
+
+  std::string getFileName();
+  int getFormat();
+
+private:
+
+  void lock();
+  void unlock();
+  void sync();
+  static void interrupt();
+
+  std::string fileName;
+  std::string addrLabel;
+  int format;
+  int syncMode;
+  uint32_t syncValue;
+  FILE *f;
+  std::string buffer;
+  uint32_t nbPending;      // Records in buffer
+  uint32_t nbUnsynced;     // Records written since the last fsync
+  double lastSync;
+  bool empty;
+  volatile bool stopFlush;
+  bool flushRunning;       // Flush thread not joined yet
+
+#ifdef WIN64
+  HANDLE flushThread;
+  HANDLE bufferMutex;
+  HANDLE fileMutex;
+#else
+  pthread_t flushThread;
+  pthread_mutex_t bufferMutex;
+  pthread_mutex_t fileMutex;
+#endif
+
+};
+
+#endif // RESULTWRITERH
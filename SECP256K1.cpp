@@ -20,6 +20,7 @@
 #include "hash/ripemd160.h"
 #include "Base58.h"
 #include "Bech32.h"
+#include "IntGroup.h"
 #include <string.h>
 
 Secp256K1::Secp256K1() {
@@ -83,7 +84,7 @@ void CheckAddress(Secp256K1 *T,std::string address,std::string privKeyStr) {
     type = P2SH; break;
   case 'b':
   case 'B':
-    type = BECH32; break;
+    type = (tolower(address.data()[3]) == 'p') ? P2TR : BECH32; break;
   default:
     printf("Failed ! \n%s Address format not supported\n", address.c_str());
     return;
@@ -147,6 +148,7 @@ void Secp256K1::Check() {
   CheckAddress(this,"3CyQYcByvcWK8BkYJabBS82yDLNWt6rWSx","KxMUSkFhEzt2eJHscv2vNSTnnV2cgAXgL4WDQBTx7Ubd9TZmACAz");
   CheckAddress(this,"31to1KQe67YjoDfYnwFJThsGeQcFhVDM5Q","KxV2Tx5jeeqLHZ1V9ufNv1doTZBZuAc5eY24e6b27GTkDhYwVad7");
   CheckAddress(this,"bc1q6tqytpg06uhmtnhn9s4f35gkt8yya5a24dptmn","L2wAVD273GwAxGuEDHvrCqPfuWg5wWLZWy6H3hjsmhCvNVuCERAQ");
+  CheckAddress(this,"bc1p0xlxvlhemja6c4dqv22uapctqupfhlxm9h8z3k2e72q4k9hcz7vqzk5jj0","KwDiBf89QgGbjEhKnhXJuH7LrciVrZi3qYjgd9M7rFU73sVHnoWn");
 
   // 1ViViGLEawN27xRzGrEhhYPQrZiTKvKLo
   pub.x.SetBase16(/*04*/"75249c39f38baa6bf20ab472191292349426dc3652382cdc45f65695946653dc");
@@ -196,6 +198,56 @@ Point Secp256K1::ComputePublicKey(Int *privKey) {
 
 }
 
+// Same as ComputePublicKey(), the projective to affine conversions
+// share a single modular inversion
+void Secp256K1::ComputePublicKeys(std::vector<Int> &privKeys, std::vector<Point> &pubKeys) {
+
+  int n = (int)privKeys.size();
+  pubKeys.resize(n);
+  if (n == 0)
+    return;
+
+  for (int j = 0; j < n; j++) {
+
+    int i = 0;
+    uint8_t b;
+    Point Q;
+
+    for (i = 0; i < 32; i++) {
+      b = privKeys[j].GetByte(i);
+      if (b)
+        break;
+    }
+    Q = GTable[256 * i + (b - 1)];
+    i++;
+
+    for (; i < 32; i++) {
+      b = privKeys[j].GetByte(i);
+      if (b)
+        Q = Add2(Q, GTable[256 * i + (b - 1)]);
+    }
+
+    pubKeys[j] = Q;
+
+  }
+
+  Int *zInv = new Int[n];
+  for (int j = 0; j < n; j++)
+    zInv[j].Set(&pubKeys[j].z);
+  IntGroup grp(n);
+  grp.Set(zInv);
+  grp.ModInv();
+
+  for (int j = 0; j < n; j++) {
+    pubKeys[j].x.ModMulK1(&zInv[j]);
+    pubKeys[j].y.ModMulK1(&zInv[j]);
+    pubKeys[j].z.SetInt32(1);
+  }
+
+  delete[] zInv;
+
+}
+
 Point Secp256K1::NextKey(Point &key) {
   // Input key must be reduced and different from G
   // in order to use AddDirect
@@ -409,20 +461,7 @@ void Secp256K1::GetHash160(int type,bool compressed,
     unsigned char kh3[20];
 
     GetHash160(P2PKH,compressed,k0,k1,k2,k3,kh0,kh1,kh2,kh3);
-
-    // Redeem Script (1 to 1 P2SH)
-    uint32_t b0[16];
-    uint32_t b1[16];
-    uint32_t b2[16];
-    uint32_t b3[16];
-
-    KEYBUFFSCRIPT(b0, kh0);
-    KEYBUFFSCRIPT(b1, kh1);
-    KEYBUFFSCRIPT(b2, kh2);
-    KEYBUFFSCRIPT(b3, kh3);
-
-    sha256sse_1B(b0, b1, b2, b3, sh0, sh1, sh2, sh3);
-    ripemd160sse_32(sh0, sh1, sh2, sh3, h0, h1, h2, h3);
+    GetScriptHash160(kh0,kh1,kh2,kh3,h0,h1,h2,h3);
 
   }
   break;
@@ -431,6 +470,37 @@ void Secp256K1::GetHash160(int type,bool compressed,
 
 }
 
+void Secp256K1::GetScriptHash160(uint8_t *kh0, uint8_t *kh1, uint8_t *kh2, uint8_t *kh3,
+                                 uint8_t *h0, uint8_t *h1, uint8_t *h2, uint8_t *h3) {
+
+#ifdef WIN64
+  __declspec(align(16)) unsigned char sh0[64];
+  __declspec(align(16)) unsigned char sh1[64];
+  __declspec(align(16)) unsigned char sh2[64];
+  __declspec(align(16)) unsigned char sh3[64];
+#else
+  unsigned char sh0[64] __attribute__((aligned(16)));
+  unsigned char sh1[64] __attribute__((aligned(16)));
+  unsigned char sh2[64] __attribute__((aligned(16)));
+  unsigned char sh3[64] __attribute__((aligned(16)));
+#endif
+
+  // Redeem Script (1 to 1 P2SH)
+  uint32_t b0[16];
+  uint32_t b1[16];
+  uint32_t b2[16];
+  uint32_t b3[16];
+
+  KEYBUFFSCRIPT(b0, kh0);
+  KEYBUFFSCRIPT(b1, kh1);
+  KEYBUFFSCRIPT(b2, kh2);
+  KEYBUFFSCRIPT(b3, kh3);
+
+  sha256sse_1B(b0, b1, b2, b3, sh0, sh1, sh2, sh3);
+  ripemd160sse_32(sh0, sh1, sh2, sh3, h0, h1, h2, h3);
+
+}
+
 uint8_t Secp256K1::GetByte(std::string &str, int idx) {
 
   char tmp[3];
@@ -583,15 +653,9 @@ void Secp256K1::GetHash160(int type, bool compressed, Point &pubKey, unsigned ch
   case P2SH:
   {
 
-    // Redeem Script (1 to 1 P2SH)
-    unsigned char script[64];
-
-    script[0] = 0x00;  // OP_0
-    script[1] = 0x14;  // PUSH 20 bytes
-    GetHash160(P2PKH, compressed, pubKey, script + 2);
-
-    sha256(script, 22, shapk);
-    ripemd160_32(shapk, hash);
+    unsigned char keyHash[20];
+    GetHash160(P2PKH, compressed, pubKey, keyHash);
+    GetScriptHash160(keyHash, hash);
 
   }
   break;
@@ -600,6 +664,22 @@ void Secp256K1::GetHash160(int type, bool compressed, Point &pubKey, unsigned ch
 
 }
 
+void Secp256K1::GetScriptHash160(unsigned char *keyHash, unsigned char *hash) {
+
+  unsigned char shapk[64];
+
+  // Redeem Script (1 to 1 P2SH)
+  unsigned char script[64];
+
+  script[0] = 0x00;  // OP_0
+  script[1] = 0x14;  // PUSH 20 bytes
+  memcpy(script + 2, keyHash, 20);
+
+  sha256(script, 22, shapk);
+  ripemd160_32(shapk, hash);
+
+}
+
 std::string Secp256K1::GetPrivAddress(bool compressed,Int &privKey) {
 
   unsigned char address[38];
@@ -698,15 +778,49 @@ std::vector<std::string> Secp256K1::GetAddress(int type, bool compressed, unsign
   sha256sse_checksum(b1,b2,b3,b4,add1 + 21, add2 + 21, add3 + 21, add4 + 21);
 
   // Base58
-  ret.push_back(EncodeBase58(add1, add1 + 25));
-  ret.push_back(EncodeBase58(add2, add2 + 25));
-  ret.push_back(EncodeBase58(add3, add3 + 25));
-  ret.push_back(EncodeBase58(add4, add4 + 25));
+  char s1[40];
+  char s2[40];
+  char s3[40];
+  char s4[40];
+  EncodeBase58Address(add1, add2, add3, add4, s1, s2, s3, s4);
+  ret.push_back(std::string(s1));
+  ret.push_back(std::string(s2));
+  ret.push_back(std::string(s3));
+  ret.push_back(std::string(s4));
 
   return ret;
 
 }
 
+void Secp256K1::GetAddressBytes(int type, unsigned char *h1, unsigned char *h2, unsigned char *h3, unsigned char *h4,
+                                unsigned char *p1, unsigned char *p2, unsigned char *p3, unsigned char *p4) {
+
+  uint32_t b1[16];
+  uint32_t b2[16];
+  uint32_t b3[16];
+  uint32_t b4[16];
+
+  p1[0] = p2[0] = p3[0] = p4[0] = (type == P2SH) ? 0x05 : 0x00;
+  memcpy(p1 + 1, h1, 20);
+  memcpy(p2 + 1, h2, 20);
+  memcpy(p3 + 1, h3, 20);
+  memcpy(p4 + 1, h4, 20);
+  CHECKSUM(b1, p1);
+  CHECKSUM(b2, p2);
+  CHECKSUM(b3, p3);
+  CHECKSUM(b4, p4);
+  sha256sse_checksum(b1, b2, b3, b4, p1 + 21, p2 + 21, p3 + 21, p4 + 21);
+
+}
+
+void Secp256K1::GetAddressBytes(int type, unsigned char *hash160, unsigned char *payload) {
+
+  payload[0] = (type == P2SH) ? 0x05 : 0x00;
+  memcpy(payload + 1, hash160, 20);
+  sha256_checksum(payload, 21, payload + 21);
+
+}
+
 std::string Secp256K1::GetAddress(int type, bool compressed,unsigned char *hash160) {
 
   unsigned char address[25];
@@ -732,7 +846,9 @@ std::string Secp256K1::GetAddress(int type, bool compressed,unsigned char *hash1
   sha256_checksum(address,21,address+21);
 
   // Base58
-  return EncodeBase58(address, address + 25);
+  char str[40];
+  EncodeBase58Address(address, str);
+  return std::string(str);
 
 }
 
@@ -742,6 +858,19 @@ std::string Secp256K1::GetAddress(int type, bool compressed, Point &pubKey) {
 
   switch (type) {
 
+  case PUBKEY:
+    return GetPublicKeyHex(compressed, pubKey);
+
+  case P2TR:
+  {
+    // Witness v1 program is the x-only output key (no BIP341 tweak)
+    char output[128];
+    uint8_t xOnly[32];
+    pubKey.x.Get32Bytes(xOnly);
+    segwit_addr_encode(output, "bc", 1, xOnly, 32);
+    return std::string(output);
+  }
+
   case P2PKH:
     address[0] = 0x00;
     break;
@@ -771,7 +900,9 @@ std::string Secp256K1::GetAddress(int type, bool compressed, Point &pubKey) {
   sha256_checksum(address, 21, address + 21);
 
   // Base58
-  return EncodeBase58(address, address + 25);
+  char str[40];
+  EncodeBase58Address(address, str);
+  return std::string(str);
 
 }
 
@@ -26,6 +26,10 @@
 #define P2PKH  0
 #define P2SH   1
 #define BECH32 2
+#define PUBKEY 3  // Public key (hex), no address
+#define P2TR   4  // Taproot, untweaked x-only output key
+
+static const char *addressTypes[] = {"P2PKH","P2SH","BECH32","PUBKEY","P2TR"};
 
 class Secp256K1 {
 
@@ -35,6 +39,7 @@ public:
   ~Secp256K1();
   void Init();
   Point ComputePublicKey(Int *privKey);
+  void ComputePublicKeys(std::vector<Int> &privKeys, std::vector<Point> &pubKeys);
   Point NextKey(Point &key);
   void Check();
   bool  EC(Point &p);
@@ -45,9 +50,19 @@ public:
 
   void GetHash160(int type,bool compressed, Point &pubKey, unsigned char *hash);
 
+  // P2SH (P2WPKH nested) script hash from an already computed public key hash160
+  void GetScriptHash160(uint8_t *kh0, uint8_t *kh1, uint8_t *kh2, uint8_t *kh3,
+                        uint8_t *h0, uint8_t *h1, uint8_t *h2, uint8_t *h3);
+  void GetScriptHash160(unsigned char *keyHash, unsigned char *hash);
+
   std::string GetAddress(int type, bool compressed, Point &pubKey);
   std::string GetAddress(int type, bool compressed, unsigned char *hash160);
   std::vector<std::string> GetAddress(int type, bool compressed, unsigned char *h1, unsigned char *h2, unsigned char *h3, unsigned char *h4);
+
+  // Base58Check payload (version, hash160, checksum) of P2PKH/P2SH addresses
+  void GetAddressBytes(int type, unsigned char *hash160, unsigned char *payload);
+  void GetAddressBytes(int type, unsigned char *h1, unsigned char *h2, unsigned char *h3, unsigned char *h4,
+                       unsigned char *p1, unsigned char *p2, unsigned char *p3, unsigned char *p4);
   std::string GetPrivAddress(bool compressed, Int &privKey );
   std::string GetPublicKeyHex(bool compressed, Point &p);
   Point ParsePublicKeyHex(std::string str, bool &isCompressed);
@@ -31,8 +31,75 @@ LARGE_INTEGER Timer::qwTicksPerSec;
 #include <sys/time.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sched.h>
 time_t Timer::tickStart;
 
+// Number of cpus allowed by the cgroup v2 (cpu.max) or v1 (cfs quota)
+// limits of the process and of its parents, -1 if unlimited
+static double getCgroupQuota() {
+
+  double quota = -1.0;
+  char line[512];
+  FILE *f;
+
+  // cgroup v2, "0::/path" in /proc/self/cgroup
+  std::string path = "";
+  f = fopen("/proc/self/cgroup", "r");
+  if (f) {
+    while (fgets(line, sizeof(line), f)) {
+      if (strncmp(line, "0::", 3) == 0) {
+        path = std::string(line + 3);
+        while (path.length() > 0 && (path.back() == '\n' || path.back() == '/'))
+          path.pop_back();
+      }
+    }
+    fclose(f);
+  }
+
+  while (true) {
+    f = fopen(("/sys/fs/cgroup" + path + "/cpu.max").c_str(), "r");
+    if (f) {
+      char max[64];
+      double period;
+      if (fscanf(f, "%63s %lf", max, &period) == 2 && strcmp(max, "max") != 0 && period > 0) {
+        double q = atof(max) / period;
+        if (quota < 0 || q < quota)
+          quota = q;
+      }
+      fclose(f);
+    }
+    if (path.length() == 0)
+      break;
+    size_t pos = path.find_last_of('/');
+    path = (pos == std::string::npos) ? "" : path.substr(0, pos);
+  }
+
+  // cgroup v1
+  const char *v1[] = { "/sys/fs/cgroup/cpu", "/sys/fs/cgroup/cpu,cpuacct" };
+  for (int i = 0; i < 2; i++) {
+    double q = -1.0;
+    double period = 0.0;
+    f = fopen((std::string(v1[i]) + "/cpu.cfs_quota_us").c_str(), "r");
+    if (f) {
+      if (fscanf(f, "%lf", &q) != 1) q = -1.0;
+      fclose(f);
+    }
+    f = fopen((std::string(v1[i]) + "/cpu.cfs_period_us").c_str(), "r");
+    if (f) {
+      if (fscanf(f, "%lf", &period) != 1) period = 0.0;
+      fclose(f);
+    }
+    if (q > 0 && period > 0 && (quota < 0 || q / period < quota))
+      quota = q / period;
+  }
+
+  return quota;
+
+}
+
 #endif
 
 void Timer::Init() {
@@ -159,13 +226,44 @@ void Timer::printResult(char *unit, int nbTry, double t0, double t1) {
 
 int Timer::getCoreNumber() {
 
+#ifdef WIN64
+  DWORD_PTR procMask, sysMask;
+  if (GetProcessAffinityMask(GetCurrentProcess(), &procMask, &sysMask)) {
+    int nb = 0;
+    for (; procMask; procMask >>= 1)
+      nb += (int)(procMask & 1);
+    if (nb > 0)
+      return nb;
+  }
+  SYSTEM_INFO sysinfo;
+  GetSystemInfo(&sysinfo);
+  return sysinfo.dwNumberOfProcessors;
+#else
+  int nb = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    nb = CPU_COUNT(&set);
+
+  // Partial cores are rounded up
+  double quota = getCgroupQuota();
+  if (quota > 0 && (int)ceil(quota) < nb)
+    nb = (int)ceil(quota);
+
+  return (nb > 0) ? nb : 1;
+#endif
+
+}
+
+int Timer::getMaxCoreNumber() {
+
 #ifdef WIN64
   SYSTEM_INFO sysinfo;
   GetSystemInfo(&sysinfo);
   return sysinfo.dwNumberOfProcessors;
 #else
-  // TODO
-  return 1;
+  int nb = (int)sysconf(_SC_NPROCESSORS_CONF);
+  return (nb > 0) ? nb : 1;
 #endif
 
 }
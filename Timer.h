@@ -31,7 +31,8 @@ public:
   static double get_tick();
   static void printResult(char *unit, int nbTry, double t0, double t1);
   static std::string getResult(char *unit, int nbTry, double t0, double t1);
-  static int getCoreNumber();
+  static int getCoreNumber();      // Usable cores (affinity and cgroup quota)
+  static int getMaxCoreNumber();   // Cores of the host
   static std::string getSeed(int size);
   static uint32_t getSeed32();
   static void SleepMillis(uint32_t millis);
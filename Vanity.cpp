@@ -4,6 +4,10 @@
 #include "hash/sha256.h"
 #include "hash/sha512.h"
 #include "IntGroup.h"
+#include "Numa.h"
+#include "Coordinator.h"
+#include "WorkerLink.h"
+#include <signal.h>
 #include "Wildcard.h"
 #include "Timer.h"
 #include "hash/ripemd160.h"
@@ -12,6 +16,8 @@
 #include <algorithm>
 #ifndef WIN64
 #include <pthread.h>
+#include <semaphore.h>
+#include <errno.h>
 #endif
 
 using namespace std;
@@ -19,33 +25,124 @@ using namespace std;
 Point Gn[CPU_GRP_SIZE / 2];
 Point _2Gn;
 
+// Harvest mode, lookup hits of the calling thread (NULL when not harvesting)
+static thread_local std::vector<HARVEST_ITEM> *harvestItems = NULL;
+
+// Lookup buckets of the calling thread, see enterLookup()
+static thread_local PREFIX_TABLE_ITEM *tLookup = NULL;
+
+// CPU threads to add (SIGUSR1) or remove (SIGUSR2)
+static std::atomic<int> threadRequest(0);
+
+#ifndef WIN64
+// Posted by the signal handler (async-signal-safe), waited by the signal watcher
+static sem_t threadSignal;
+static std::atomic<bool> watchStop(false);
+
+static void onThreadSignal(int sig) {
+  threadRequest += (sig == SIGUSR1) ? 1 : -1;
+  sem_post(&threadSignal);
+}
+#endif
+
+// NUMA node of the calling search thread (NULL when not pinned)
+static thread_local NUMA_NODE *tNode = NULL;
+
+// Stats block of the calling search thread (NULL for other threads)
+static thread_local THREAD_STATS *tStats = NULL;
+
+// Single writer counter, no need for a locked add
+static inline void addStat(std::atomic<uint64_t> &c, uint64_t v) {
+  c.store(c.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+}
+
+static bool difficultyGreater(const DIFFICULTY_ITEM &a, const DIFFICULTY_ITEM &b) {
+  return a.difficulty > b.difficulty;
+}
+
 // ----------------------------------------------------------------------------
 
 VanitySearch::VanitySearch(Secp256K1 *secp, vector<std::string> &prefix,string seed,int searchMode,
-                           bool useGpu, bool stop, string outputFile, bool useSSE, uint32_t maxFound,
+                           bool useGpu, bool stop, ResultWriter *writer, bool useSSE, uint32_t maxFound,
                            uint64_t rekey, bool caseSensitive, Point &startPubKey, bool paranoiacSeed,
-                           uint32_t rangeStart, uint32_t rangeEnd, uint32_t keysPerThread)
+                           Int &rangeStart, Int &rangeEnd, bool rangeStrict,
+                           bool rangeRandom, int chunkBits, int harvest, uint32_t statsInterval, bool useNuma, string ctlFile,
+                           string ckptFile, uint32_t ckptInterval, bool resume,
+                           string coordAddr, string workerAddr, string queueDir, uint32_t leaseTimeout)
   :inputPrefixes(prefix) {
 
   this->secp = secp;
   this->searchMode = searchMode;
   this->useGpu = useGpu;
   this->stopWhenFound = stop;
-  this->outputFile = outputFile;
+  this->writer = writer;
   this->useSSE = useSSE;
   this->nbGPUThread = 0;
   this->maxFound = maxFound;
   this->rekey = rekey;
   this->searchType = -1;
+  this->hasHash160 = false;
+  this->hasP2SH = false;
   this->startPubKey = startPubKey;
   this->hasPattern = false;
   this->caseSensitive = caseSensitive;
   this->startPubKeySpecified = !startPubKey.isZero();
-  this->rangeStart = rangeStart;
-  this->rangeEnd = rangeEnd;
-  this->keysPerThread = keysPerThread;
+  this->rangeStart.Set(&rangeStart);
+  this->rangeEnd.Set(&rangeEnd);
+  this->rangeMode = !rangeEnd.IsZero();
+  // Range of a worker given by the coordinator or the job directory
+  this->linked = workerAddr.length() > 0 || queueDir.length() > 0;
+  this->rangeStrict = rangeStrict && (rangeMode || linked);
+  this->rangeRandom = rangeRandom && rangeMode;
+  this->rangePool = this->rangeRandom || linked;
+  this->nbChunk = 0;
+  this->chunkReq.SetInt32(0);
+  if (chunkBits > 0) {
+    this->chunkReq.SetInt32(1);
+    this->chunkReq.ShiftL(chunkBits);
+  }
+  this->chunkCursor = 0;
+  this->nbChunkDone = 0;
+  this->slots = NULL;
+  this->ckptFile = ckptFile;
+  this->ckptInterval = ckptInterval;
+  this->resume = resume;
+  this->nbVerifiedHit = 0;
+  this->coordAddr = coordAddr;
+  this->workerAddr = workerAddr;
+  this->leaseTimeout = leaseTimeout;
+  this->queueDir = queueDir;
+  this->link = NULL;
+  this->coordinator = NULL;
+  this->hitQueue = NULL;
+  this->endOfSearch = false;
+  this->interrupted = false;
+  this->gpuDemand = 0;
+  this->harvest = harvest;
+  this->statsInterval = statsInterval;
+  this->events = 0;
+  this->stats = NULL;
+  this->useNuma = useNuma;
+  this->ctlFile = ctlFile;
+  this->numaNodes = NULL;
+  this->nbNumaNode = 0;
+
+#ifdef WIN64
+  ghMutex = CreateMutex(NULL, FALSE, NULL);
+  rangeMutex = CreateMutex(NULL, FALSE, NULL);
+  InitializeCriticalSection(&eventLock);
+  InitializeConditionVariable(&eventCond);
+#else
+  pthread_mutex_init(&ghMutex, NULL);
+  pthread_mutex_init(&rangeMutex, NULL);
+  pthread_mutex_init(&eventLock, NULL);
+  pthread_cond_init(&eventCond, NULL);
+#endif
 
   lastRekey = 0;
+  lookup = NULL;
+  nbPrefixLeft = 0;
+  nbPatternLeft = 0;
   prefixes.clear();
 
   // Create a 65536 items lookup table
@@ -55,13 +152,57 @@ VanitySearch::VanitySearch(Secp256K1 *secp, vector<std::string> &prefix,string s
   for(int i=0;i<65536;i++)
     prefixes.push_back(t);
 
+  // Public keys (hex) cannot be confused with addresses, '0' is not a Base58 digit.
+  // Taproot outputs are also x coordinates.
+  pubKeySearch = inputPrefixes.size() > 0 &&
+                 (inputPrefixes[0].data()[0] == '0' || isTaproot(inputPrefixes[0]));
+
   // Check is inputPrefixes contains wildcard character
-  for (int i = 0; i < (int)inputPrefixes.size() && !hasPattern; i++) {
+  for (int i = 0; i < (int)inputPrefixes.size() && !hasPattern && !pubKeySearch; i++) {
     hasPattern = ((inputPrefixes[i].find('*') != std::string::npos) ||
                    (inputPrefixes[i].find('?') != std::string::npos) );
   }
 
-  if (!hasPattern) {
+  if (pubKeySearch) {
+
+    // Public key and taproot search, x coordinates are compared directly (no hashing)
+    searchType = isTaproot(inputPrefixes[0]) ? P2TR : PUBKEY;
+    xMatcher = new XMatcher();
+    for (int i = 0; i < (int)inputPrefixes.size(); i++) {
+      if (isTaproot(inputPrefixes[i])) {
+        if (!xMatcher->addP2TR(inputPrefixes[i], i))
+          printf("Ignoring prefix \"%s\" (Only \"023456789acdefghjklmnpqrstuvwxyz\" allowed, length<=56)\n", inputPrefixes[i].c_str());
+      } else {
+        if (!xMatcher->add(inputPrefixes[i], i))
+          printf("Ignoring public key \"%s\" (02, 03 or 04 followed by hex digits expected)\n", inputPrefixes[i].c_str());
+      }
+    }
+
+    if (xMatcher->getSize() == 0) {
+      printf("VanitySearch: nothing to search !\n");
+      exit(1);
+    }
+    xMatcher->build();
+
+    patternFound = (bool *)malloc(inputPrefixes.size() * sizeof(bool));
+    memset(patternFound, 0, inputPrefixes.size() * sizeof(bool));
+    nbPatternLeft = xMatcher->getSize();
+    _difficulty = xMatcher->getDifficulty();
+
+    printf("Difficulty: %.0f\n", _difficulty);
+    string searchInfo = (searchType == P2TR) ? "Taproot, untweaked key" : "Public key";
+    if (xMatcher->getSize() == 1) {
+      printf("Search: %s [%s]\n", inputPrefixes[0].c_str(), searchInfo.c_str());
+    } else {
+      printf("Search: %d keys [%s]\n", xMatcher->getSize(), searchInfo.c_str());
+    }
+
+    if (useGpu) {
+      printf("Warning, public key and taproot search not supported by the GPU kernel, GPU disabled\n");
+      this->useGpu = false;
+    }
+
+  } else if (!hasPattern) {
 
     // No wildcard used, standard search
     // Insert prefixes
@@ -71,6 +212,7 @@ VanitySearch::VanitySearch(Secp256K1 *secp, vector<std::string> &prefix,string s
 
     nbPrefix = 0;
     onlyFull = true;
+    inputFound.assign(inputPrefixes.size(), NULL);
     for (int i = 0; i < (int)inputPrefixes.size(); i++) {
 
       PREFIX_ITEM it;
@@ -78,56 +220,22 @@ VanitySearch::VanitySearch(Secp256K1 *secp, vector<std::string> &prefix,string s
 
       if (!caseSensitive) {
 
-        // For caseunsensitive search, loop through all possible combination
-        // and fill up lookup table
-        vector<string> subList;
-        enumCaseUnsentivePrefix(inputPrefixes[i], subList);
-
-        bool *found = new bool;
-        *found = false;
-
-        for (int j = 0; j < (int)subList.size(); j++) {
-          if (initPrefix(subList[j], &it)) {
-            it.found = found;
-            it.prefix = strdup(it.prefix); // We need to allocate here, subList will be destroyed
-            itPrefixes.push_back(it);
-          }
-        }
-
-        if (itPrefixes.size() > 0) {
-
-          // Compute difficulty for case unsensitive search
-          // Not obvious to perform the right calculation here using standard double
-          // Improvement are welcome
-
-          // Get the min difficulty and divide by the number of item having the same difficulty
-          // Should give good result when difficulty is large enough
-          double dMin = itPrefixes[0].difficulty;
-          int nbMin = 1;
-          for (int j = 1; j < (int)itPrefixes.size(); j++) {
-            if (itPrefixes[j].difficulty == dMin) {
-              nbMin++;
-            } else if (itPrefixes[j].difficulty < dMin) {
-              dMin = itPrefixes[j].difficulty;
-              nbMin = 1;
-            }
-          }
-
-          dMin /= (double)nbMin;
-
-          // Updates
+        // For caseunsensitive search, fill up the lookup table with the
+        // 16 bit prefixes reachable by case variants
+        if (initCaseUnsensitivePrefix(inputPrefixes[i], itPrefixes)) {
+          std::atomic<bool> *found = new std::atomic<bool>(false);
           for (int j = 0; j < (int)itPrefixes.size(); j++)
-            itPrefixes[j].difficulty = dMin;
-
+            itPrefixes[j].found = found;
+          inputFound[i] = found;
         }
 
       } else {
 
         if (initPrefix(inputPrefixes[i], &it)) {
-          bool *found = new bool;
-          *found = false;
+          std::atomic<bool> *found = new std::atomic<bool>(false);
           it.found = found;
           itPrefixes.push_back(it);
+          inputFound[i] = found;
         }
 
       }
@@ -148,7 +256,11 @@ VanitySearch::VanitySearch(Secp256K1 *secp, vector<std::string> &prefix,string s
 
         }
 
-        onlyFull &= it.isFull;
+        onlyFull &= itPrefixes[0].isFull;
+        if (itPrefixes[0].type == P2SH)
+          hasP2SH = true;
+        else
+          hasHash160 = true;
         nbPrefix++;
 
       }
@@ -162,15 +274,19 @@ VanitySearch::VanitySearch(Secp256K1 *secp, vector<std::string> &prefix,string s
 
     //dumpPrefixes();
 
-    if (!caseSensitive && searchType == BECH32) {
-      printf("Error, case unsensitive search with BECH32 not allowed.\n");
+    if (nbPrefix == 0) {
+      printf("VanitySearch: nothing to search !\n");
       exit(1);
     }
 
-    if (nbPrefix == 0) {
-      printf("VanitySearch: nothing to search !\n");
+    // P2PKH and BECH32 share the same hash160, the GPU kernel handles a single
+    // hash type and only reports P2SH candidates when searching P2SH alone
+    if (hasHash160 && hasP2SH && useGpu) {
+      printf("Error: P2SH targets cannot be searched on GPU with P2PKH or BECH32 ones, search them in separate runs\n");
       exit(1);
     }
+    if (hasHash160 && searchType == P2SH)
+      searchType = P2PKH;
 
     // Second level lookup
     uint32_t unique_sPrefix = 0;
@@ -198,6 +314,34 @@ VanitySearch::VanitySearch(Secp256K1 *secp, vector<std::string> &prefix,string s
     if (loadingProgress)
       printf("\n");
 
+    // Initial lookup, found items are pruned from copies of it
+    PREFIX_LOOKUP *l = new PREFIX_LOOKUP;
+    l->table = prefixes.data();
+    l->usedPrefix = usedPrefix;
+    l->usedPrefixL = usedPrefixL;
+    l->nbItem = 0;
+    for (int i = 0; i < (int)usedPrefix.size(); i++)
+      l->nbItem += (uint32_t)prefixes[usedPrefix[i]].items->size();
+    l->nbLeft = (int)nbPrefix;
+    l->epoch = 0;
+    l->owner = false;
+    lookup = l;
+    nbPrefixLeft = (int)nbPrefix;
+
+    // Difficulty min-heap, found items are removed when they reach the top
+    if (!onlyFull) {
+      for (int i = 0; i < (int)usedPrefix.size(); i++) {
+        vector<PREFIX_ITEM> *items = prefixes[usedPrefix[i]].items;
+        for (int j = 0; j < (int)items->size(); j++) {
+          DIFFICULTY_ITEM d;
+          d.difficulty = (*items)[j].difficulty;
+          d.found = (*items)[j].found;
+          difficultyHeap.push_back(d);
+        }
+      }
+      std::make_heap(difficultyHeap.begin(), difficultyHeap.end(), difficultyGreater);
+    }
+
     _difficulty = getDiffuclty();
     string seachInfo = string(searchModes[searchMode]) + (startPubKeySpecified ? ", with public key" : "");
     if (nbPrefix == 1) {
@@ -246,9 +390,36 @@ VanitySearch::VanitySearch(Secp256K1 *secp, vector<std::string> &prefix,string s
       printf("Search: %d patterns [%s]\n", (int)inputPrefixes.size(), searchInfo.c_str());
     }
 
+    hasP2SH = (searchType == P2SH);
+    hasHash160 = !hasP2SH;
+
     patternFound = (bool *)malloc(inputPrefixes.size()*sizeof(bool));
     memset(patternFound,0, inputPrefixes.size() * sizeof(bool));
 
+    // Compile patterns
+    matcher = new WildcardMatcher(inputPrefixes, searchType, caseSensitive);
+    nbPatternLeft = (int)inputPrefixes.size();
+    if (matcher->isSuffix())
+      printf("Suffix search (Base58 residues)\n");
+
+  }
+
+  if (harvest != HARVEST_NONE) {
+
+    if (hasPattern || pubKeySearch || onlyFull) {
+
+      printf("Warning, harvest mode needs address prefixes, disabled\n");
+      this->harvest = HARVEST_NONE;
+
+    } else {
+
+      // Records are streamed to the result writer
+      if (harvest == HARVEST_CSV && writer->isEmpty())
+        writer->writeRaw("address,type,wif,hex\n", 21, 0);
+      printf("Harvest: %s records to %s\n", (harvest == HARVEST_CSV) ? "CSV" : "binary", writer->getFileName().c_str());
+
+    }
+
   }
 
   // Compute Generator table G[n] = (n+1)*G
@@ -298,7 +469,29 @@ VanitySearch::VanitySearch(Secp256K1 *secp, vector<std::string> &prefix,string s
   ctimeBuff = ctime(&now);
   printf("Start %s", ctimeBuff);
 
-  if (rekey > 0) {
+  if (rangeMode) {
+
+    if (rangeStart.IsZero() || rangeStart.IsGreater(&rangeEnd) || rangeEnd.IsGreaterOrEqual(&secp->order)) {
+      printf("Error: invalid range, start must be in [1,end] and end lower than the curve order\n");
+      exit(-1);
+    }
+    if (rekey > 0) {
+      printf("Warning, rekey is disabled in range mode\n");
+      this->rekey = 0;
+    }
+    rangeSize.Set(&rangeEnd);
+    rangeSize.Sub(&rangeStart);
+    rangeSize.AddOne();
+    printf("Range: %s:%s (2^%.2f keys)%s%s\n", rangeStart.GetBase16().c_str(), rangeEnd.GetBase16().c_str(),
+      log2(rangeSize.ToDouble()), this->rangeStrict ? " strict" : "", this->rangeRandom ? " random" : "");
+
+  } else if (linked) {
+    if (rekey > 0) {
+      printf("Warning, rekey is disabled in worker mode\n");
+      this->rekey = 0;
+    }
+    printf("Worker of %s\n", workerAddr.length() > 0 ? workerAddr.c_str() : queueDir.c_str());
+  } else if (rekey > 0) {
     printf("Base Key: Randomly changed every %.0f Mkeys\n",(double)rekey);
   } else {
     printf("Base Key: %s\n", startKey.GetBase16().c_str());
@@ -308,6 +501,15 @@ VanitySearch::VanitySearch(Secp256K1 *secp, vector<std::string> &prefix,string s
 
 // ----------------------------------------------------------------------------
 
+bool VanitySearch::isTaproot(std::string &pref) {
+
+  return pref.length() >= 4 && tolower(pref.data()[0]) == 'b' && tolower(pref.data()[1]) == 'c' &&
+         pref.data()[2] == '1' && tolower(pref.data()[3]) == 'p';
+
+}
+
+// ----------------------------------------------------------------------------
+
 bool VanitySearch::isSingularPrefix(std::string pref) {
 
   // check is the given prefix contains only 1
@@ -358,10 +560,7 @@ bool VanitySearch::initPrefix(std::string &prefix,PREFIX_ITEM *it) {
   }
 
   if (searchType == -1) searchType = aType;
-  if (aType != searchType) {
-    printf("Ignoring prefix \"%s\" (P2PKH, P2SH or BECH32 allowed at once)\n", prefix.c_str());
-    return false;
-  }
+  it->type = aType;
 
   if (aType == BECH32) {
 
@@ -475,7 +674,7 @@ bool VanitySearch::initPrefix(std::string &prefix,PREFIX_ITEM *it) {
       }
     }
 
-    if (searchType == P2SH) {
+    if (aType == P2SH) {
       if (result.data()[0] != 5) {
         if(caseSensitive)
           printf("Ignoring prefix \"%s\" (Unreachable, 31h1 to 3R2c only)\n", prefix.c_str());
@@ -530,38 +729,82 @@ void VanitySearch::dumpPrefixes() {
 }
 // ----------------------------------------------------------------------------
 
-void VanitySearch::enumCaseUnsentivePrefix(std::string s, std::vector<std::string> &list) {
+bool VanitySearch::initCaseUnsensitivePrefix(std::string &prefix, std::vector<PREFIX_ITEM> &items) {
 
-  char letter[64];
-  int letterpos[64];
-  int nbLetter = 0;
-  int length = (int)s.length();
+  if (prefix.length() < 2) {
+    printf("Ignoring prefix \"%s\" (too short)\n", prefix.c_str());
+    return false;
+  }
 
-  for (int i = 1; i < length; i++) {
-    char c = s.data()[i];
-    if( (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ) {
-      letter[nbLetter] = tolower(c);
-      letterpos[nbLetter] = i;
-      nbLetter++;
-    }
+  int aType = -1;
+  switch (prefix.data()[0]) {
+  case '1':
+    aType = P2PKH;
+    break;
+  case '3':
+    aType = P2SH;
+    break;
+  case 'b':
+  case 'B':
+    aType = BECH32;
+    break;
+  }
+
+  if (aType == -1) {
+    printf("Ignoring prefix \"%s\" (must start with 1 or 3 or bc1q)\n", prefix.c_str());
+    return false;
   }
 
-  int total = 1 << nbLetter;
+  if (aType == BECH32) {
+    printf("Error, case unsensitive search with BECH32 not allowed.\n");
+    exit(1);
+  }
 
-  for (int i = 0; i < total; i++) {
+  if (searchType == -1) searchType = aType;
 
-    char tmp[64];
-    strcpy(tmp, s.c_str());
+  vector<H160_RANGE> ranges;
+  double proba = Wildcard::getRangesNoCase(prefix, aType, 16, ranges);
+  if (proba <= 0.0) {
+    printf("Ignoring prefix \"%s\" (0 not allowed or unreachable)\n", prefix.c_str());
+    return false;
+  }
 
-    for (int j = 0; j < nbLetter; j++) {
-      int mask = 1 << j;
-      if (mask&i) tmp[letterpos[j]] = toupper(letter[j]);
-      else         tmp[letterpos[j]] = letter[j];
+  PREFIX_ITEM it;
+  it.prefix = (char *)prefix.c_str();
+  it.prefixLength = (int)prefix.length();
+  it.type = aType;
+  it.difficulty = 1.0 / proba;
+  it.isFull = false;
+  it.lPrefix = 0;
+
+  // One item per reachable 16 bit prefix
+  vector<bool> used(65536, false);
+  for (int i = 0; i < (int)ranges.size(); i++) {
+    for (uint32_t b = (uint32_t)(ranges[i].lo >> 48); b <= (uint32_t)(ranges[i].hi >> 48); b++) {
+      if (!used[b]) {
+        used[b] = true;
+        it.sPrefix = (prefix_t)((b >> 8) | ((b & 0xFF) << 8));
+        items.push_back(it);
+      }
     }
+  }
+
+  return true;
 
-    list.push_back(string(tmp));
+}
+
+// ----------------------------------------------------------------------------
+
+bool VanitySearch::prefixMatch(char *prefix, char *addr) {
 
+  // Case unsensitive comparison
+  while (*prefix) {
+    if (tolower(*prefix) != tolower(*addr))
+      return false;
+    prefix++;
+    addr++;
   }
+  return true;
 
 }
 
@@ -574,17 +817,24 @@ double VanitySearch::getDiffuclty() {
   if (onlyFull)
     return min;
 
-  for (int i = 0; i < (int)usedPrefix.size(); i++) {
-    int p = usedPrefix[i];
-    if (prefixes[p].items) {
-      for (int j = 0; j < (int)prefixes[p].items->size(); j++) {
-        if (!*((*prefixes[p].items)[j].found)) {
-          if ((*prefixes[p].items)[j].difficulty < min)
-            min = (*prefixes[p].items)[j].difficulty;
-        }
-      }
-    }
+#ifdef WIN64
+  WaitForSingleObject(ghMutex, INFINITE);
+#else
+  pthread_mutex_lock(&ghMutex);
+#endif
+
+  while (difficultyHeap.size() > 0 && *(difficultyHeap.front().found)) {
+    std::pop_heap(difficultyHeap.begin(), difficultyHeap.end(), difficultyGreater);
+    difficultyHeap.pop_back();
   }
+  if (difficultyHeap.size() > 0)
+    min = difficultyHeap.front().difficulty;
+
+#ifdef WIN64
+  ReleaseMutex(ghMutex);
+#else
+  pthread_mutex_unlock(&ghMutex);
+#endif
 
   return min;
 
@@ -651,64 +901,62 @@ string VanitySearch::GetExpectedTime(double keyRate,double keyCount) {
 
 }
 
-// ----------------------------------------------------------------------------
-
-void VanitySearch::output(string addr,string pAddr,string pAddrHex) {
+string VanitySearch::GetRangeProgress(double keyRate, uint64_t keyCount) {
 
-#ifdef WIN64
-   WaitForSingleObject(ghMutex,INFINITE);
-#else
-  pthread_mutex_lock(&ghMutex);
-#endif
+  char tmp[128];
 
-  FILE *f = stdout;
-  bool needToClose = false;
+  if (linked) {
+    // Whole job
+    sprintf(tmp, "[Job %.2f%%]", 100.0 * link->progress);
+    return string(tmp);
+  }
 
-  if (outputFile.length() > 0) {
-    f = fopen(outputFile.c_str(), "a");
-    if (f == NULL) {
-      printf("Cannot open %s for writing\n", outputFile.c_str());
-      f = stdout;
-    } else {
-      needToClose = true;
-    }
+  uint64_t done = 0;
+  for (int i = 0; i < nbCPUSlot + nbGPUThread; i++)
+    done += stats[i].rangeKeys.load(std::memory_order_relaxed);
+  if (keyCount == 0)
+    return "[Range 0.00%]";
+
+  // Each range key gives several keys (endomorphisms and symmetry)
+  double size = rangeSize.ToDouble();
+  double rangeRate = keyRate * (double)done / (double)keyCount;
+  double dTime = (rangeRate > 0.0) ? (size - (double)done) / rangeRate : 0.0;
+  if (dTime < 0) dTime = 0;
+
+  // Sampled chunks never overlap, the probability is the one of the
+  // distinct keys covered (endomorphisms and symmetry if not strict)
+  if (rangeRandom && !hasPattern) {
+    sprintf(tmp, "[Range %.2f%%]", 100.0 * (double)done / size);
+    double nbCovered = (rangeStrict ? 1.0 : 6.0) * (double)done;
+    return string(tmp) + GetExpectedTime(keyRate * nbCovered / (double)keyCount, nbCovered);
   }
 
-  if(!needToClose)
-    printf("\n");
+  double nbDay = dTime / 86400.0;
+  if (nbDay >= 1) {
+    sprintf(tmp, "[Range %.2f%%][End in %.1fd]", 100.0 * (double)done / size, nbDay);
+  } else {
+    int iTime = (int)dTime;
+    sprintf(tmp, "[Range %.2f%%][End in %02d:%02d:%02d]", 100.0 * (double)done / size,
+      iTime / 3600, (iTime % 3600) / 60, iTime % 60);
+  }
 
-  fprintf(f, "PubAddress: %s\n", addr.c_str());
+  return string(tmp);
 
-  if (startPubKeySpecified) {
+}
 
-    fprintf(f, "PartialPriv: %s\n", pAddr.c_str());
+// ----------------------------------------------------------------------------
 
-  } else {
+void VanitySearch::output(int type,string addr,string pAddr,string pAddrHex) {
 
-    switch (searchType) {
-    case P2PKH:
-      fprintf(f, "Priv (WIF): p2pkh:%s\n", pAddr.c_str());
-      break;
-    case P2SH:
-      fprintf(f, "Priv (WIF): p2wpkh-p2sh:%s\n", pAddr.c_str());
-      break;
-    case BECH32:
-      fprintf(f, "Priv (WIF): p2wpkh:%s\n", pAddr.c_str());
-      break;
-    }
-    fprintf(f, "Priv (HEX): 0x%s\n", pAddrHex.c_str());
+  writer->write(type, addr, pAddr, pAddrHex, startPubKeySpecified);
 
+  if (linked) {
+    // Sent to the coordinator or written to the job directory with the next report
+    lockRange();
+    linkFound.push_back(to_string(type) + " " + addr + " " + pAddr + " " + pAddrHex);
+    unlockRange();
   }
 
-  if(needToClose)
-    fclose(f);
-
-#ifdef WIN64
-  ReleaseMutex(ghMutex);
-#else
-  pthread_mutex_unlock(&ghMutex);
-#endif
-
 }
 
 // ----------------------------------------------------------------------------
@@ -721,975 +969,2937 @@ void VanitySearch::updateFound() {
 
     if (hasPattern) {
 
-      bool allFound = true;
-      for (int i = 0; i < (int)inputPrefixes.size(); i++) {
-        allFound &= patternFound[i];
-      }
-      endOfSearch = allFound;
+      if (nbPatternLeft == 0)
+        endOfSearch = true;
+
+    } else if (pubKeySearch) {
+
+      if (nbPatternLeft == 0)
+        endOfSearch = true;
+      _difficulty = xMatcher->getDifficulty();
 
     } else {
 
-      bool allFound = true;
-      for (int i = 0; i < (int)usedPrefix.size(); i++) {
-        bool iFound = true;
-        prefix_t p = usedPrefix[i];
-        if (!prefixes[p].found) {
-          if (prefixes[p].items) {
-            for (int j = 0; j < (int)prefixes[p].items->size(); j++) {
-              iFound &= *((*prefixes[p].items)[j].found);
-            }
-          }
-          prefixes[usedPrefix[i]].found = iFound;
-        }
-        allFound &= iFound;
-      }
-      endOfSearch = allFound;
+      if (nbPrefixLeft == 0)
+        endOfSearch = true;
 
       // Update difficulty to the next most probable item
       _difficulty = getDiffuclty();
 
+      if (!endOfSearch)
+        pruneLookup();
+
     }
 
   }
 
+  notify(EVENT_FOUND);
+
 }
 
 // ----------------------------------------------------------------------------
 
-bool VanitySearch::checkPrivKey(string addr, Int &key, int32_t incr, int endomorphism, bool mode) {
+bool VanitySearch::setFound(std::atomic<bool> *found) {
 
-  Int k(&key);
-  Point sp = startPubKey;
+  // Only the first thread reporting a target counts it
+  if (found->exchange(true))
+    return false;
+  nbPrefixLeft--;
+  return true;
 
-  if (incr < 0) {
-    k.Add((uint64_t)(-incr));
-    k.Neg();
-    k.Add(&secp->order);
-    if (startPubKeySpecified) sp.y.ModNeg();
-  } else {
-    k.Add((uint64_t)incr);
-  }
+}
 
-  // Endomorphisms
-  switch (endomorphism) {
-  case 1:
-    k.ModMulK1order(&lambda);
-    if(startPubKeySpecified) sp.x.ModMulK1(&beta);
-    break;
-  case 2:
-    k.ModMulK1order(&lambda2);
-    if (startPubKeySpecified) sp.x.ModMulK1(&beta2);
-    break;
-  }
+bool VanitySearch::setTargetFound(int i) {
 
-  // Check addresses
-  Point p = secp->ComputePublicKey(&k);
-  if (startPubKeySpecified) p = secp->AddDirect(p, sp);
+  // Input target i found, by this search, a checkpoint or another worker
+  bool first;
+  if (hasPattern || pubKeySearch)
+    first = setPatternFound(i);
+  else
+    first = inputFound[i] != NULL && setFound(inputFound[i]);
 
-  string chkAddr = secp->GetAddress(searchType, mode, p);
-  if (chkAddr != addr) {
+  // The coordinator sends it to its workers with their next heartbeat
+  if (first && coordinator != NULL)
+    coordinator->TargetFound(i);
+  return first;
 
-    //Key may be the opposite one (negative zero or compressed key)
-    k.Neg();
-    k.Add(&secp->order);
-    p = secp->ComputePublicKey(&k);
-    if (startPubKeySpecified) {
-      sp.y.ModNeg();
-      p = secp->AddDirect(p, sp);
-    }
-    string chkAddr = secp->GetAddress(searchType, mode, p);
-    if (chkAddr != addr) {
-      printf("\nWarning, wrong private key generated !\n");
-      printf("  Addr :%s\n", addr.c_str());
-      printf("  Check:%s\n", chkAddr.c_str());
-      printf("  Endo:%d incr:%d comp:%d\n", endomorphism, incr, mode);
-      return false;
-    }
+}
 
-  }
+// ----------------------------------------------------------------------------
 
-  output(addr, secp->GetPrivAddress(mode ,k), k.GetBase16());
+PREFIX_LOOKUP *VanitySearch::enterLookup(int thId) {
 
-  return true;
+  // Called by each search thread before a group, the lookup it gets
+  // cannot be freed until the thread calls it again
+  PREFIX_LOOKUP *l = lookup.load();
+  if (l && tNode)
+    l = nodeLookup(l);
+  if (l) {
+    stats[thId].epoch = l->epoch;
+    tLookup = l->table;
+  }
+  return l;
 
 }
 
-void VanitySearch::checkAddrSSE(uint8_t *h1, uint8_t *h2, uint8_t *h3, uint8_t *h4,
-                                int32_t incr1, int32_t incr2, int32_t incr3, int32_t incr4,
-                                Int &key, int endomorphism, bool mode) {
-
-  vector<string> addr = secp->GetAddress(searchType, mode, h1,h2,h3,h4);
-
-  for (int i = 0; i < (int)inputPrefixes.size(); i++) {
+PREFIX_LOOKUP *VanitySearch::nodeLookup(PREFIX_LOOKUP *l) {
 
-    if (Wildcard::match(addr[0].c_str(), inputPrefixes[i].c_str(), caseSensitive)) {
+  // Node local copy of the published lookup, made by the first thread of
+  // the node that sees a new epoch
+  PREFIX_LOOKUP *r = tNode->lookup.load();
+  if (r && r->epoch == l->epoch)
+    return r;
 
-      // Found it !
-      //*((*pi)[i].found) = true;
-      if (checkPrivKey(addr[0], key, incr1, endomorphism, mode)) {
-        nbFoundKey++;
-        patternFound[i] = true;
-        updateFound();
-      }
+#ifdef WIN64
+  WaitForSingleObject(ghMutex, INFINITE);
+#else
+  pthread_mutex_lock(&ghMutex);
+#endif
 
-    }
+  // pruneLookup() cannot retire the published lookup meanwhile
+  l = lookup.load();
+  r = tNode->lookup.load();
+  if (r == NULL || r->epoch != l->epoch) {
+    PREFIX_LOOKUP *c = cloneLookup(l);
+    tNode->lookup = c;
+    if (r)
+      retiredLookups.push_back(r);
+    r = c;
+  }
 
-    if (Wildcard::match(addr[1].c_str(), inputPrefixes[i].c_str(), caseSensitive)) {
+#ifdef WIN64
+  ReleaseMutex(ghMutex);
+#else
+  pthread_mutex_unlock(&ghMutex);
+#endif
 
-      // Found it !
-      //*((*pi)[i].found) = true;
-      if (checkPrivKey(addr[1], key, incr2, endomorphism, mode)) {
-        nbFoundKey++;
-        patternFound[i] = true;
-        updateFound();
-      }
+  return r;
 
-    }
+}
 
-    if (Wildcard::match(addr[2].c_str(), inputPrefixes[i].c_str(), caseSensitive)) {
+PREFIX_LOOKUP *VanitySearch::cloneLookup(PREFIX_LOOKUP *l) {
 
-      // Found it !
-      //*((*pi)[i].found) = true;
-      if (checkPrivKey(addr[2], key, incr3, endomorphism, mode)) {
-        nbFoundKey++;
-        patternFound[i] = true;
-        updateFound();
-      }
+  PREFIX_LOOKUP *c = new PREFIX_LOOKUP;
+  c->table = new PREFIX_TABLE_ITEM[65536];
+  for (int i = 0; i < 65536; i++) {
+    c->table[i].items = NULL;
+    c->table[i].found = true;
+  }
+  for (int i = 0; i < (int)l->usedPrefix.size(); i++) {
+    prefix_t p = l->usedPrefix[i];
+    c->table[p].items = new vector<PREFIX_ITEM>(*l->table[p].items);
+    c->table[p].found = false;
+  }
+  c->usedPrefix = l->usedPrefix;
+  c->usedPrefixL = l->usedPrefixL;
+  c->nbItem = l->nbItem;
+  c->nbLeft = l->nbLeft;
+  c->epoch = l->epoch;
+  c->owner = true;
+  return c;
 
-    }
+}
 
-    if (Wildcard::match(addr[3].c_str(), inputPrefixes[i].c_str(), caseSensitive)) {
+void VanitySearch::enterNode(int node, vector<int> &cpus) {
 
-      // Found it !
-      //*((*pi)[i].found) = true;
-      if (checkPrivKey(addr[3], key, incr4, endomorphism, mode)) {
-        nbFoundKey++;
-        patternFound[i] = true;
-        updateFound();
-      }
+  // Must be called before the thread allocates its buffers (first touch)
+  if (!Numa::PinThread(cpus))
+    printf("Warning, cannot set thread affinity on node %d\n", node);
+  tNode = numaNodes + node;
 
-    }
+#ifdef WIN64
+  WaitForSingleObject(ghMutex, INFINITE);
+#else
+  pthread_mutex_lock(&ghMutex);
+#endif
 
+  if (tNode->Gn == NULL) {
+    tNode->Gn = new Point[CPU_GRP_SIZE / 2 + 1];
+    for (int i = 0; i < CPU_GRP_SIZE / 2; i++)
+      tNode->Gn[i] = Gn[i];
+    tNode->Gn[CPU_GRP_SIZE / 2] = _2Gn;
   }
 
+#ifdef WIN64
+  ReleaseMutex(ghMutex);
+#else
+  pthread_mutex_unlock(&ghMutex);
+#endif
 
 }
 
-void VanitySearch::checkAddr(int prefIdx, uint8_t *hash160, Int &key, int32_t incr, int endomorphism, bool mode) {
+void VanitySearch::freeLookup(PREFIX_LOOKUP *l) {
 
-  if (hasPattern) {
+  if (l->owner) {
+    for (int i = 0; i < (int)l->usedPrefix.size(); i++)
+      delete l->table[l->usedPrefix[i]].items;
+    delete[] l->table;
+  }
+  delete l;
 
-    // Wildcard search
-    string addr = secp->GetAddress(searchType, mode, hash160);
+}
 
-    for (int i = 0; i < (int)inputPrefixes.size(); i++) {
+void VanitySearch::pruneLookup() {
 
-      if (Wildcard::match(addr.c_str(), inputPrefixes[i].c_str(), caseSensitive)) {
+  // Targets found since the published lookup was built
+  PREFIX_LOOKUP *cur = lookup.load();
+  int nbFound = cur->nbLeft - nbPrefixLeft;
+  if (nbFound <= 0 || (int64_t)nbFound * LOOKUP_PRUNE_RATIO < cur->nbLeft)
+    return;
 
-        // Found it !
-        //*((*pi)[i].found) = true;
-        if (checkPrivKey(addr, key, incr, endomorphism, mode)) {
-          nbFoundKey++;
-          patternFound[i] = true;
-          updateFound();
-        }
+#ifdef WIN64
+  WaitForSingleObject(ghMutex, INFINITE);
+#else
+  pthread_mutex_lock(&ghMutex);
+#endif
 
-      }
+  // Another thread may have rebuilt it meanwhile
+  cur = lookup.load();
+  nbFound = cur->nbLeft - nbPrefixLeft;
 
+  if (nbFound > 0 && (int64_t)nbFound * LOOKUP_PRUNE_RATIO >= cur->nbLeft) {
+
+    PREFIX_LOOKUP *l = new PREFIX_LOOKUP;
+    l->table = new PREFIX_TABLE_ITEM[65536];
+    for (int i = 0; i < 65536; i++) {
+      l->table[i].items = NULL;
+      l->table[i].found = true;
+    }
+    l->nbItem = 0;
+
+    for (int i = 0; i < (int)cur->usedPrefix.size(); i++) {
+      prefix_t p = cur->usedPrefix[i];
+      vector<PREFIX_ITEM> *items = cur->table[p].items;
+      for (int j = 0; j < (int)items->size(); j++) {
+        if (*((*items)[j].found))
+          continue;
+        if (l->table[p].items == NULL) {
+          l->table[p].items = new vector<PREFIX_ITEM>();
+          l->table[p].found = false;
+          l->usedPrefix.push_back(p);
+        }
+        l->table[p].items->push_back((*items)[j]);
+        l->nbItem++;
+      }
     }
 
-    return;
+    for (int i = 0; i < (int)l->usedPrefix.size(); i++) {
+      LPREFIX lit;
+      lit.sPrefix = l->usedPrefix[i];
+      vector<PREFIX_ITEM> *items = l->table[lit.sPrefix].items;
+      for (int j = 0; j < (int)items->size(); j++)
+        lit.lPrefixes.push_back((*items)[j].lPrefix);
+      sort(lit.lPrefixes.begin(), lit.lPrefixes.end());
+      l->usedPrefixL.push_back(lit);
+    }
+
+    l->nbLeft = cur->nbLeft - nbFound;
+    l->epoch = cur->epoch + 1;
+    l->owner = true;
+    lookup = l;
+    retiredLookups.push_back(cur);
+
+    // Free the lookups no thread can still use
+    uint32_t minEpoch = 0xFFFFFFFF;
+    for (int i = 0; i < nbCPUSlot + nbGPUThread; i++)
+      if (stats[i].epoch < minEpoch)
+        minEpoch = stats[i].epoch;
+    for (int i = 0; i < (int)retiredLookups.size();) {
+      if (retiredLookups[i]->epoch < minEpoch) {
+        freeLookup(retiredLookups[i]);
+        retiredLookups.erase(retiredLookups.begin() + i);
+      } else {
+        i++;
+      }
+    }
 
   }
 
-  vector<PREFIX_ITEM> *pi = prefixes[prefIdx].items;
+#ifdef WIN64
+  ReleaseMutex(ghMutex);
+#else
+  pthread_mutex_unlock(&ghMutex);
+#endif
 
-  if (onlyFull) {
+}
 
-    // Full addresses
-    for (int i = 0; i < (int)pi->size(); i++) {
+// ----------------------------------------------------------------------------
 
-      if (stopWhenFound && *((*pi)[i].found))
-        continue;
+void VanitySearch::getPrivKey(Int &key, int32_t incr, int endomorphism, Int &k, Point &sp) {
 
-      if (ripemd160_comp_hash((*pi)[i].hash160, hash160)) {
+  k.Set(&key);
+  sp = startPubKey;
 
-        // Found it !
-        *((*pi)[i].found) = true;
-        // You believe it ?
-        if (checkPrivKey(secp->GetAddress(searchType, mode, hash160), key, incr, endomorphism, mode)) {
-          nbFoundKey++;
-          updateFound();
-        }
+  if (incr < 0) {
+    k.Add((uint64_t)(-incr));
+    k.Neg();
+    k.Add(&secp->order);
+    if (startPubKeySpecified) sp.y.ModNeg();
+  } else {
+    k.Add((uint64_t)incr);
+  }
 
-      }
+  // Endomorphisms
+  switch (endomorphism) {
+  case 1:
+    k.ModMulK1order(&lambda);
+    if(startPubKeySpecified) sp.x.ModMulK1(&beta);
+    break;
+  case 2:
+    k.ModMulK1order(&lambda2);
+    if (startPubKeySpecified) sp.x.ModMulK1(&beta2);
+    break;
+  }
 
-    }
+}
 
-  } else {
+void VanitySearch::pushHit(int type, string &addr, Int &key, int32_t incr, int endomorphism, bool mode) {
 
+  HIT_ITEM it;
+  it.type = type;
+  it.mode = mode;
+  it.incr = incr;
+  it.endomorphism = endomorphism;
+  it.key.Set(&key);
+  strncpy(it.addr, addr.c_str(), sizeof(it.addr) - 1);
+  it.addr[sizeof(it.addr) - 1] = 0;
+  if (tStats)
+    addStat(tStats->hits, 1);
 
-    char a[64];
+  // Back pressure, wait for the verifier when the queue is full
+  while (!hitQueue->push(it))
+    Timer::SleepMillis(1);
 
-    string addr = secp->GetAddress(searchType, mode, hash160);
+}
 
-    for (int i = 0; i < (int)pi->size(); i++) {
+// ----------------------------------------------------------------------------
 
-      if (stopWhenFound && *((*pi)[i].found))
-        continue;
+void VanitySearch::verifyHits(vector<HIT_ITEM> &hits) {
 
-      strncpy(a, addr.c_str(), (*pi)[i].prefixLength);
-      a[(*pi)[i].prefixLength] = 0;
+  int n = (int)hits.size();
+  vector<Int> keys(n);
+  vector<Point> sps(n);
+  vector<Point> pts;
 
-      if (strcmp((*pi)[i].prefix, a) == 0) {
+  for (int i = 0; i < n; i++)
+    getPrivKey(hits[i].key, hits[i].incr, hits[i].endomorphism, keys[i], sps[i]);
+  secp->ComputePublicKeys(keys, pts);
 
-        // Found it !
-        *((*pi)[i].found) = true;
-        if (checkPrivKey(addr, key, incr, endomorphism, mode)) {
-          nbFoundKey++;
-          updateFound();
-        }
+  for (int i = 0; i < n; i++) {
+
+    HIT_ITEM &it = hits[i];
+    string addr = string(it.addr);
+
+    // Same address reported twice (several matching prefixes or patterns)
+    if (verified.find(addr) != verified.end())
+      continue;
+
+    // Check addresses
+    Point p = pts[i];
+    if (startPubKeySpecified) p = secp->AddDirect(p, sps[i]);
+
+    string chkAddr = secp->GetAddress(it.type, it.mode, p);
+    if (chkAddr != addr) {
 
+      //Key may be the opposite one (negative zero or compressed key)
+      keys[i].Neg();
+      keys[i].Add(&secp->order);
+      p.y.ModNeg();
+      chkAddr = secp->GetAddress(it.type, it.mode, p);
+      if (chkAddr != addr) {
+        printf("\nWarning, wrong private key generated !\n");
+        printf("  Addr :%s\n", addr.c_str());
+        printf("  Check:%s\n", chkAddr.c_str());
+        printf("  Endo:%d incr:%d comp:%d\n", it.endomorphism, it.incr, it.mode);
+        continue;
       }
 
     }
 
+    if (verified.size() >= HIT_QUEUE_SIZE)
+      verified.clear();
+    verified.insert(addr);
+
+    output(it.type, addr, secp->GetPrivAddress(it.mode, keys[i]), keys[i].GetBase16());
+    nbFoundKey++;
+    updateFound();
+
   }
 
 }
 
 // ----------------------------------------------------------------------------
 
-#ifdef WIN64
-DWORD WINAPI _FindKey(LPVOID lpParam) {
-#else
-void *_FindKey(void *lpParam) {
-#endif
-  TH_PARAM *p = (TH_PARAM *)lpParam;
-  p->obj->FindKeyCPU(p);
-  return 0;
-}
+void VanitySearch::VerifyHits() {
 
-#ifdef WIN64
-DWORD WINAPI _FindKeyGPU(LPVOID lpParam) {
-#else
-void *_FindKeyGPU(void *lpParam) {
-#endif
-  TH_PARAM *p = (TH_PARAM *)lpParam;
-  p->obj->FindKeyGPU(p);
-  return 0;
-}
+  vector<HIT_ITEM> hits;
+  HIT_ITEM it;
 
-// ----------------------------------------------------------------------------
+  // Drains the queue until the search threads are all stopped
+  while (true) {
 
-void VanitySearch::checkAddresses(bool compressed, Int key, int i, Point p1) {
+    hits.clear();
+    while ((int)hits.size() < HIT_BATCH && hitQueue->pop(it))
+      hits.push_back(it);
 
-  unsigned char h0[20];
-  Point pte1[1];
-  Point pte2[1];
+    if (hits.size() > 0) {
+      verifyHits(hits);
+      nbVerifiedHit += hits.size();
+    } else {
+      if (verifierStop)
+        break;
+      Timer::SleepMillis(1);
+    }
 
-  // Point
-  secp->GetHash160(searchType,compressed, p1, h0);
-  prefix_t pr0 = *(prefix_t *)h0;
-  if (hasPattern || prefixes[pr0].items)
-    checkAddr(pr0, h0, key, i, 0, compressed);
+  }
 
-  // Endomorphism #1
-  pte1[0].x.ModMulK1(&p1.x, &beta);
-  pte1[0].y.Set(&p1.y);
+}
 
-  secp->GetHash160(searchType, compressed, pte1[0], h0);
+void VanitySearch::checkAddrSSE(uint8_t *h1, uint8_t *h2, uint8_t *h3, uint8_t *h4,
+                                int32_t incr1, int32_t incr2, int32_t incr3, int32_t incr4,
+                                Int &key, int endomorphism, bool mode) {
 
-  pr0 = *(prefix_t *)h0;
-  if (hasPattern || prefixes[pr0].items)
-    checkAddr(pr0, h0, key, i, 1, compressed);
+  bool c1;
+  bool c2;
+  bool c3;
+  bool c4;
 
-  // Endomorphism #2
-  pte2[0].x.ModMulK1(&p1.x, &beta2);
-  pte2[0].y.Set(&p1.y);
+  if (matcher->isSuffix()) {
 
-  secp->GetHash160(searchType, compressed, pte2[0], h0);
+    // Suffix search, checksums only
+    uint8_t p1[25];
+    uint8_t p2[25];
+    uint8_t p3[25];
+    uint8_t p4[25];
+    secp->GetAddressBytes(searchType, h1, h2, h3, h4, p1, p2, p3, p4);
+    c1 = matcher->suffixFilter(p1);
+    c2 = matcher->suffixFilter(p2);
+    c3 = matcher->suffixFilter(p3);
+    c4 = matcher->suffixFilter(p4);
 
-  pr0 = *(prefix_t *)h0;
-  if (hasPattern || prefixes[pr0].items)
-    checkAddr(pr0, h0, key, i, 2, compressed);
+  } else {
 
-  // Curve symetrie
-  // if (x,y) = k*G, then (x, -y) is -k*G
-  p1.y.ModNeg();
-  secp->GetHash160(searchType, compressed, p1, h0);
-  pr0 = *(prefix_t *)h0;
-  if (hasPattern || prefixes[pr0].items)
-    checkAddr(pr0, h0, key, -i, 0, compressed);
+    c1 = patternFilter(h1);
+    c2 = patternFilter(h2);
+    c3 = patternFilter(h3);
+    c4 = patternFilter(h4);
 
-  // Endomorphism #1
-  pte1[0].y.ModNeg();
+  }
 
-  secp->GetHash160(searchType, compressed, pte1[0], h0);
+  if (c1 && c2 && c3 && c4) {
 
-  pr0 = *(prefix_t *)h0;
-  if (hasPattern || prefixes[pr0].items)
-    checkAddr(pr0, h0, key, -i, 1, compressed);
+    vector<string> addr = secp->GetAddress(searchType, mode, h1,h2,h3,h4);
+    checkPattern(addr[0], key, incr1, endomorphism, mode);
+    checkPattern(addr[1], key, incr2, endomorphism, mode);
+    checkPattern(addr[2], key, incr3, endomorphism, mode);
+    checkPattern(addr[3], key, incr4, endomorphism, mode);
 
-  // Endomorphism #2
-  pte2[0].y.ModNeg();
+  } else {
 
-  secp->GetHash160(searchType, compressed, pte2[0], h0);
+    if (c1) checkAddr(0, h1, key, incr1, endomorphism, mode, searchType == P2SH, NULL);
+    if (c2) checkAddr(0, h2, key, incr2, endomorphism, mode, searchType == P2SH, NULL);
+    if (c3) checkAddr(0, h3, key, incr3, endomorphism, mode, searchType == P2SH, NULL);
+    if (c4) checkAddr(0, h4, key, incr4, endomorphism, mode, searchType == P2SH, NULL);
 
-  pr0 = *(prefix_t *)h0;
-  if (hasPattern || prefixes[pr0].items)
-    checkAddr(pr0, h0, key, -i, 2, compressed);
+  }
 
 }
 
 // ----------------------------------------------------------------------------
 
-void VanitySearch::checkAddressesSSE(bool compressed,Int key, int i, Point p1, Point p2, Point p3, Point p4) {
-
-  unsigned char h0[20];
-  unsigned char h1[20];
-  unsigned char h2[20];
-  unsigned char h3[20];
-  Point pte1[4];
-  Point pte2[4];
-  prefix_t pr0;
-  prefix_t pr1;
-  prefix_t pr2;
-  prefix_t pr3;
+bool VanitySearch::patternFilter(uint8_t *hash160) {
 
-  // Point -------------------------------------------------------------------------
-  secp->GetHash160(searchType, compressed, p1, p2, p3, p4, h0, h1, h2, h3);
+  if (matcher->isSuffix()) {
+    uint8_t payload[25];
+    secp->GetAddressBytes(searchType, hash160, payload);
+    return matcher->suffixFilter(payload);
+  }
 
-  if (!hasPattern) {
+  return matcher->preFilter(WildcardMatcher::getH64(hash160));
 
-    pr0 = *(prefix_t *)h0;
-    pr1 = *(prefix_t *)h1;
-    pr2 = *(prefix_t *)h2;
-    pr3 = *(prefix_t *)h3;
-
-    if (prefixes[pr0].items)
-      checkAddr(pr0, h0, key, i, 0, compressed);
-    if (prefixes[pr1].items)
-      checkAddr(pr1, h1, key, i + 1, 0, compressed);
-    if (prefixes[pr2].items)
-      checkAddr(pr2, h2, key, i + 2, 0, compressed);
-    if (prefixes[pr3].items)
-      checkAddr(pr3, h3, key, i + 3, 0, compressed);
+}
 
-  } else {
+bool VanitySearch::setPatternFound(int id) {
 
-    checkAddrSSE(h0,h1,h2,h3,i,i+1,i+2,i+3,key,0,compressed);
+#ifdef WIN64
+  WaitForSingleObject(ghMutex, INFINITE);
+#else
+  pthread_mutex_lock(&ghMutex);
+#endif
 
+  bool first = !patternFound[id];
+  if (first) {
+    patternFound[id] = true;
+    nbPatternLeft--;
+    // Found patterns are no longer searched
+    if (stopWhenFound) {
+      if (pubKeySearch)
+        xMatcher->remove(id);
+      else
+        matcher->remove(id);
+    }
   }
 
-  // Endomorphism #1
-  // if (x, y) = k * G, then (beta*x, y) = lambda*k*G
-  pte1[0].x.ModMulK1(&p1.x, &beta);
-  pte1[0].y.Set(&p1.y);
-  pte1[1].x.ModMulK1(&p2.x, &beta);
-  pte1[1].y.Set(&p2.y);
-  pte1[2].x.ModMulK1(&p3.x, &beta);
-  pte1[2].y.Set(&p3.y);
-  pte1[3].x.ModMulK1(&p4.x, &beta);
-  pte1[3].y.Set(&p4.y);
-
-  secp->GetHash160(searchType, compressed, pte1[0], pte1[1], pte1[2], pte1[3], h0, h1, h2, h3);
-
-  if (!hasPattern) {
+#ifdef WIN64
+  ReleaseMutex(ghMutex);
+#else
+  pthread_mutex_unlock(&ghMutex);
+#endif
 
-    pr0 = *(prefix_t *)h0;
-    pr1 = *(prefix_t *)h1;
-    pr2 = *(prefix_t *)h2;
-    pr3 = *(prefix_t *)h3;
-
-    if (prefixes[pr0].items)
-      checkAddr(pr0, h0, key, i, 1, compressed);
-    if (prefixes[pr1].items)
-      checkAddr(pr1, h1, key, (i + 1), 1, compressed);
-    if (prefixes[pr2].items)
-      checkAddr(pr2, h2, key, (i + 2), 1, compressed);
-    if (prefixes[pr3].items)
-      checkAddr(pr3, h3, key, (i + 3), 1, compressed);
+  return first;
 
-  } else {
+}
 
-    checkAddrSSE(h0, h1, h2, h3, i, i + 1, i + 2, i + 3, key, 1, compressed);
+void VanitySearch::checkPattern(string &addr, Int &key, int32_t incr, int endomorphism, bool mode) {
 
-  }
+  vector<int> ids;
+  matcher->match(addr.c_str(), ids);
+  if (ids.size() == 0)
+    return;
 
-  // Endomorphism #2
-  // if (x, y) = k * G, then (beta2*x, y) = lambda2*k*G
-  pte2[0].x.ModMulK1(&p1.x, &beta2);
-  pte2[0].y.Set(&p1.y);
-  pte2[1].x.ModMulK1(&p2.x, &beta2);
-  pte2[1].y.Set(&p2.y);
-  pte2[2].x.ModMulK1(&p3.x, &beta2);
-  pte2[2].y.Set(&p3.y);
-  pte2[3].x.ModMulK1(&p4.x, &beta2);
-  pte2[3].y.Set(&p4.y);
+  // Found it !
+  for (int i = 0; i < (int)ids.size(); i++)
+    setPatternFound(ids[i]);
+  pushHit(searchType, addr, key, incr, endomorphism, mode);
 
-  secp->GetHash160(searchType, compressed, pte2[0], pte2[1], pte2[2], pte2[3], h0, h1, h2, h3);
+}
 
-  if (!hasPattern) {
+// ----------------------------------------------------------------------------
 
-    pr0 = *(prefix_t *)h0;
-    pr1 = *(prefix_t *)h1;
-    pr2 = *(prefix_t *)h2;
-    pr3 = *(prefix_t *)h3;
-
-    if (prefixes[pr0].items)
-      checkAddr(pr0, h0, key, i, 2, compressed);
-    if (prefixes[pr1].items)
-      checkAddr(pr1, h1, key, (i + 1), 2, compressed);
-    if (prefixes[pr2].items)
-      checkAddr(pr2, h2, key, (i + 2), 2, compressed);
-    if (prefixes[pr3].items)
-      checkAddr(pr3, h3, key, (i + 3), 2, compressed);
+void VanitySearch::checkAddr(int prefIdx, uint8_t *hash160, Int &key, int32_t incr, int endomorphism, bool mode, bool scriptHash, Point *p) {
 
-  } else {
+  if (hasPattern) {
 
-    checkAddrSSE(h0, h1, h2, h3, i, i + 1, i + 2, i + 3, key, 2, compressed);
+    // Wildcard search
+    string addr = secp->GetAddress(searchType, mode, hash160);
+    checkPattern(addr, key, incr, endomorphism, mode);
+    return;
 
   }
 
-  // Curve symetrie -------------------------------------------------------------------------
-  // if (x,y) = k*G, then (x, -y) is -k*G
+  vector<PREFIX_ITEM> *pi = tLookup[prefIdx].items;
+  if (pi == NULL)
+    return;
 
-  p1.y.ModNeg();
-  p2.y.ModNeg();
-  p3.y.ModNeg();
-  p4.y.ModNeg();
+  if (onlyFull) {
+
+    // Full addresses
+    for (int i = 0; i < (int)pi->size(); i++) {
 
-  secp->GetHash160(searchType, compressed, p1, p2, p3, p4, h0, h1, h2, h3);
+      if (stopWhenFound && *((*pi)[i].found))
+        continue;
 
-  if (!hasPattern) {
+      // P2SH items are keyed by script hash, others by public key hash
+      if (((*pi)[i].type == P2SH) != scriptHash)
+        continue;
 
-    pr0 = *(prefix_t *)h0;
-    pr1 = *(prefix_t *)h1;
-    pr2 = *(prefix_t *)h2;
-    pr3 = *(prefix_t *)h3;
-
-    if (prefixes[pr0].items)
-      checkAddr(pr0, h0, key, -i, 0, compressed);
-    if (prefixes[pr1].items)
-      checkAddr(pr1, h1, key, -(i + 1), 0, compressed);
-    if (prefixes[pr2].items)
-      checkAddr(pr2, h2, key, -(i + 2), 0, compressed);
-    if (prefixes[pr3].items)
-      checkAddr(pr3, h3, key, -(i + 3), 0, compressed);
+      if (ripemd160_comp_hash((*pi)[i].hash160, hash160)) {
 
-  } else {
+        // Found it !
+        setFound((*pi)[i].found);
+        string addr = secp->GetAddress((*pi)[i].type, mode, hash160);
+        pushHit((*pi)[i].type, addr, key, incr, endomorphism, mode);
 
-    checkAddrSSE(h0, h1, h2, h3, -i, -(i + 1), -(i + 2), -(i + 3), key, 0, compressed);
+      }
 
-  }
+    }
 
-  // Endomorphism #1
-  // if (x, y) = k * G, then (beta*x, y) = lambda*k*G
-  pte1[0].y.ModNeg();
-  pte1[1].y.ModNeg();
-  pte1[2].y.ModNeg();
-  pte1[3].y.ModNeg();
+  } else {
 
+    if (harvestItems) {
+
+      // Harvest mode, prefixes are compared and keys checked by batch
+      HARVEST_ITEM it;
+      it.key.Set(&key);
+      it.incr = incr;
+      it.endomorphism = endomorphism;
+      it.mode = mode;
+      it.scriptHash = scriptHash;
+      it.prefIdx = (prefix_t)prefIdx;
+      memcpy(it.hash160, hash160, 20);
+      it.hasPoint = (p != NULL);
+      if (p) {
+        it.p.x.Set(&p->x);
+        it.p.y.Set(&p->y);
+        it.p.z.SetInt32(1);
+      }
+      harvestItems->push_back(it);
+      addStat(tStats->hits, 1);
+      return;
 
-  secp->GetHash160(searchType, compressed, pte1[0], pte1[1], pte1[2], pte1[3], h0, h1, h2, h3);
+    }
 
-  if (!hasPattern) {
+    char a[64];
 
-    pr0 = *(prefix_t *)h0;
-    pr1 = *(prefix_t *)h1;
-    pr2 = *(prefix_t *)h2;
-    pr3 = *(prefix_t *)h3;
-
-    if (prefixes[pr0].items)
-      checkAddr(pr0, h0, key, -i, 1, compressed);
-    if (prefixes[pr1].items)
-      checkAddr(pr1, h1, key, -(i + 1), 1, compressed);
-    if (prefixes[pr2].items)
-      checkAddr(pr2, h2, key, -(i + 2), 1, compressed);
-    if (prefixes[pr3].items)
-      checkAddr(pr3, h3, key, -(i + 3), 1, compressed);
+    // Address strings are built on demand, P2PKH and BECH32 items may share a bucket
+    string addr[3];
 
-  } else {
+    for (int i = 0; i < (int)pi->size(); i++) {
 
-    checkAddrSSE(h0, h1, h2, h3, -i, -(i + 1), -(i + 2), -(i + 3), key, 1, compressed);
+      if (stopWhenFound && *((*pi)[i].found))
+        continue;
 
-  }
+      int type = (*pi)[i].type;
+      if ((type == P2SH) != scriptHash)
+        continue;
 
-  // Endomorphism #2
-  // if (x, y) = k * G, then (beta2*x, y) = lambda2*k*G
-  pte2[0].y.ModNeg();
-  pte2[1].y.ModNeg();
-  pte2[2].y.ModNeg();
-  pte2[3].y.ModNeg();
+      if (addr[type].length() == 0)
+        addr[type] = secp->GetAddress(type, mode, hash160);
 
-  secp->GetHash160(searchType, compressed, pte2[0], pte2[1], pte2[2], pte2[3], h0, h1, h2, h3);
+      strncpy(a, addr[type].c_str(), (*pi)[i].prefixLength);
+      a[(*pi)[i].prefixLength] = 0;
 
-  if (!hasPattern) {
+      if (caseSensitive ? strcmp((*pi)[i].prefix, a) == 0 : prefixMatch((*pi)[i].prefix, a)) {
 
-    pr0 = *(prefix_t *)h0;
-    pr1 = *(prefix_t *)h1;
-    pr2 = *(prefix_t *)h2;
-    pr3 = *(prefix_t *)h3;
-
-    if (prefixes[pr0].items)
-      checkAddr(pr0, h0, key, -i, 2, compressed);
-    if (prefixes[pr1].items)
-      checkAddr(pr1, h1, key, -(i + 1), 2, compressed);
-    if (prefixes[pr2].items)
-      checkAddr(pr2, h2, key, -(i + 2), 2, compressed);
-    if (prefixes[pr3].items)
-      checkAddr(pr3, h3, key, -(i + 3), 2, compressed);
+        // Found it !
+        setFound((*pi)[i].found);
+        pushHit(type, addr[type], key, incr, endomorphism, mode);
 
-  } else {
+      }
 
-    checkAddrSSE(h0, h1, h2, h3, -i, -(i + 1), -(i + 2), -(i + 3), key, 2, compressed);
+    }
 
   }
 
 }
 
 // ----------------------------------------------------------------------------
-void VanitySearch::getCPUStartingKey(int thId,Int& key,Point& startP) {
 
-  if (rekey > 0) {
-    key.Rand(256);
-  } else {
-    key.Set(&startKey);
-    Int off((int64_t)thId);
-    off.ShiftL(64);
-    key.Add(&off);
+void VanitySearch::harvestVerify(vector<HARVEST_ITEM> &items, vector<int> &ids, vector<Int> &privKeys) {
+
+  int n = (int)ids.size();
+  vector<bool> valid(n, false);
+  vector<int> toCheck;
+  vector<int> sumIds;
+
+  // CPU points are checked all at once: sum(k)*G == sum(P)
+  // incr 0 is excluded (-0 == 0, the symmetric point has the opposite key)
+  for (int i = 0; i < n; i++) {
+    HARVEST_ITEM &it = items[ids[i]];
+    if (it.hasPoint && it.incr != 0 && !startPubKeySpecified)
+      sumIds.push_back(i);
+    else
+      toCheck.push_back(i);
   }
 
-  // Apply range limits if specified
-  if (rangeStart > 0 || rangeEnd > 0) {
-    Int rangeWidth;
-    rangeWidth.Set(&secp->order);
-    
-    if (rangeEnd > 0) {
-      Int end;
-      end.SetInt32((uint32_t)rangeEnd);
-      rangeWidth.Set(&end);
-    }
-    
-    if (rangeStart > 0) {
-      Int start;
-      start.SetInt32((uint32_t)rangeStart);
-      if (rangeEnd > 0)
-        rangeWidth.Sub(&start);
-      key.Set(&start);
-    } else {
-      key.SetInt32(0);
+  if (sumIds.size() > 0) {
+
+    Int sk;
+    sk.SetInt32(0);
+    Point sp = items[ids[sumIds[0]]].p;
+    sk.ModAddK1order(&privKeys[sumIds[0]]);
+    for (int j = 1; j < (int)sumIds.size(); j++) {
+      sk.ModAddK1order(&privKeys[sumIds[j]]);
+      sp = secp->Add2(sp, items[ids[sumIds[j]]].p);
     }
-    
-    // Calculate thread offset within range
-    Int offset;
-    offset.SetInt32(thId);
-    offset.Mult(keysPerThread);
-    key.Add(&offset);
-    
-    // Make sure key is within range
-    if (!key.IsLowerOrEqual(&rangeWidth)) {
-      key.Set(&rangeWidth);
+    sp.Reduce();
+
+    Point q = secp->ComputePublicKey(&sk);
+    if (q.equals(sp)) {
+      for (int j = 0; j < (int)sumIds.size(); j++)
+        valid[sumIds[j]] = true;
+    } else {
+      // Wrong key or degenerated sum (same point twice), check one by one
+      toCheck.insert(toCheck.end(), sumIds.begin(), sumIds.end());
     }
+
   }
 
-  Int km(&key);
-  km.Add((uint64_t)CPU_GRP_SIZE / 2);
-  startP = secp->ComputePublicKey(&km);
-  if(startPubKeySpecified)
-    startP = secp->AddDirect(startP,startPubKey);
-}
+  if (toCheck.size() > 0) {
 
-void VanitySearch::FindKeyCPU(TH_PARAM *ph) {
+    vector<Int> keys;
+    vector<Point> pts;
+    for (int j = 0; j < (int)toCheck.size(); j++)
+      keys.push_back(privKeys[toCheck[j]]);
+    secp->ComputePublicKeys(keys, pts);
 
-  // Global init
-  int thId = ph->threadId;
-  counters[thId] = 0;
+    for (int j = 0; j < (int)toCheck.size(); j++) {
 
-  // CPU Thread
-  IntGroup *grp = new IntGroup(CPU_GRP_SIZE/2+1);
+      int i = toCheck[j];
+      HARVEST_ITEM &it = items[ids[i]];
+      int hType = it.scriptHash ? P2SH : P2PKH;
+      uint8_t h[20];
 
-  // Group Init
-  Int  key;
-  Point startP;
-  getCPUStartingKey(thId,key,startP);
+      Point p = pts[j];
+      if (startPubKeySpecified) {
+        Int k;
+        Point sp;
+        getPrivKey(it.key, it.incr, it.endomorphism, k, sp);
+        p = secp->AddDirect(p, sp);
+      }
 
-  Int dx[CPU_GRP_SIZE/2+1];
+      secp->GetHash160(hType, it.mode, p, h);
+      if (!ripemd160_comp_hash(h, it.hash160)) {
+
+        // Key may be the opposite one (negative zero or compressed key)
+        p.y.ModNeg();
+        secp->GetHash160(hType, it.mode, p, h);
+        if (!ripemd160_comp_hash(h, it.hash160)) {
+          printf("\nWarning, wrong private key generated !\n");
+          printf("  Endo:%d incr:%d comp:%d\n", it.endomorphism, it.incr, it.mode);
+          continue;
+        }
+        privKeys[i].Neg();
+        privKeys[i].Add(&secp->order);
+
+      }
+
+      valid[i] = true;
+
+    }
+
+  }
+
+  int nbValid = 0;
+  for (int i = 0; i < n; i++) {
+    if (valid[i]) {
+      ids[nbValid] = ids[i];
+      privKeys[nbValid].Set(&privKeys[i]);
+      nbValid++;
+    }
+  }
+  ids.resize(nbValid);
+  privKeys.resize(nbValid);
+
+}
+
+// ----------------------------------------------------------------------------
+
+void VanitySearch::harvestFlush(vector<HARVEST_ITEM> &items) {
+
+  int n = (int)items.size();
+  if (n == 0)
+    return;
+
+  // Addresses, P2PKH and P2SH ones are Base58 encoded 4 at a time
+  vector<string> addr[3];
+  vector<int> toEncode[2][2];  // [type][compressed]
+  for (int t = 0; t < 3; t++)
+    addr[t].resize(n);
+
+  for (int i = 0; i < n; i++) {
+
+    HARVEST_ITEM &it = items[i];
+    vector<PREFIX_ITEM> *pi = tLookup[it.prefIdx].items;
+    if (pi == NULL)
+      continue;
+    bool need[3] = { false,false,false };
+    for (int j = 0; j < (int)pi->size(); j++) {
+      if (stopWhenFound && *((*pi)[j].found))
+        continue;
+      int type = (*pi)[j].type;
+      // P2SH and BECH32 addresses are defined for compressed keys only
+      if ((type == P2SH) == it.scriptHash && (it.mode || type == P2PKH))
+        need[type] = true;
+    }
+
+    if (need[P2PKH]) toEncode[P2PKH][it.mode].push_back(i);
+    if (need[P2SH]) toEncode[P2SH][it.mode].push_back(i);
+    if (need[BECH32]) addr[BECH32][i] = secp->GetAddress(BECH32, it.mode, it.hash160);
+
+  }
+
+  for (int t = 0; t < 2; t++) {
+    for (int m = 0; m < 2; m++) {
+      vector<int> &l = toEncode[t][m];
+      int last = (int)l.size() - 1;
+      for (int j = 0; j <= last; j += 4) {
+        vector<string> a = secp->GetAddress(t, m == 1, items[l[j]].hash160,
+                                            items[l[std::min(j + 1, last)]].hash160,
+                                            items[l[std::min(j + 2, last)]].hash160,
+                                            items[l[std::min(j + 3, last)]].hash160);
+        for (int k = 0; k < 4 && j + k <= last; k++)
+          addr[t][l[j + k]] = a[k];
+      }
+    }
+  }
+
+  // Prefixes
+  char a[64];
+  vector<int> ids;
+  vector<int> typeMask(n, 0);
+
+  for (int i = 0; i < n; i++) {
+
+    HARVEST_ITEM &it = items[i];
+    vector<PREFIX_ITEM> *pi = tLookup[it.prefIdx].items;
+    if (pi == NULL)
+      continue;
+
+    for (int j = 0; j < (int)pi->size(); j++) {
+
+      if (stopWhenFound && *((*pi)[j].found))
+        continue;
+
+      int type = (*pi)[j].type;
+      if ((type == P2SH) != it.scriptHash || addr[type][i].length() == 0)
+        continue;
+
+      strncpy(a, addr[type][i].c_str(), (*pi)[j].prefixLength);
+      a[(*pi)[j].prefixLength] = 0;
+
+      if (caseSensitive ? strcmp((*pi)[j].prefix, a) == 0 : prefixMatch((*pi)[j].prefix, a)) {
+        setFound((*pi)[j].found);
+        typeMask[i] |= (1 << type);
+      }
+
+    }
+
+    if (typeMask[i])
+      ids.push_back(i);
+
+  }
+
+  if (ids.size() == 0)
+    return;
+
+  // Private keys
+  vector<Int> privKeys(ids.size());
+  for (int j = 0; j < (int)ids.size(); j++) {
+    HARVEST_ITEM &it = items[ids[j]];
+    Point sp;
+    getPrivKey(it.key, it.incr, it.endomorphism, privKeys[j], sp);
+  }
+  harvestVerify(items, ids, privKeys);
+
+  // Records
+  string csv;
+  vector<uint8_t> bin;
+  int nbRecord = 0;
+
+  for (int j = 0; j < (int)ids.size(); j++) {
+
+    int i = ids[j];
+    HARVEST_ITEM &it = items[i];
+
+    for (int type = 0; type < 3; type++) {
+
+      if (!(typeMask[i] & (1 << type)))
+        continue;
+
+      if (harvest == HARVEST_CSV) {
+        csv.append(addr[type][i]);
+        csv.append(",");
+        csv.append(addressTypes[type]);
+        csv.append(",");
+        if (!startPubKeySpecified)
+          csv.append(secp->GetPrivAddress(it.mode, privKeys[j]));
+        csv.append(",");
+        csv.append(privKeys[j].GetBase16());
+        csv.append("\n");
+      } else {
+        uint8_t r[56];
+        r[0] = (uint8_t)type;
+        r[1] = it.mode ? 1 : 0;
+        r[2] = startPubKeySpecified ? 1 : 0;
+        r[3] = 0;
+        memcpy(r + 4, it.hash160, 20);
+        privKeys[j].Get32Bytes(r + 24);
+        bin.insert(bin.end(), r, r + 56);
+      }
+      nbRecord++;
+
+    }
+
+  }
+
+  if (harvest == HARVEST_CSV)
+    writer->writeRaw(csv.c_str(), csv.length(), nbRecord);
+  else
+    writer->writeRaw(bin.data(), bin.size(), nbRecord);
+  nbFoundKey += nbRecord;
+
+  if (stopWhenFound)
+    updateFound();
+
+}
+
+// ----------------------------------------------------------------------------
+
+#ifdef WIN64
+DWORD WINAPI _VerifyHits(LPVOID lpParam) {
+#else
+void *_VerifyHits(void *lpParam) {
+#endif
+  VanitySearch *v = (VanitySearch *)lpParam;
+  v->VerifyHits();
+  return 0;
+}
+
+#ifdef WIN64
+DWORD WINAPI _FindKey(LPVOID lpParam) {
+#else
+void *_FindKey(void *lpParam) {
+#endif
+  TH_PARAM *p = (TH_PARAM *)lpParam;
+  p->obj->FindKeyCPU(p);
+  return 0;
+}
+
+#ifdef WIN64
+DWORD WINAPI _FindKeyGPU(LPVOID lpParam) {
+#else
+void *_FindKeyGPU(void *lpParam) {
+#endif
+  TH_PARAM *p = (TH_PARAM *)lpParam;
+  p->obj->FindKeyGPU(p);
+  return 0;
+}
+
+// Called by the flush thread of the writer on SIGINT/SIGTERM
+static void _Interrupt(int sig, void *arg) {
+  VanitySearch *v = (VanitySearch *)arg;
+  v->Interrupt();
+}
+
+#ifndef WIN64
+void *_SignalWatch(void *lpParam) {
+  VanitySearch *v = (VanitySearch *)lpParam;
+  v->SignalWatch();
+  return 0;
+}
+#endif
+
+THREAD_HANDLE launchThread(THREAD_FUNC f, void *param) {
+
+#ifdef WIN64
+  DWORD thread_id;
+  THREAD_HANDLE h = CreateThread(NULL, 0, f, param, 0, &thread_id);
+  if (h == NULL) {
+#else
+  THREAD_HANDLE h;
+  if (pthread_create(&h, NULL, f, param) != 0) {
+#endif
+    printf("Cannot create thread\n");
+    exit(-1);
+  }
+  return h;
+
+}
+
+void joinThread(THREAD_HANDLE h) {
+
+#ifdef WIN64
+  WaitForSingleObject(h, INFINITE);
+  CloseHandle(h);
+#else
+  pthread_join(h, NULL);
+#endif
+
+}
+
+void detachThread(THREAD_HANDLE h) {
+
+#ifdef WIN64
+  CloseHandle(h);
+#else
+  pthread_detach(h);
+#endif
+
+}
+
+// ----------------------------------------------------------------------------
+
+void VanitySearch::checkHash(bool compressed, Point &p, int32_t incr, Int &key, int endomorphism) {
+
+  unsigned char h0[20];
+  prefix_t pr0;
+
+  if (hasPattern) {
+    secp->GetHash160(searchType, compressed, p, h0);
+    if (patternFilter(h0))
+      checkAddr(0, h0, key, incr, endomorphism, compressed, searchType == P2SH, &p);
+    return;
+  }
+
+  // Public key hash, shared by P2PKH and BECH32
+  if (hasHash160) {
+    secp->GetHash160(P2PKH, compressed, p, h0);
+    pr0 = *(prefix_t *)h0;
+    if (tLookup[pr0].items)
+      checkAddr(pr0, h0, key, incr, endomorphism, compressed, false, &p);
+  }
+
+  // Script hash, derived from the public key hash
+  if (hasP2SH) {
+    if (hasHash160)
+      secp->GetScriptHash160(h0, h0);
+    else
+      secp->GetHash160(P2SH, compressed, p, h0);
+    pr0 = *(prefix_t *)h0;
+    if (tLookup[pr0].items)
+      checkAddr(pr0, h0, key, incr, endomorphism, compressed, true, &p);
+  }
+
+}
+
+// ----------------------------------------------------------------------------
+
+void VanitySearch::checkHashSSE(bool compressed, Point &p1, Point &p2, Point &p3, Point &p4,
+                                int32_t incr1, int32_t incr2, int32_t incr3, int32_t incr4,
+                                Int &key, int endomorphism) {
+
+  unsigned char h0[20];
+  unsigned char h1[20];
+  unsigned char h2[20];
+  unsigned char h3[20];
+
+  if (hasPattern) {
+    secp->GetHash160(searchType, compressed, p1, p2, p3, p4, h0, h1, h2, h3);
+    checkAddrSSE(h0, h1, h2, h3, incr1, incr2, incr3, incr4, key, endomorphism, compressed);
+    return;
+  }
+
+  // Public key hash, shared by P2PKH and BECH32
+  if (hasHash160) {
+
+    secp->GetHash160(P2PKH, compressed, p1, p2, p3, p4, h0, h1, h2, h3);
+
+    prefix_t pr0 = *(prefix_t *)h0;
+    prefix_t pr1 = *(prefix_t *)h1;
+    prefix_t pr2 = *(prefix_t *)h2;
+    prefix_t pr3 = *(prefix_t *)h3;
+
+    if (tLookup[pr0].items)
+      checkAddr(pr0, h0, key, incr1, endomorphism, compressed, false, &p1);
+    if (tLookup[pr1].items)
+      checkAddr(pr1, h1, key, incr2, endomorphism, compressed, false, &p2);
+    if (tLookup[pr2].items)
+      checkAddr(pr2, h2, key, incr3, endomorphism, compressed, false, &p3);
+    if (tLookup[pr3].items)
+      checkAddr(pr3, h3, key, incr4, endomorphism, compressed, false, &p4);
+
+  }
+
+  // Script hash, derived from the public key hash
+  if (hasP2SH) {
+
+    if (hasHash160)
+      secp->GetScriptHash160(h0, h1, h2, h3, h0, h1, h2, h3);
+    else
+      secp->GetHash160(P2SH, compressed, p1, p2, p3, p4, h0, h1, h2, h3);
+
+    prefix_t pr0 = *(prefix_t *)h0;
+    prefix_t pr1 = *(prefix_t *)h1;
+    prefix_t pr2 = *(prefix_t *)h2;
+    prefix_t pr3 = *(prefix_t *)h3;
+
+    if (tLookup[pr0].items)
+      checkAddr(pr0, h0, key, incr1, endomorphism, compressed, true, &p1);
+    if (tLookup[pr1].items)
+      checkAddr(pr1, h1, key, incr2, endomorphism, compressed, true, &p2);
+    if (tLookup[pr2].items)
+      checkAddr(pr2, h2, key, incr3, endomorphism, compressed, true, &p3);
+    if (tLookup[pr3].items)
+      checkAddr(pr3, h3, key, incr4, endomorphism, compressed, true, &p4);
+
+  }
+
+}
+
+// ----------------------------------------------------------------------------
+
+void VanitySearch::checkAddresses(bool compressed, Int key, int i, Point p1) {
+
+  Point pte1[1];
+  Point pte2[1];
+
+  // Point
+  checkHash(compressed, p1, i, key, 0);
+  if (rangeStrict)
+    return;
+
+  // Endomorphism #1
+  pte1[0].x.ModMulK1(&p1.x, &beta);
+  pte1[0].y.Set(&p1.y);
+  checkHash(compressed, pte1[0], i, key, 1);
+
+  // Endomorphism #2
+  pte2[0].x.ModMulK1(&p1.x, &beta2);
+  pte2[0].y.Set(&p1.y);
+  checkHash(compressed, pte2[0], i, key, 2);
+
+  // Curve symetrie
+  // if (x,y) = k*G, then (x, -y) is -k*G
+  p1.y.ModNeg();
+  checkHash(compressed, p1, -i, key, 0);
+
+  // Endomorphism #1
+  pte1[0].y.ModNeg();
+  checkHash(compressed, pte1[0], -i, key, 1);
+
+  // Endomorphism #2
+  pte2[0].y.ModNeg();
+  checkHash(compressed, pte2[0], -i, key, 2);
+
+}
+
+// ----------------------------------------------------------------------------
+
+void VanitySearch::checkPubKey(Int &x, Int &y, Int &key, int32_t incr, int endomorphism) {
+
+  vector<int> ids;
+  xMatcher->match(&x, ids);
+
+  for (int i = 0; i < (int)ids.size(); i++) {
+
+    X_TARGET &t = xMatcher->get(ids[i]);
+
+    // (x,y) and (x,-y) share the same x, the target parity selects the key
+    Point p;
+    p.x.Set(&x);
+    p.y.Set(&y);
+    int32_t pIncr = incr;
+    if (t.parity >= 0 && (int)p.y.IsOdd() != t.parity) {
+      if (rangeStrict)
+        continue;
+      p.y.ModNeg();
+      pIncr = -incr;
+    }
+
+    setPatternFound(ids[i]);
+    string addr = secp->GetAddress(t.type, t.compressed, p);
+    pushHit(t.type, addr, key, pIncr, endomorphism, t.compressed);
+
+  }
+
+}
+
+// ----------------------------------------------------------------------------
+
+void VanitySearch::checkPubKeys(Int &key, int i, Point &p1) {
+
+  Int x;
+
+  // Point and symetric point
+  if (xMatcher->preFilter(p1.x.bits64[3]))
+    checkPubKey(p1.x, p1.y, key, i, 0);
+  if (rangeStrict)
+    return;
+
+  // Endomorphism #1
+  x.ModMulK1(&p1.x, &beta);
+  if (xMatcher->preFilter(x.bits64[3]))
+    checkPubKey(x, p1.y, key, i, 1);
+
+  // Endomorphism #2
+  x.ModMulK1(&p1.x, &beta2);
+  if (xMatcher->preFilter(x.bits64[3]))
+    checkPubKey(x, p1.y, key, i, 2);
+
+}
+
+// ----------------------------------------------------------------------------
+
+void VanitySearch::checkAddressesSSE(bool compressed,Int key, int i, Point p1, Point p2, Point p3, Point p4) {
+
+  Point pte1[4];
+  Point pte2[4];
+
+  // Point -------------------------------------------------------------------------
+  checkHashSSE(compressed, p1, p2, p3, p4, i, i + 1, i + 2, i + 3, key, 0);
+  if (rangeStrict)
+    return;
+
+  // Endomorphism #1
+  // if (x, y) = k * G, then (beta*x, y) = lambda*k*G
+  pte1[0].x.ModMulK1(&p1.x, &beta);
+  pte1[0].y.Set(&p1.y);
+  pte1[1].x.ModMulK1(&p2.x, &beta);
+  pte1[1].y.Set(&p2.y);
+  pte1[2].x.ModMulK1(&p3.x, &beta);
+  pte1[2].y.Set(&p3.y);
+  pte1[3].x.ModMulK1(&p4.x, &beta);
+  pte1[3].y.Set(&p4.y);
+
+  checkHashSSE(compressed, pte1[0], pte1[1], pte1[2], pte1[3], i, i + 1, i + 2, i + 3, key, 1);
+
+  // Endomorphism #2
+  // if (x, y) = k * G, then (beta2*x, y) = lambda2*k*G
+  pte2[0].x.ModMulK1(&p1.x, &beta2);
+  pte2[0].y.Set(&p1.y);
+  pte2[1].x.ModMulK1(&p2.x, &beta2);
+  pte2[1].y.Set(&p2.y);
+  pte2[2].x.ModMulK1(&p3.x, &beta2);
+  pte2[2].y.Set(&p3.y);
+  pte2[3].x.ModMulK1(&p4.x, &beta2);
+  pte2[3].y.Set(&p4.y);
+
+  checkHashSSE(compressed, pte2[0], pte2[1], pte2[2], pte2[3], i, i + 1, i + 2, i + 3, key, 2);
+
+  // Curve symetrie -------------------------------------------------------------------------
+  // if (x,y) = k*G, then (x, -y) is -k*G
+
+  p1.y.ModNeg();
+  p2.y.ModNeg();
+  p3.y.ModNeg();
+  p4.y.ModNeg();
+
+  checkHashSSE(compressed, p1, p2, p3, p4, -i, -(i + 1), -(i + 2), -(i + 3), key, 0);
+
+  // Endomorphism #1
+  // if (x, y) = k * G, then (beta*x, y) = lambda*k*G
+  pte1[0].y.ModNeg();
+  pte1[1].y.ModNeg();
+  pte1[2].y.ModNeg();
+  pte1[3].y.ModNeg();
+
+  checkHashSSE(compressed, pte1[0], pte1[1], pte1[2], pte1[3], -i, -(i + 1), -(i + 2), -(i + 3), key, 1);
+
+  // Endomorphism #2
+  // if (x, y) = k * G, then (beta2*x, y) = lambda2*k*G
+  pte2[0].y.ModNeg();
+  pte2[1].y.ModNeg();
+  pte2[2].y.ModNeg();
+  pte2[3].y.ModNeg();
+
+  checkHashSSE(compressed, pte2[0], pte2[1], pte2[2], pte2[3], -i, -(i + 1), -(i + 2), -(i + 3), key, 2);
+
+}
+
+// ----------------------------------------------------------------------------
+void VanitySearch::getCPUStartingKey(int thId,Int& key,Point& startP) {
+
+  if (rekey > 0) {
+    key.Rand(256);
+  } else {
+    key.Set(&startKey);
+    Int off((int64_t)thId);
+    off.ShiftL(64);
+    key.Add(&off);
+  }
+
+  getCPUStartingPoint(key, startP);
+
+}
+
+void VanitySearch::getCPUStartingPoint(Int &key, Point &startP) {
+
+  Int km(&key);
+  km.Add((uint64_t)CPU_GRP_SIZE / 2);
+  startP = secp->ComputePublicKey(&km);
+  if(startPubKeySpecified)
+    startP = secp->AddDirect(startP,startPubKey);
+
+}
+
+// ----------------------------------------------------------------------------
+
+static void directAdd(Secp256K1 *secp, Point &c, bool same, Point &r) {
+
+  // c + a where a = c (same) or a = -c, point at infinity cleared
+  if (same)
+    r = secp->DoubleDirect(c);
+  else
+    r.Clear();
+
+}
+
+static void computeGroup(Secp256K1 *secp, Point &startP, Point *gn, Point *g2n, Int *dx, IntGroup *grp, Point *pts) {
+
+  // pts[i] = startP + (i - GRP_SIZE/2)*G, startP moved to the next center
+
+  Int dy;
+  Int dyn;
+  Int _s;
+  Int _p;
+  Point pp;
+  Point pn;
+
+  // Fill group
+  int i;
+  int hLength = (CPU_GRP_SIZE / 2 - 1);
+
+  for (i = 0; i < hLength; i++) {
+    dx[i].ModSub(&gn[i].x, &startP.x);
+  }
+  dx[i].ModSub(&gn[i].x, &startP.x);  // For the first point
+  dx[i+1].ModSub(&g2n->x, &startP.x); // For the next center point
+
+  // A center equal to +/-gn[i] or +/-g2n (keys close to 0, GRP_SIZE or the
+  // order) gives a null dx that would spoil the whole inversion, these
+  // points are computed apart
+  bool degenerate = false;
+  for (i = 0; i < hLength + 2; i++) {
+    if (dx[i].IsZero()) {
+      dx[i].SetInt32(1);
+      degenerate = true;
+    }
+  }
+
+  // Grouped ModInv
+  grp->ModInv();
+
+  // We use the fact that P + i*G and P - i*G has the same deltax, so the same inverse
+  // We compute key in the positive and negative way from the center of the group
+
+  // center point
+  Point center(startP);
+  pts[CPU_GRP_SIZE/2] = startP;
+
+  for (i = 0; i<hLength; i++) {
+
+    pp = startP;
+    pn = startP;
+
+    // P = startP + i*G
+    dy.ModSub(&gn[i].y,&pp.y);
+
+    _s.ModMulK1(&dy, &dx[i]);       // s = (p2.y-p1.y)*inverse(p2.x-p1.x);
+    _p.ModSquareK1(&_s);            // _p = pow2(s)
+
+    pp.x.ModNeg();
+    pp.x.ModAdd(&_p);
+    pp.x.ModSub(&gn[i].x);           // rx = pow2(s) - p1.x - p2.x;
+
+    pp.y.ModSub(&gn[i].x, &pp.x);
+    pp.y.ModMulK1(&_s);
+    pp.y.ModSub(&gn[i].y);           // ry = - p2.y - s*(ret.x-p2.x);
+
+    // P = startP - i*G  , if (x,y) = i*G then (x,-y) = -i*G
+    dyn.Set(&gn[i].y);
+    dyn.ModNeg();
+    dyn.ModSub(&pn.y);
+
+    _s.ModMulK1(&dyn, &dx[i]);      // s = (p2.y-p1.y)*inverse(p2.x-p1.x);
+    _p.ModSquareK1(&_s);            // _p = pow2(s)
+
+    pn.x.ModNeg();
+    pn.x.ModAdd(&_p);
+    pn.x.ModSub(&gn[i].x);          // rx = pow2(s) - p1.x - p2.x;
+
+    pn.y.ModSub(&gn[i].x, &pn.x);
+    pn.y.ModMulK1(&_s);
+    pn.y.ModAdd(&gn[i].y);          // ry = - p2.y - s*(ret.x-p2.x);
+
+    pts[CPU_GRP_SIZE/2 + (i+1)] = pp;
+    pts[CPU_GRP_SIZE/2 - (i+1)] = pn;
+
+  }
+
+  // First point (startP - (GRP_SZIE/2)*G)
+  pn = startP;
+  dyn.Set(&gn[i].y);
+  dyn.ModNeg();
+  dyn.ModSub(&pn.y);
+
+  _s.ModMulK1(&dyn, &dx[i]);
+  _p.ModSquareK1(&_s);
+
+  pn.x.ModNeg();
+  pn.x.ModAdd(&_p);
+  pn.x.ModSub(&gn[i].x);
+
+  pn.y.ModSub(&gn[i].x, &pn.x);
+  pn.y.ModMulK1(&_s);
+  pn.y.ModAdd(&gn[i].y);
+
+  pts[0] = pn;
+
+  // Next start point (startP + GRP_SIZE*G)
+  pp = startP;
+  dy.ModSub(&g2n->y, &pp.y);
+
+  _s.ModMulK1(&dy, &dx[i+1]);
+  _p.ModSquareK1(&_s);
+
+  pp.x.ModNeg();
+  pp.x.ModAdd(&_p);
+  pp.x.ModSub(&g2n->x);
+
+  pp.y.ModSub(&g2n->x, &pp.x);
+  pp.y.ModMulK1(&_s);
+  pp.y.ModSub(&g2n->y);
+  startP = pp;
+
+  if (degenerate) {
+    for (i = 0; i <= hLength; i++) {
+      if (!center.x.IsEqual(&gn[i].x))
+        continue;
+      bool same = center.y.IsEqual(&gn[i].y);
+      if (i < hLength)
+        directAdd(secp, center, same, pts[CPU_GRP_SIZE/2 + (i+1)]);
+      directAdd(secp, center, !same, pts[CPU_GRP_SIZE/2 - (i+1)]);
+    }
+    if (center.x.IsEqual(&g2n->x))
+      directAdd(secp, center, center.y.IsEqual(&g2n->y), startP);
+  }
+
+}
+
+// ----------------------------------------------------------------------------
+
+bool VanitySearch::CheckGroup(Secp256K1 *secp) {
+
+  // Groups whose center is an addend of the batched addition (regression:
+  // -rg 0,FFF missed 0x1F3, -rg 200,FFF missed 0x300)
+  Point gn[CPU_GRP_SIZE / 2 + 1];
+  Point g = secp->G;
+  gn[0] = g;
+  for (int i = 1; i < CPU_GRP_SIZE / 2; i++) {
+    g = (i == 1) ? secp->DoubleDirect(g) : secp->AddDirect(g, secp->G);
+    gn[i] = g;
+  }
+  gn[CPU_GRP_SIZE / 2] = secp->DoubleDirect(gn[CPU_GRP_SIZE / 2 - 1]);
+
+  Int dx[CPU_GRP_SIZE / 2 + 1];
+  Point pts[CPU_GRP_SIZE];
+  IntGroup grp(CPU_GRP_SIZE / 2 + 1);
+  grp.Set(dx);
+
+  // Centers GRP_SIZE/2+1 (first key 1), GRP_SIZE, 2, order-1, order-GRP_SIZE
+  const int64_t centers[] = { CPU_GRP_SIZE / 2 + 1, CPU_GRP_SIZE, 2, -1, -CPU_GRP_SIZE };
+  bool ok = true;
+  for (int c = 0; c < 5; c++) {
+
+    Int key((uint64_t)(centers[c] < 0 ? -centers[c] : centers[c]));
+    if (centers[c] < 0) {
+      key.Neg();
+      key.Add(&secp->order);
+    }
+    Point startP = secp->ComputePublicKey(&key);
+    computeGroup(secp, startP, gn, gn + CPU_GRP_SIZE / 2, dx, &grp, pts);
+
+    Int k(&key);
+    k.Sub((uint64_t)CPU_GRP_SIZE / 2);
+    if (k.IsNegative())
+      k.Add(&secp->order);
+    for (int i = 0; i <= CPU_GRP_SIZE; i++) {
+      Point &p = (i < CPU_GRP_SIZE) ? pts[i] : startP;
+      if (i == CPU_GRP_SIZE) {
+        k.Set(&key);
+        k.Add((uint64_t)CPU_GRP_SIZE);
+        k.Mod(&secp->order);
+      }
+      if (k.IsZero()) {
+        ok = ok && p.x.IsZero() && p.y.IsZero();
+      } else {
+        Point e = secp->ComputePublicKey(&k);
+        if (!e.x.IsEqual(&p.x) || !e.y.IsEqual(&p.y)) {
+          printf("CheckGroup: wrong point %d for center %s\n", i, key.GetBase16().c_str());
+          ok = false;
+        }
+      }
+      k.AddOne();
+      if (k.IsEqual(&secp->order))
+        k.SetInt32(0);
+    }
+
+  }
+
+  printf("CheckGroup %s\n", ok ? "OK" : "failed");
+  return ok;
+
+}
+
+void VanitySearch::FindKeyCPU(TH_PARAM *ph) {
+
+  // Global init
+  int thId = ph->threadId;
+  tStats = stats + thId;
+
+  // Threads are spread over the nodes, one cpu each
+  if (useNuma) {
+    int node = thId % nbNumaNode;
+    vector<int> &nodeCpus = Numa::GetCpus(node);
+    vector<int> cpu(1, nodeCpus[(thId / nbNumaNode) % nodeCpus.size()]);
+    enterNode(node, cpu);
+  }
+  Point *gn = tNode ? tNode->Gn : Gn;
+  Point *g2n = tNode ? tNode->Gn + CPU_GRP_SIZE / 2 : &_2Gn;
+
+  // CPU Thread
+  IntGroup *grp = new IntGroup(CPU_GRP_SIZE/2+1);
+
+  // Group Init, a reused slot continues where its previous thread stopped.
+  // In range mode, the starting point is computed with the first group.
+  Int  key;
+  Point startP;
+  bool jump = rangeMode;
+  if (rangeMode) {
+    lockRange();
+    ph->working = true;
+    key.Set(&ph->resumeKey);
+    unlockRange();
+  } else if (ph->hasResume) {
+    key.Set(&ph->resumeKey);
+    getCPUStartingPoint(key, startP);
+  } else {
+    getCPUStartingKey(thId, key, startP);
+  }
+  lockRange();
+  ph->ckptKey.Set(&key);
+  unlockRange();
+
+  Int dx[CPU_GRP_SIZE/2+1];
   Point pts[CPU_GRP_SIZE];
+  grp->Set(dx);
+
+  vector<HARVEST_ITEM> hItems;
+  double lastFlush = Timer::get_tick();
+  if (harvest != HARVEST_NONE) {
+    hItems.reserve(HARVEST_BATCH + 6 * CPU_GRP_SIZE);
+    harvestItems = &hItems;
+  }
+
+  ph->hasStarted = true;
+  ph->rekeyRequest = false;
+  notify(EVENT_STARTED);
+
+  int nbKey = CPU_GRP_SIZE;
+
+  while (!endOfSearch && !ph->stopRequest) {
+
+    if (ph->rekeyRequest) {
+      getCPUStartingKey(thId, key, startP);
+      ph->rekeyRequest = false;
+      addStat(tStats->rekeys, 1);
+    }
+
+    // Keys before the group are checked, saved by the checkpoints
+    if (!rangeMode && ckptFile.length() > 0) {
+      lockRange();
+      ph->ckptKey.Set(&key);
+      unlockRange();
+    }
+
+    if (rangeMode) {
+      if (!getRangeGroup(ph, key, nbKey, jump)) {
+        if (waitLeases())
+          continue;
+        ph->done = true;
+        break;
+      }
+      if (jump) {
+        getCPUStartingPoint(key, startP);
+        jump = false;
+      }
+    }
+
+    enterLookup(thId);
+
+    computeGroup(secp, startP, gn, g2n, dx, grp, pts);
+
+#if 0
+    // Check
+    {
+      bool wrong = false;
+      Point p0 = secp.ComputePublicKey(&key);
+      for (int i = 0; i < CPU_GRP_SIZE; i++) {
+        if (!p0.equals(pts[i])) {
+          wrong = true;
+          printf("[%d] wrong point\n",i);
+        }
+        p0 = secp.NextKey(p0);
+      }
+      if(wrong) exit(0);
+    }
+#endif
+
+    // Check addresses
+    if (pubKeySearch) {
+
+      for (int i = 0; i < nbKey && !endOfSearch; i++)
+        checkPubKeys(key, i, pts[i]);
+
+    } else if (useSSE && nbKey == CPU_GRP_SIZE) {
+
+      for (int i = 0; i < CPU_GRP_SIZE && !endOfSearch; i += 4) {
+
+        switch (searchMode) {
+          case SEARCH_COMPRESSED:
+            checkAddressesSSE(true, key, i, pts[i], pts[i + 1], pts[i + 2], pts[i + 3]);
+            break;
+          case SEARCH_UNCOMPRESSED:
+            checkAddressesSSE(false, key, i, pts[i], pts[i + 1], pts[i + 2], pts[i + 3]);
+            break;
+          case SEARCH_BOTH:
+            checkAddressesSSE(true, key, i, pts[i], pts[i + 1], pts[i + 2], pts[i + 3]);
+            checkAddressesSSE(false, key, i, pts[i], pts[i + 1], pts[i + 2], pts[i + 3]);
+            break;
+        }
+
+      }
+
+    } else {
+
+      for (int i = 0; i < nbKey && !endOfSearch; i ++) {
+
+        switch (searchMode) {
+        case SEARCH_COMPRESSED:
+          checkAddresses(true, key, i, pts[i]);
+          break;
+        case SEARCH_UNCOMPRESSED:
+          checkAddresses(false, key, i, pts[i]);
+          break;
+        case SEARCH_BOTH:
+          checkAddresses(true, key, i, pts[i]);
+          checkAddresses(false, key, i, pts[i]);
+          break;
+        }
+
+      }
+
+    }
+
+    if (harvestItems && hItems.size() > 0) {
+      double t = Timer::get_tick();
+      if (hItems.size() >= HARVEST_BATCH || t - lastFlush > 1.0) {
+        harvestFlush(hItems);
+        hItems.clear();
+        lastFlush = t;
+      }
+    }
+
+    key.Add((uint64_t)CPU_GRP_SIZE);
+    addStat(tStats->keys, rangeStrict ? nbKey : 6*nbKey); // Point + endo #1 + endo #2 + Symetric point + endo #1 + endo #2
+    addStat(tStats->groups, 1);
+    if (rangeMode)
+      addStat(tStats->rangeKeys, nbKey);
+
+  }
+
+  if (harvestItems) {
+    harvestFlush(hItems);
+    harvestItems = NULL;
+  }
+
+  if (rangeMode) {
+    lockRange();
+    ph->working = false;
+    ph->ckptKey.Set(&key);
+    unlockRange();
+  } else {
+    ph->resumeKey.Set(&key);
+    ph->hasResume = true;
+  }
+
+  tStats->epoch = 0xFFFFFFFF;
+  tStats = NULL;
+  tNode = NULL;
+  ph->isRunning = false;
+  notify(EVENT_STOPPED);
+
+}
+
+// ----------------------------------------------------------------------------
+
+void VanitySearch::splitRange(Int &start, Int &end, int nbPart, int part, Int &s, Int &e) {
+
+  // Part sizes differ by at most one key, an empty part has e = s - 1
+  Int size(&end);
+  size.Sub(&start);
+  size.AddOne();
+  Int n((uint64_t)nbPart);
+  Int r;
+  size.Div(&n, &r);
+  uint64_t extra = r.bits64[0];
+
+  Int off(&size);
+  off.Mult((uint64_t)part);
+  off.Add((uint64_t)part < extra ? (uint64_t)part : extra);
+  s.Set(&start);
+  s.Add(&off);
+  e.Set(&s);
+  e.Add(&size);
+  if ((uint64_t)part >= extra)
+    e.SubOne();
+
+}
+
+// ----------------------------------------------------------------------------
+
+void VanitySearch::lockRange() {
+#ifdef WIN64
+  WaitForSingleObject(rangeMutex, INFINITE);
+#else
+  pthread_mutex_lock(&rangeMutex);
+#endif
+}
+
+void VanitySearch::unlockRange() {
+#ifdef WIN64
+  ReleaseMutex(rangeMutex);
+#else
+  pthread_mutex_unlock(&rangeMutex);
+#endif
+}
+
+void VanitySearch::initChunks(Int &start, Int &end) {
+
+  chunkStart.Set(&start);
+  chunkEnd.Set(&end);
+  chunkCursor = 0;
+  nbChunkDone = 0;
+  chunkPieces.clear();
+  chunkDone.clear();
+  chunkTaken.clear();
+  if (start.IsGreater(&end)) {
+    nbChunk = 0;
+    return;
+  }
+
+  Int size(&end);
+  size.Sub(&start);
+  size.AddOne();
+  Int maxChunk((uint64_t)RANGE_MAX_CHUNK);
+
+  if (!chunkReq.IsZero()) {
+
+    // Chunk size of the command line, whatever the range
+    chunkSize.Set(&chunkReq);
+    Int n(&size);
+    n.Div(&chunkSize);
+    if (n.IsGreaterOrEqual(&maxChunk)) {
+      printf("Error: -chunk too small for the range, more than 2^%.0f chunks\n", log2((double)RANGE_MAX_CHUNK));
+      exit(-1);
+    }
+
+  } else {
+
+    // Larger chunks only when there would be too many of them, whole groups
+    Int minSize((uint64_t)RANGE_CHUNK_SIZE);
+    chunkSize.Set(&minSize);
+    Int max(&size);
+    max.Div(&maxChunk);
+    if (max.IsGreaterOrEqual(&chunkSize)) {
+      Int grp((uint64_t)CPU_GRP_SIZE);
+      chunkSize.Set(&max);
+      chunkSize.Div(&grp);
+      chunkSize.AddOne();
+      chunkSize.Mult((uint64_t)CPU_GRP_SIZE);
+    }
+
+  }
+
+  Int n(&size);
+  Int r;
+  n.Div(&chunkSize, &r);
+  nbChunk = n.bits64[0] + (r.IsZero() ? 0 : 1);
+
+  printf("Range chunks: %.0f x 2^%.2f keys\n", (double)nbChunk, log2(chunkSize.ToDouble()));
+
+}
+
+void VanitySearch::endPiece(TH_PARAM *p) {
+
+  // Range lock held, the chunk is completed with its last piece
+  uint64_t c = (uint64_t)p->chunk;
+  p->chunk = -1;
+  endChunk(c);
+
+}
+
+void VanitySearch::endChunk(uint64_t c) {
+
+  // Range lock held, one piece of the chunk is completed
+  auto it = chunkPieces.find(c);
+  if (it == chunkPieces.end())
+    return;  // Revoked by the coordinator
+  if (--it->second == 0) {
+    chunkPieces.erase(it);
+    chunkDone.add(c);
+    nbChunkDone++;
+    if (linked)
+      completedChunks.push_back(c);
+  }
+
+}
+
+uint64_t VanitySearch::nextChunk() {
+
+  // Range lock held, next chunk to search, nbChunk when all are pulled
+  if (chunkCursor.load() >= nbChunk)
+    return nbChunk;
+  if (!rangeRandom)
+    return chunkCursor.fetch_add(1);
+
+  // A few random draws, then the next free chunk from the last draw
+  uint64_t c = 0;
+  for (int i = 0; i < RANGE_RANDOM_DRAW; i++) {
+    c = (((uint64_t)rndl() << 32) ^ (uint64_t)rndl()) % nbChunk;
+    if (!chunkTaken.has(c))
+      break;
+  }
+  while (chunkTaken.has(c)) {
+    c++;
+    if (c >= nbChunk || c < chunkTaken.base)
+      c = chunkTaken.base;
+  }
+
+  chunkTaken.add(c);
+  chunkCursor++;
+  return c;
+
+}
+
+void VanitySearch::getChunk(uint64_t c, Int &s, Int &e) {
+
+  Int off(&chunkSize);
+  off.Mult(c);
+  s.Set(&chunkStart);
+  s.Add(&off);
+  e.Set(&s);
+  e.Add(&chunkSize);
+  e.SubOne();
+  if (e.IsGreater(&chunkEnd))
+    e.Set(&chunkEnd);
+
+}
+
+bool VanitySearch::stealPiece(TH_PARAM *ph) {
+
+  // Range lock held, takes the second half of the largest piece left,
+  // or the whole piece of a stopped slot
+  TH_PARAM *victim = NULL;
+  Int maxLeft;
+  maxLeft.SetInt32(0);
+
+  for (int i = 0; i < nbCPUSlot; i++) {
+    TH_PARAM *p = slots + i;
+    if (p == ph || p->chunk < 0)
+      continue;
+    if (p->resumeKey.IsGreater(&p->rangeEnd)) {
+      if (!p->working)
+        endPiece(p);
+      continue;
+    }
+    Int left(&p->rangeEnd);
+    left.Sub(&p->resumeKey);
+    left.AddOne();
+    if (!p->working) {
+      ph->resumeKey.Set(&p->resumeKey);
+      ph->rangeEnd.Set(&p->rangeEnd);
+      ph->chunk = p->chunk;
+      p->chunk = -1;
+      return true;
+    }
+    if (left.IsGreater(&maxLeft)) {
+      maxLeft.Set(&left);
+      victim = p;
+    }
+  }
+
+  Int minSteal((uint64_t)RANGE_MIN_STEAL);
+  if (victim == NULL || maxLeft.IsLower(&minSteal))
+    return false;
+
+  Int half(&maxLeft);
+  half.ShiftR(1);
+  ph->resumeKey.Set(&victim->rangeEnd);
+  ph->resumeKey.Sub(&half);
+  ph->resumeKey.AddOne();
+  ph->rangeEnd.Set(&victim->rangeEnd);
+  ph->chunk = victim->chunk;
+  victim->rangeEnd.Set(&ph->resumeKey);
+  victim->rangeEnd.SubOne();
+  chunkPieces[(uint64_t)ph->chunk]++;
+  return true;
+
+}
+
+bool VanitySearch::getRangeGroup(TH_PARAM *ph, Int &key, int &nbKey, bool &jump) {
+
+  // Next group of a CPU thread, from its piece, a new chunk or a stolen
+  // piece. False when no range key is left for the thread.
+  bool ok = true;
+  lockRange();
+
+  if (ph->chunk >= 0 && key.IsGreater(&ph->rangeEnd))
+    endPiece(ph);
+
+  if (ph->chunk < 0) {
+
+    uint64_t c = (freePieces.size() == 0) ? nextChunk() : nbChunk;
+    if (freePieces.size() > 0) {
+      // Left by a resumed search
+      ph->resumeKey.Set(&freePieces.back().start);
+      ph->rangeEnd.Set(&freePieces.back().end);
+      ph->chunk = (int64_t)freePieces.back().chunk;
+      freePieces.pop_back();
+    } else if (c < nbChunk) {
+      getChunk(c, ph->resumeKey, ph->rangeEnd);
+      ph->chunk = (int64_t)c;
+      chunkPieces[c] = 1;
+    } else {
+      ok = stealPiece(ph);
+    }
+    if (ok) {
+      key.Set(&ph->resumeKey);
+      jump = true;
+    }
+
+  }
+
+  if (ok) {
+    // Keys of the group in the piece, the last group is partial. Keys
+    // before resumeKey can no longer be stolen.
+    Int left(&ph->rangeEnd);
+    left.Sub(&key);
+    Int grpSize((uint64_t)CPU_GRP_SIZE);
+    nbKey = left.IsLower(&grpSize) ? (int)left.bits64[0] + 1 : CPU_GRP_SIZE;
+    ph->ckptKey.Set(&key);
+    ph->resumeKey.Set(&key);
+    ph->resumeKey.Add((uint64_t)nbKey);
+  }
+
+  unlockRange();
+  return ok;
+
+}
+
+void VanitySearch::getGPUStartingKeys(TH_PARAM *ph, int groupSize, int nbThread, Int *keys, Point *p, Int *ends) {
+
+  int thId = ph->threadId;
 
-  Int dy;
-  Int dyn;
-  Int _s;
-  Int _p;
-  Point pp;
-  Point pn;
-  grp->Set(dx);
+  if (rangePool) {
+    // A worker waits for the leases of a whole batch
+    while (linked && !link->ended && !endOfSearch) {
+      lockRange();
+      size_t nbFree = freePieces.size();
+      unlockRange();
+      if (nbFree >= (size_t)nbThread)
+        break;
+      Timer::SleepMillis(LINK_WAIT_MS);
+    }
+    // One chunk, or a piece left by a resumed search or leased, per GPU thread
+    lockRange();
+    ph->pieces.resize(nbThread);
+    for (int i = 0; i < nbThread; i++) {
+      CKPT_PIECE &pc = ph->pieces[i];
+      uint64_t c = (freePieces.size() == 0) ? nextChunk() : nbChunk;
+      if (freePieces.size() > 0) {
+        pc = freePieces.back();
+        freePieces.pop_back();
+      } else if (c < nbChunk) {
+        pc.chunk = c;
+        getChunk(c, pc.start, pc.end);
+        chunkPieces[c] = 1;
+      } else {
+        // Nothing left, the thread starts past its end
+        pc.chunk = nbChunk;
+        pc.start.Set(&rangeEnd);
+        pc.start.AddOne();
+        pc.end.Set(&rangeEnd);
+      }
+      keys[i].Set(&pc.start);
+      ends[i].Set(&pc.end);
+    }
+    ph->steps = 0;
+    unlockRange();
+  }
 
-  ph->hasStarted = true;
+  for (int i = 0; i < nbThread && !rangePool; i++) {
+    if (rangeMode) {
+      // Part of the GPU split over its threads
+      splitRange(ph->resumeKey, ph->rangeEnd, nbThread, i, keys[i], ends[i]);
+    } else if (rekey > 0) {
+      keys[i].Rand(256);
+    } else {
+      Int pk(&startKey);
+      Int offset;
+      offset.SetInt32(thId);
+      offset.ShiftL(64);
+      pk.Add(&offset);
+      offset.SetInt32(i);
+      offset.ShiftL(32);
+      pk.Add(&offset);
+      keys[i].Set(&pk);
+    }
+
+    // Kernel calls done before a checkpoint
+    if (rekey == 0 && ph->steps > 0) {
+      Int off((uint64_t)STEP_SIZE);
+      off.Mult(ph->steps.load());
+      keys[i].Add(&off);
+    }
+  }
+
+  // Starting points, center of the first group, with a single modular
+  // inversion for the whole grid
+  vector<Int> km(nbThread);
+  vector<Point> pts;
+  for (int i = 0; i < nbThread; i++) {
+    km[i].Set(keys + i);
+    km[i].Add((uint64_t)groupSize / 2);
+  }
+  secp->ComputePublicKeys(km, pts);
+  for (int i = 0; i < nbThread; i++) {
+    p[i] = pts[i];
+    if (startPubKeySpecified)
+      p[i] = secp->AddDirect(p[i], startPubKey);
+  }
+
+}
+
+void VanitySearch::endGPUPieces(TH_PARAM *ph) {
+
+  // GPU threads past the end of their piece, their chunks are completed
+  lockRange();
+  for (int i = 0; i < (int)ph->pieces.size(); i++)
+    if (ph->pieces[i].chunk < nbChunk)
+      endChunk(ph->pieces[i].chunk);
+  ph->pieces.clear();
+  unlockRange();
+
+}
+
+void VanitySearch::FindKeyGPU(TH_PARAM *ph) {
+
+  bool ok = true;
+
+#ifdef WITHGPU
+
+  // Global init
+  int thId = ph->threadId;
+
+  // Host thread on the node of its GPU, pinned buffers are node local
+  if (useNuma) {
+    int node = Numa::GetDeviceNode(GPUEngine::GetPCIBusId(ph->gpuId));
+    if (node < 0)
+      node = (thId - nbCPUSlot) % nbNumaNode;
+    enterNode(node, Numa::GetCpus(node));
+  }
+
+  GPUEngine g(ph->gridSizeX,ph->gridSizeY, ph->gpuId, maxFound, (rekey!=0));
+  int nbThread = g.GetNbThread();
+  if (linked)
+    gpuDemand += nbThread;
+  Point *p = new Point[nbThread];
+  Int *keys = new Int[nbThread];
+  Int *ends = rangeMode ? new Int[nbThread] : NULL;
+  int nbLeft = nbThread;    // GPU threads with range keys left
+  vector<ITEM> found;
+  vector<HARVEST_ITEM> hItems;
+  if (harvest != HARVEST_NONE)
+    harvestItems = &hItems;
+
+  printf("GPU: %s\n",g.deviceName.c_str());
+
+  tStats = stats + thId;
+
+  g.SetSearchMode(searchMode);
+  g.SetSearchType(searchType);
+  g.SetRangeStrict(rangeStrict);
+  if (onlyFull) {
+    g.SetPrefix(usedPrefixL,nbPrefix);
+  } else {
+    if(hasPattern)
+      g.SetPattern(inputPrefixes[0].c_str());
+    else
+      g.SetPrefix(usedPrefix);
+  }
+
+  getGPUStartingKeys(ph, g.GetGroupSize(), nbThread, keys, p, ends);
+  ok = g.SetKeys(p);
   ph->rekeyRequest = false;
+  if (rangeMode)
+    for (int i = 0; i < nbThread; i++)
+      if (keys[i].IsGreater(ends + i))
+        nbLeft--;
+  uint32_t gpuEpoch = 0;
+
+  ph->hasStarted = true;
+  notify(EVENT_STARTED);
 
-  while (!endOfSearch) {
+  // GPU Thread
+  while (ok && !endOfSearch && nbLeft > 0) {
 
     if (ph->rekeyRequest) {
-      getCPUStartingKey(thId, key, startP);
+      getGPUStartingKeys(ph, g.GetGroupSize(), nbThread, keys, p, ends);
+      ok = g.SetKeys(p);
       ph->rekeyRequest = false;
+      addStat(tStats->rekeys, 1);
+    }
+
+    // Found items removed from the lookup, upload the new tables
+    PREFIX_LOOKUP *l = enterLookup(thId);
+    if (l && l->epoch != gpuEpoch) {
+      if (onlyFull)
+        g.SetPrefix(l->usedPrefixL, l->nbItem);
+      else
+        g.SetPrefix(l->usedPrefix);
+      gpuEpoch = l->epoch;
+    }
+
+    // Call kernel
+    ok = g.Launch(found);
+
+    for(int i=0;i<(int)found.size() && !endOfSearch;i++) {
+
+      ITEM it = found[i];
+      if (rangeMode) {
+        // Threads go on past the end of their part, their hits are dropped
+        Int k(keys + it.thId);
+        k.Add((uint64_t)((it.incr < 0) ? -it.incr : it.incr));
+        if (k.IsGreater(ends + it.thId))
+          continue;
+      }
+      checkAddr(*(prefix_t *)(it.hash), it.hash, keys[it.thId], it.incr, it.endo, it.mode, searchType == P2SH, NULL);
+
+    }
+
+    if (harvestItems) {
+      harvestFlush(hItems);
+      hItems.clear();
+    }
+
+    if (ok) {
+      if (rangeMode) {
+        // Range keys covered by this call
+        uint64_t nbKey = 0;
+        Int step((uint64_t)STEP_SIZE);
+        for (int i = 0; i < nbThread; i++) {
+          if (keys[i].IsGreater(ends + i))
+            continue;
+          Int left(ends + i);
+          left.Sub(keys + i);
+          if (left.IsLower(&step)) {
+            nbKey += left.bits64[0] + 1;
+            nbLeft--;
+          } else {
+            nbKey += STEP_SIZE;
+          }
+        }
+        addStat(tStats->keys, rangeStrict ? nbKey : 6ULL * nbKey);
+        addStat(tStats->rangeKeys, nbKey);
+      } else {
+        addStat(tStats->keys, 6ULL * STEP_SIZE * nbThread); // Point +  endo1 + endo2 + symetrics
+      }
+      for (int i = 0; i < nbThread; i++) {
+        keys[i].Add((uint64_t)STEP_SIZE);
+      }
+      ph->steps++;
+      addStat(tStats->groups, 1);
+    }
+
+    if (ok && rangePool && nbLeft == 0) {
+      // Next random chunks
+      endGPUPieces(ph);
+      getGPUStartingKeys(ph, g.GetGroupSize(), nbThread, keys, p, ends);
+      ok = g.SetKeys(p);
+      for (int i = 0; i < nbThread; i++)
+        if (!keys[i].IsGreater(ends + i))
+          nbLeft++;
+    }
+
+  }
+
+  if (rangeMode && nbLeft == 0) {
+    if (rangePool)
+      endGPUPieces(ph);
+    ph->done = true;
+  }
+
+  delete[] keys;
+  delete[] ends;
+  delete[] p;
+  tStats->epoch = 0xFFFFFFFF;
+  tStats = NULL;
+  tNode = NULL;
+
+#else
+  ph->hasStarted = true;
+  printf("GPU code not compiled, use -DWITHGPU when compiling.\n");
+#endif
+
+  ph->isRunning = false;
+  notify(EVENT_STOPPED);
+
+}
+
+// ----------------------------------------------------------------------------
+
+#ifndef WIN64
+void VanitySearch::SignalWatch() {
+
+  // The supervisor cannot be woken from the signal handler itself
+  while (true) {
+    while (sem_wait(&threadSignal) != 0 && errno == EINTR);
+    if (watchStop)
+      break;
+    notify(EVENT_RESIZE);
+  }
+
+}
+#endif
+
+void VanitySearch::Interrupt() {
+
+  // The supervisor stops the threads and saves the checkpoint. The workers
+  // of a coordinator are not told the end of the job.
+  interrupted = true;
+  if (coordinator == NULL)
+    endOfSearch = true;
+  notify(EVENT_INTERRUPT);
+
+}
+
+void VanitySearch::notify(uint32_t event) {
+
+#ifdef WIN64
+  EnterCriticalSection(&eventLock);
+  events |= event;
+  WakeConditionVariable(&eventCond);
+  LeaveCriticalSection(&eventLock);
+#else
+  pthread_mutex_lock(&eventLock);
+  events |= event;
+  pthread_cond_signal(&eventCond);
+  pthread_mutex_unlock(&eventLock);
+#endif
+
+}
+
+// Waits for an event or for the timeout (ms), returns and clears the pending events
+uint32_t VanitySearch::waitEvent(uint32_t timeout) {
+
+  uint32_t ev;
+
+#ifdef WIN64
+  EnterCriticalSection(&eventLock);
+  if (events == 0)
+    SleepConditionVariableCS(&eventCond, &eventLock, timeout);
+  ev = events;
+  events = 0;
+  LeaveCriticalSection(&eventLock);
+#else
+  pthread_mutex_lock(&eventLock);
+  if (events == 0) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout / 1000;
+    ts.tv_nsec += (long)(timeout % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&eventCond, &eventLock, &ts);
+  }
+  ev = events;
+  events = 0;
+  pthread_mutex_unlock(&eventLock);
+#endif
+
+  return ev;
+
+}
+
+// ----------------------------------------------------------------------------
+
+bool VanitySearch::isAlive(TH_PARAM *p) {
+
+  bool isAlive = true;
+  int total = nbCPUSlot + nbGPUThread;
+  for(int i=0;i<total;i++)
+    if (p[i].launched && !p[i].stopRequest && !p[i].done)
+      isAlive = isAlive && p[i].isRunning;
+
+  if (isAlive && linked) {
+    // Until the end of the job, and of the pieces still held
+    bool left = !link->ended;
+    for (int i = 0; i < total; i++)
+      left = left || (p[i].launched && !p[i].stopRequest && !p[i].done);
+    isAlive = left;
+  } else if (isAlive && rangeMode) {
+    // Until all parts of the range are searched
+    bool left = nbChunkDone < nbChunk;
+    for (int i = 0; i < nbGPUThread; i++)
+      left = left || !p[nbCPUSlot + i].done;
+    isAlive = left;
+  }
+
+  return isAlive;
+
+}
+
+// ----------------------------------------------------------------------------
+
+bool VanitySearch::hasStarted(TH_PARAM *p) {
+
+  bool hasStarted = true;
+  int total = nbCPUSlot + nbGPUThread;
+  for (int i = 0; i < total; i++)
+    if (p[i].launched)
+      hasStarted = hasStarted && p[i].hasStarted;
+
+  return hasStarted;
+
+}
+
+// ----------------------------------------------------------------------------
+
+void VanitySearch::rekeyRequest(TH_PARAM *p) {
+
+  int total = nbCPUSlot + nbGPUThread;
+  for (int i = 0; i < total; i++)
+    p[i].rekeyRequest = true;
+
+}
+
+// ----------------------------------------------------------------------------
+
+void VanitySearch::launchCPUThread(TH_PARAM *p) {
+
+  // Protects the published lookup until the thread enters it
+  stats[p->threadId].epoch = 0;
+  p->isRunning = true;
+  p->hasStarted = false;
+  p->stopRequest = false;
+  p->launched = true;
+  workers[p->threadId] = launchThread(_FindKey, (void*)p);
+  nbCPUThread++;
+
+}
+
+void VanitySearch::resizeCPUThreads(TH_PARAM *p, int nbThread) {
+
+  // At least one search thread
+  int min = (nbGPUThread > 0) ? 0 : 1;
+  if (nbThread < min) nbThread = min;
+  if (nbThread > nbCPUSlot) nbThread = nbCPUSlot;
+  if (nbThread == nbCPUTarget)
+    return;
+
+  nbCPUTarget = nbThread;
+  balanceCPUThreads(p);
+  printf("\nNumber of CPU thread: %d\n", nbCPUThread);
+
+}
+
+void VanitySearch::balanceCPUThreads(TH_PARAM *p) {
+
+  // Threads which have searched their part of the range
+  for (int i = 0; i < nbCPUSlot; i++) {
+    if (p[i].launched && p[i].done && !p[i].isRunning) {
+      joinThread(workers[i]);
+      p[i].launched = false;
+      nbCPUThread--;
+    }
+  }
+
+  if (rangeMode) {
+    // Pieces of stopped threads are searched again by finished slots
+    bool left = false;
+    lockRange();
+    for (int i = 0; i < nbCPUSlot; i++)
+      left = left || (!p[i].launched && p[i].chunk >= 0);
+    unlockRange();
+    for (int i = 0; i < nbCPUSlot && left; i++)
+      if (!p[i].launched)
+        p[i].done = false;
+  }
+
+  // Free slots are reused first, their keys continue where they stopped
+  for (int i = 0; i < nbCPUSlot && nbCPUThread < nbCPUTarget; i++)
+    if (!p[i].launched && !p[i].done)
+      launchCPUThread(p + i);
+
+  for (int i = nbCPUSlot - 1; i >= 0 && nbCPUThread > nbCPUTarget; i--) {
+    if (p[i].launched) {
+      p[i].stopRequest = true;
+      joinThread(workers[i]);
+      p[i].launched = false;
+      nbCPUThread--;
+    }
+  }
+
+}
+
+int VanitySearch::readControlFile() {
+
+  // -1 if missing or invalid
+  int nb = -1;
+  FILE *f = fopen(ctlFile.c_str(), "r");
+  if (f) {
+    if (fscanf(f, "%d", &nb) != 1)
+      nb = -1;
+    fclose(f);
+  }
+  return nb;
+
+}
+
+// ----------------------------------------------------------------------------
+
+uint64_t VanitySearch::getGPUCount() {
+
+  uint64_t count = 0;
+  for(int i=0;i<nbGPUThread;i++)
+    count += stats[nbCPUSlot + i].keys.load(std::memory_order_relaxed);
+  return count;
+
+}
+
+uint64_t VanitySearch::getCPUCount() {
+
+  uint64_t count = 0;
+  for(int i=0;i<nbCPUSlot;i++)
+    count += stats[i].keys.load(std::memory_order_relaxed);
+  return count;
+
+}
+
+// ----------------------------------------------------------------------------
+
+void VanitySearch::fillCheckpoint(Checkpoint &c) {
+
+  // Search parameters
+  vector<string> t(inputPrefixes);
+  sort(t.begin(), t.end());
+  string all;
+  for (int i = 0; i < (int)t.size(); i++)
+    all += t[i] + "\n";
+  uint8_t digest[32];
+  sha256((uint8_t *)all.c_str(), (int)all.length(), digest);
+  vector<unsigned char> d(digest, digest + 32);
+
+  c.nbTarget = (int)inputPrefixes.size();
+  c.targets = GetHex(d);
+  c.searchMode = searchMode;
+  c.searchType = searchType;
+  c.caseSensitive = caseSensitive;
+  c.stop = stopWhenFound;
+  if (startPubKeySpecified)
+    c.startPubKey = startPubKey.x.GetBase16() + ":" + startPubKey.y.GetBase16();
+  if (rangeMode) {
+    c.range = rangeStart.GetBase16() + ":" + rangeEnd.GetBase16();
+    // Chunks of the CPU part, the GPU parts depend on the same split
+    c.range += "/" + chunkStart.GetBase16() + ":" + chunkEnd.GetBase16() + ":" + to_string(nbChunk);
+  }
+  c.rangeStrict = rangeStrict;
+  c.rangeRandom = rangeRandom;
+  c.rekey = rekey;
+  c.gpu = gpuDesc;
+
+}
+
+void VanitySearch::saveCheckpoint(TH_PARAM *p) {
+
+  Checkpoint c;
+  fillCheckpoint(c);
+  c.baseKey.Set(&startKey);
+
+  // Positions, the search threads are only held for the copy
+  lockRange();
+  for (int i = 0; i < nbCPUSlot && !rangeMode; i++) {
+    if (p[i].launched && p[i].hasStarted) {
+      c.cpuSlots.push_back(i);
+      c.cpuKeys.push_back(p[i].ckptKey);
+    } else if (p[i].hasResume) {
+      c.cpuSlots.push_back(i);
+      c.cpuKeys.push_back(p[i].resumeKey);
     }
+  }
+  if (rangeMode && nbChunk > 0) {
+    c.chunkSize.Set(&chunkSize);
+    c.nbChunk = nbChunk;
+    c.chunkCursor = (chunkCursor < nbChunk) ? chunkCursor.load() : nbChunk;
+    c.chunkDone = chunkDone;
+    getPieces(p, c.pieces);
+    // Chunks in progress without any piece left are completed
+    unordered_set<uint64_t> left;
+    for (int i = 0; i < (int)c.pieces.size(); i++)
+      left.insert(c.pieces[i].chunk);
+    for (auto it = chunkPieces.begin(); it != chunkPieces.end(); it++)
+      if (left.find(it->first) == left.end())
+        c.chunkDone.add(it->first);
+  }
+  unlockRange();
+  for (int i = 0; i < nbGPUThread; i++)
+    c.gpuSteps.push_back(p[nbCPUSlot + i].steps);
+
+  for (int i = 0; i < nbCPUSlot + nbGPUThread; i++) {
+    c.keys += stats[i].keys.load(std::memory_order_relaxed);
+    c.rangeKeys += stats[i].rangeKeys.load(std::memory_order_relaxed);
+  }
+  if (p == NULL)
+    c.keys = stats[0].keys;  // Coordinator, keys of its workers
+
+  // Hits of the saved positions are verified and written first
+  waitVerifier();
+  writer->flush(true);
+
+  c.nbFoundKey = nbFoundKey;
+  for (int i = 0; i < (int)inputPrefixes.size(); i++) {
+    bool found = (hasPattern || pubKeySearch) ? patternFound[i] : (inputFound[i] && inputFound[i]->load());
+    if (found)
+      c.found.push_back(inputPrefixes[i]);
+  }
 
-    // Fill group
-    int i;
-    int hLength = (CPU_GRP_SIZE / 2 - 1);
+  c.Save(ckptFile);
+
+}
+
+void VanitySearch::getPieces(TH_PARAM *p, vector<CKPT_PIECE> &pieces) {
+
+  // Range lock held, parts of the range left in the chunks in progress:
+  // not started, held by the CPU threads and the GPU threads, leased
+  pieces.insert(pieces.end(), freePieces.begin(), freePieces.end());
+  for (int i = 0; i < nbCPUSlot; i++) {
+    if (p[i].chunk >= 0 && !p[i].ckptKey.IsGreater(&p[i].rangeEnd)) {
+      CKPT_PIECE pc;
+      pc.chunk = (uint64_t)p[i].chunk;
+      pc.start.Set(&p[i].ckptKey);
+      pc.end.Set(&p[i].rangeEnd);
+      pieces.push_back(pc);
+    }
+  }
+  for (int i = 0; i < nbGPUThread; i++) {
+    TH_PARAM *g = p + (nbCPUSlot + i);
+    Int off((uint64_t)STEP_SIZE);
+    off.Mult(g->steps.load());
+    for (int j = 0; j < (int)g->pieces.size(); j++) {
+      CKPT_PIECE pc = g->pieces[j];
+      pc.start.Add(&off);
+      if (pc.chunk < nbChunk && !pc.start.IsGreater(&pc.end))
+        pieces.push_back(pc);
+    }
+  }
+  if (coordinator != NULL)
+    coordinator->GetLeasedPieces(pieces);
 
-    for (i = 0; i < hLength; i++) {
-      dx[i].ModSub(&Gn[i].x, &startP.x);
-    }
-    dx[i].ModSub(&Gn[i].x, &startP.x);  // For the first point
-    dx[i+1].ModSub(&_2Gn.x, &startP.x); // For the next center point
+}
 
-    // Grouped ModInv
-    grp->ModInv();
+void VanitySearch::waitVerifier() {
 
-    // We use the fact that P + i*G and P - i*G has the same deltax, so the same inverse
-    // We compute key in the positive and negative way from the center of the group
+  // Hits pushed so far are verified and given to the writer
+  if (hitQueue == NULL)
+    return;
+  uint64_t nbPushed = hitQueue->getPushed();
+  while (nbVerifiedHit < nbPushed)
+    Timer::SleepMillis(1);
 
-    // center point
-    pts[CPU_GRP_SIZE/2] = startP;
+}
 
-    for (i = 0; i<hLength && !endOfSearch; i++) {
+void VanitySearch::restoreCheckpoint(TH_PARAM *p) {
 
-      pp = startP;
-      pn = startP;
+  Checkpoint c;
+  if (!c.Load(ckptFile)) {
+    printf("Error: cannot read checkpoint %s\n", ckptFile.c_str());
+    exit(-1);
+  }
 
-      // P = startP + i*G
-      dy.ModSub(&Gn[i].y,&pp.y);
+  Checkpoint cur;
+  fillCheckpoint(cur);
+  string diff = cur.Compare(c);
+  if (diff.length() > 0) {
+    printf("Error: checkpoint %s is not from this search, different %s\n", ckptFile.c_str(), diff.c_str());
+    exit(-1);
+  }
 
-      _s.ModMulK1(&dy, &dx[i]);       // s = (p2.y-p1.y)*inverse(p2.x-p1.x);
-      _p.ModSquareK1(&_s);            // _p = pow2(s)
+  startKey.Set(&c.baseKey);
+  stats[0].keys = c.keys;
+  stats[0].rangeKeys = c.rangeKeys;
 
-      pp.x.ModNeg();
-      pp.x.ModAdd(&_p);
-      pp.x.ModSub(&Gn[i].x);           // rx = pow2(s) - p1.x - p2.x;
+  // Found targets
+  for (int i = 0; i < (int)inputPrefixes.size(); i++) {
+    if (find(c.found.begin(), c.found.end(), inputPrefixes[i]) != c.found.end())
+      setTargetFound(i);
+  }
+  nbFoundKey = c.nbFoundKey;
+  updateFound();
+
+  // Positions
+  if (!rangeMode && rekey == 0) {
+    for (int i = 0; i < (int)c.cpuKeys.size(); i++) {
+      if (c.cpuSlots[i] < nbCPUSlot) {
+        p[c.cpuSlots[i]].resumeKey.Set(&c.cpuKeys[i]);
+        p[c.cpuSlots[i]].hasResume = true;
+      }
+    }
+  }
+  for (int i = 0; i < nbGPUThread && i < (int)c.gpuSteps.size() && !rangePool; i++)
+    p[nbCPUSlot + i].steps = c.gpuSteps[i];
+
+  if (rangeMode && nbChunk > 0) {
+    chunkCursor = c.chunkCursor;
+    chunkDone = c.chunkDone;
+    freePieces = c.pieces;
+    for (int i = 0; i < (int)freePieces.size(); i++)
+      chunkPieces[freePieces[i].chunk]++;
+    if (rangeRandom) {
+      // Chunks pulled are the completed ones and the ones with pieces left
+      chunkTaken = chunkDone;
+      for (auto it = chunkPieces.begin(); it != chunkPieces.end(); it++)
+        chunkTaken.add(it->first);
+      chunkCursor = chunkTaken.size();
+    } else {
+      // Chunks pulled without any piece left are completed
+      for (uint64_t i = chunkDone.base; i < c.chunkCursor; i++)
+        if (chunkPieces.find(i) == chunkPieces.end())
+          chunkDone.add(i);
+    }
+    nbChunkDone = chunkDone.size();
+  }
 
-      pp.y.ModSub(&Gn[i].x, &pp.x);
-      pp.y.ModMulK1(&_s);
-      pp.y.ModSub(&Gn[i].y);           // ry = - p2.y - s*(ret.x-p2.x);
+  printf("Resumed from %s: 2^%.2f keys, %d found\n", ckptFile.c_str(), log2((double)c.keys + 1.0), nbFoundKey.load());
 
-      // P = startP - i*G  , if (x,y) = i*G then (x,-y) = -i*G
-      dyn.Set(&Gn[i].y);
-      dyn.ModNeg();
-      dyn.ModSub(&pn.y);
+}
 
-      _s.ModMulK1(&dyn, &dx[i]);      // s = (p2.y-p1.y)*inverse(p2.x-p1.x);
-      _p.ModSquareK1(&_s);            // _p = pow2(s)
+// ----------------------------------------------------------------------------
 
-      pn.x.ModNeg();
-      pn.x.ModAdd(&_p);
-      pn.x.ModSub(&Gn[i].x);          // rx = pow2(s) - p1.x - p2.x;
+string VanitySearch::getJobId() {
 
-      pn.y.ModSub(&Gn[i].x, &pn.x);
-      pn.y.ModMulK1(&_s);
-      pn.y.ModAdd(&Gn[i].y);          // ry = - p2.y - s*(ret.x-p2.x);
+  // Targets and search options shared by the coordinator and its workers
+  Checkpoint c;
+  fillCheckpoint(c);
+  char tmp[64];
+  sprintf(tmp, ":%d:%d:%d:%d:", c.searchMode, c.searchType, c.caseSensitive, rangeStrict);
+  return to_string(c.nbTarget) + ":" + c.targets + string(tmp) + c.startPubKey;
 
-      pts[CPU_GRP_SIZE/2 + (i+1)] = pp;
-      pts[CPU_GRP_SIZE/2 - (i+1)] = pn;
+}
 
-    }
+bool VanitySearch::getJob(Int &start, Int &end, Int &size, uint64_t &nb) {
 
-    // First point (startP - (GRP_SZIE/2)*G)
-    pn = startP;
-    dyn.Set(&Gn[i].y);
-    dyn.ModNeg();
-    dyn.ModSub(&pn.y);
+  // Range and chunks of the command line (-rg), false without range
+  if (!rangeMode)
+    return false;
+  start.Set(&rangeStart);
+  end.Set(&rangeEnd);
+  size.Set(&chunkSize);
+  nb = nbChunk;
+  return true;
 
-    _s.ModMulK1(&dyn, &dx[i]);
-    _p.ModSquareK1(&_s);
+}
 
-    pn.x.ModNeg();
-    pn.x.ModAdd(&_p);
-    pn.x.ModSub(&Gn[i].x);
+bool VanitySearch::setJob(Int &start, Int &end, Int &size, uint64_t nb, string worker, string source) {
+
+  // Range of the coordinator or of the job directory, unless given by -rg
+  if (!rangeMode) {
+    rangeStart.Set(&start);
+    rangeEnd.Set(&end);
+    rangeSize.Set(&rangeEnd);
+    rangeSize.Sub(&rangeStart);
+    rangeSize.AddOne();
+    rangeMode = true;
+    chunkReq.Set(&size);
+    initChunks(rangeStart, rangeEnd);
+  }
+  printf("Worker %s of %s, range %s:%s (2^%.2f keys)%s\n", worker.c_str(), source.c_str(),
+    rangeStart.GetBase16().c_str(), rangeEnd.GetBase16().c_str(), log2(rangeSize.ToDouble()), rangeStrict ? " strict" : "");
 
-    pn.y.ModSub(&Gn[i].x, &pn.x);
-    pn.y.ModMulK1(&_s);
-    pn.y.ModAdd(&Gn[i].y);
+  // Same chunks on all sides, all of them leased or claimed
+  if (!size.IsEqual(&chunkSize) || nb != nbChunk) {
+    printf("Error: chunks of %s differ from the local ones\n", source.c_str());
+    return false;
+  }
+  chunkCursor = nbChunk;
+  return true;
 
-    pts[0] = pn;
+}
 
-    // Next start point (startP + GRP_SIZE*G)
-    pp = startP;
-    dy.ModSub(&_2Gn.y, &pp.y);
+void VanitySearch::endSearch() {
 
-    _s.ModMulK1(&dy, &dx[i+1]);
-    _p.ModSquareK1(&_s);
+  endOfSearch = true;
 
-    pp.x.ModNeg();
-    pp.x.ModAdd(&_p);
-    pp.x.ModSub(&_2Gn.x);
+}
 
-    pp.y.ModSub(&_2Gn.x, &pp.x);
-    pp.y.ModMulK1(&_s);
-    pp.y.ModSub(&_2Gn.y);
-    startP = pp;
+bool VanitySearch::takePieces(vector<CKPT_PIECE> &pieces) {
 
-#if 0
-    // Check
-    {
-      bool wrong = false;
-      Point p0 = secp.ComputePublicKey(&key);
-      for (int i = 0; i < CPU_GRP_SIZE; i++) {
-        if (!p0.equals(pts[i])) {
-          wrong = true;
-          printf("[%d] wrong point\n",i);
-        }
-        p0 = secp.NextKey(p0);
+  // Range lock held, the free pieces of one chunk (whole chunks stay with
+  // one worker) or a new chunk, false when none is left
+  if (freePieces.size() > 0) {
+    uint64_t c = freePieces.back().chunk;
+    for (int j = (int)freePieces.size() - 1; j >= 0; j--) {
+      if (freePieces[j].chunk == c) {
+        pieces.push_back(freePieces[j]);
+        freePieces.erase(freePieces.begin() + j);
       }
-      if(wrong) exit(0);
     }
-#endif
+    return true;
+  }
+  CKPT_PIECE pc;
+  pc.chunk = nextChunk();
+  if (pc.chunk >= nbChunk)
+    return false;
+  getChunk(pc.chunk, pc.start, pc.end);
+  pieces.push_back(pc);
+  return true;
 
-    // Check addresses
-    if (useSSE) {
+}
 
-      for (int i = 0; i < CPU_GRP_SIZE && !endOfSearch; i += 4) {
+void VanitySearch::releasePieces(vector<CKPT_PIECE> &pieces) {
 
-        switch (searchMode) {
-          case SEARCH_COMPRESSED:
-            checkAddressesSSE(true, key, i, pts[i], pts[i + 1], pts[i + 2], pts[i + 3]);
-            break;
-          case SEARCH_UNCOMPRESSED:
-            checkAddressesSSE(false, key, i, pts[i], pts[i + 1], pts[i + 2], pts[i + 3]);
-            break;
-          case SEARCH_BOTH:
-            checkAddressesSSE(true, key, i, pts[i], pts[i + 1], pts[i + 2], pts[i + 3]);
-            checkAddressesSSE(false, key, i, pts[i], pts[i + 1], pts[i + 2], pts[i + 3]);
-            break;
-        }
+  // Range lock held
+  freePieces.insert(freePieces.end(), pieces.begin(), pieces.end());
 
-      }
+}
 
-    } else {
+void VanitySearch::dropPieces(uint64_t c) {
 
-      for (int i = 0; i < CPU_GRP_SIZE && !endOfSearch; i ++) {
+  // Range lock held
+  for (int j = (int)freePieces.size() - 1; j >= 0; j--)
+    if (freePieces[j].chunk == c)
+      freePieces.erase(freePieces.begin() + j);
 
-        switch (searchMode) {
-        case SEARCH_COMPRESSED:
-          checkAddresses(true, key, i, pts[i]);
-          break;
-        case SEARCH_UNCOMPRESSED:
-          checkAddresses(false, key, i, pts[i]);
-          break;
-        case SEARCH_BOTH:
-          checkAddresses(true, key, i, pts[i]);
-          checkAddresses(false, key, i, pts[i]);
-          break;
-        }
+}
 
-      }
+bool VanitySearch::completeChunk(uint64_t c) {
 
-    }
+  // Range lock held, false if already completed
+  if (c >= nbChunk || !chunkDone.add(c))
+    return false;
+  nbChunkDone++;
+  dropPieces(c);
+  return true;
 
-    key.Add((uint64_t)CPU_GRP_SIZE);
-    counters[thId]+= 6*CPU_GRP_SIZE; // Point + endo #1 + endo #2 + Symetric point + endo #1 + endo #2
+}
 
-  }
+bool VanitySearch::isJobDone() {
 
-  ph->isRunning = false;
+  // All chunks done, or all targets found with -stop
+  return nbChunkDone >= nbChunk || endOfSearch;
 
 }
 
-// ----------------------------------------------------------------------------
+void VanitySearch::getJobProgress(uint64_t &nbDone, uint64_t &nb) {
 
-void VanitySearch::getGPUStartingKeys(int thId, int groupSize, int nbThread, Int *keys, Point *p) {
+  nbDone = nbChunkDone;
+  nb = nbChunk;
 
-  for (int i = 0; i < nbThread; i++) {
-    if (rekey > 0) {
-      keys[i].Rand(256);
-    } else {
-      Int pk(&startKey);
-      Int offset;
-      offset.SetInt32(thId);
-      offset.ShiftL(64);
-      pk.Add(&offset);
-      offset.SetInt32(i);
-      offset.ShiftL(32);
-      pk.Add(&offset);
-      keys[i].Set(&pk);
-    }
+}
 
-    // Apply range limits if specified
-    if (rangeStart > 0 || rangeEnd > 0) {
-      Int rangeWidth;
-      rangeWidth.Set(&secp->order);
-      
-      if (rangeEnd > 0) {
-        Int end;
-        end.SetInt32((uint32_t)rangeEnd);
-        rangeWidth.Set(&end);
-      }
-      
-      if (rangeStart > 0) {
-        Int start;
-        start.SetInt32((uint32_t)rangeStart);
-        if (rangeEnd > 0)
-          rangeWidth.Sub(&start);
-        keys[i].Set(&start);
-      } else {
-        keys[i].SetInt32(0);
-      }
-      
-      // Calculate thread offset within range
-      Int offset;
-      offset.SetInt32(thId * nbThread + i);
-      offset.Mult(keysPerThread);
-      keys[i].Add(&offset);
-      
-      // Make sure key is within range
-      if (!keys[i].IsLowerOrEqual(&rangeWidth)) {
-        keys[i].Set(&rangeWidth);
-      }
+bool VanitySearch::checkResult(int type, string &addr, string &hex, string &wif) {
+
+  // Result of a worker, the address is computed again from the private key
+  if (type < P2PKH || type > P2TR || hex.length() == 0 || hex.length() > 64 ||
+      hex.find_first_not_of("0123456789abcdefABCDEF") != string::npos)
+    return false;
+  Int k;
+  k.SetBase16((char *)hex.c_str());
+  if (k.IsZero() || !k.IsLower(&secp->order))
+    return false;
+  Point p = secp->ComputePublicKey(&k);
+
+  // With a start public key, the symmetry and endomorphism of the hit are not known
+  bool ok = false;
+  bool mode = true;
+  for (int i = 0; i < (startPubKeySpecified ? 6 : 1) && !ok; i++) {
+    Point q = p;
+    if (startPubKeySpecified) {
+      Point sp = startPubKey;
+      if (i / 2 == 1) sp.x.ModMulK1(&beta);
+      if (i / 2 == 2) sp.x.ModMulK1(&beta2);
+      if (i % 2 == 1) sp.y.ModNeg();
+      q = secp->AddDirect(q, sp);
     }
+    for (int m = 0; m < 2 && !ok; m++) {
+      mode = (m == 0);
+      ok = secp->GetAddress(type, mode, q) == addr;
+    }
+  }
+  if (!ok)
+    return false;
+  wif = secp->GetPrivAddress(mode, k);
 
-    // Compute starting point
-    Int k(keys + i);
-    // Add the starting offset to the key
-    k.Add((uint64_t)groupSize / 2);
-    p[i] = secp->ComputePublicKey(&k);
-    if (startPubKeySpecified)
-      p[i] = secp->AddDirect(p[i], startPubKey);
+  // Targets of the job only
+  bool target = false;
+  for (int i = 0; i < (int)inputPrefixes.size(); i++) {
+    bool match;
+    if (hasPattern)
+      match = Wildcard::match(addr.c_str(), inputPrefixes[i].c_str(), caseSensitive);
+    else if (caseSensitive && !pubKeySearch)
+      match = addr.compare(0, inputPrefixes[i].length(), inputPrefixes[i]) == 0;
+    else
+      match = prefixMatch((char *)inputPrefixes[i].c_str(), (char *)addr.c_str());
+    if (match) {
+      setTargetFound(i);
+      target = true;
+    }
   }
+  return target;
 
 }
 
-void VanitySearch::FindKeyGPU(TH_PARAM *ph) {
+void VanitySearch::addResult(int type, string &addr, string &wif, string &hex) {
 
-  bool ok = true;
+  writer->write(type, addr, wif, hex, startPubKeySpecified);
+  nbFoundKey++;
+  updateFound();
 
-#ifdef WITHGPU
+}
 
-  // Global init
-  int thId = ph->threadId;
-  GPUEngine g(ph->gridSizeX,ph->gridSizeY, ph->gpuId, maxFound, (rekey!=0));
-  int nbThread = g.GetNbThread();
-  Point *p = new Point[nbThread];
-  Int *keys = new Int[nbThread];
-  vector<ITEM> found;
+void VanitySearch::flushResults() {
 
-  printf("GPU: %s\n",g.deviceName.c_str());
+  writer->flush(true);
 
-  counters[thId] = 0;
+}
 
-  getGPUStartingKeys(thId, g.GetGroupSize(), nbThread, keys, p);
+void VanitySearch::Coordinate() {
 
-  g.SetSearchMode(searchMode);
-  g.SetSearchType(searchType);
-  if (onlyFull) {
-    g.SetPrefix(usedPrefixL,nbPrefix);
-  } else {
-    if(hasPattern)
-      g.SetPattern(inputPrefixes[0].c_str());
-    else
-      g.SetPrefix(usedPrefix);
-  }
+  coordinator = new Coordinator(this, coordAddr, leaseTimeout);
+  if (!coordinator->Listen())
+    exit(-1);
 
-  getGPUStartingKeys(thId, g.GetGroupSize(), nbThread, keys, p);
-  ok = g.SetKeys(p);
-  ph->rekeyRequest = false;
+  nbCPUSlot = 0;
+  nbGPUThread = 0;
+  nbFoundKey = 0;
+  stats = new THREAD_STATS[1];
+  stats[0].keys = 0;
+  stats[0].rangeKeys = 0;
+  initChunks(rangeStart, rangeEnd);
+  if (resume)
+    restoreCheckpoint(NULL);
+  uint64_t baseKeys = stats[0].keys;
 
-  ph->hasStarted = true;
+  coordinator->Start();
+  ResultWriter::setInterruptHandler(_Interrupt, (void *)this);
 
-  // GPU Thread
-  while (ok && !endOfSearch) {
+#ifndef WIN64
+  setvbuf(stdout, NULL, _IONBF, 0);
+#endif
 
-    if (ph->rekeyRequest) {
-      getGPUStartingKeys(thId, g.GetGroupSize(), nbThread, keys, p);
-      ok = g.SetKeys(p);
-      ph->rekeyRequest = false;
+  double nextCkpt = Timer::get_tick() + ckptInterval;
+  double endTime = 0.0;
+
+  while (true) {
+
+    Timer::SleepMillis(statsInterval);
+    double now = Timer::get_tick();
+
+    int nbWorker;
+    double keyRate;
+    uint64_t keys;
+    int nbLease;
+    lockRange();
+    coordinator->ExpireLeases(now);
+    coordinator->GetStats(nbWorker, keyRate, keys, nbLease);
+    bool jobDone = isJobDone();
+    unlockRange();
+    keys += baseKeys;
+    stats[0].keys = keys;
+
+    printf("\r[%.2f Mkey/s][Workers %d][Leases %d][Total 2^%.2f][Job %.2f%%][Found %d]  ",
+      keyRate / 1000000.0, nbWorker, nbLease, log2((double)keys + 1.0),
+      100.0 * (double)nbChunkDone / (double)nbChunk, nbFoundKey.load());
+
+    if (ckptFile.length() > 0 && now >= nextCkpt) {
+      saveCheckpoint(NULL);
+      nextCkpt = now + ckptInterval;
     }
 
-    // Call kernel
-    ok = g.Launch(found);
-
-    for(int i=0;i<(int)found.size() && !endOfSearch;i++) {
-
-      ITEM it = found[i];
-      checkAddr(*(prefix_t *)(it.hash), it.hash, keys[it.thId], it.incr, it.endo, it.mode);
-
-    }
+    if (interrupted)
+      break;
 
-    if (ok) {
-      for (int i = 0; i < nbThread; i++) {
-        keys[i].Add((uint64_t)STEP_SIZE);
-      }
-      counters[thId] += 6ULL * STEP_SIZE * nbThread; // Point +  endo1 + endo2 + symetrics
+    // Workers are told the end (all chunks done, or all targets found with -stop)
+    // at their next request or heartbeat
+    if (jobDone) {
+      if (endTime == 0.0)
+        endTime = now;
+      if (nbWorker == 0 || now - endTime > 5.0 * LINK_REPORT_MS / 1000.0)
+        break;
     }
 
   }
 
-  delete[] keys;
-  delete[] p;
-
-#else
-  ph->hasStarted = true;
-  printf("GPU code not compiled, use -DWITHGPU when compiling.\n");
-#endif
-
-  ph->isRunning = false;
+  printf(interrupted ? "\nInterrupted\n" : "\nJob completed\n");
+  if (ckptFile.length() > 0)
+    saveCheckpoint(NULL);
+  ResultWriter::setInterruptHandler(NULL, NULL);
+  writer->close();
+  coordinator->Close();
 
 }
 
 // ----------------------------------------------------------------------------
 
-bool VanitySearch::isAlive(TH_PARAM *p) {
-
-  bool isAlive = true;
-  int total = nbCPUThread + nbGPUThread;
-  for(int i=0;i<total;i++)
-    isAlive = isAlive && p[i].isRunning;
+void VanitySearch::addPieces(vector<CKPT_PIECE> &pieces) {
 
-  return isAlive;
+  // Leased or claimed, searched by the threads like the pieces of a resumed search
+  lockRange();
+  for (int i = 0; i < (int)pieces.size(); i++) {
+    chunkPieces[pieces[i].chunk]++;
+    freePieces.push_back(pieces[i]);
+  }
+  unlockRange();
 
 }
 
-// ----------------------------------------------------------------------------
+void VanitySearch::revokeChunk(uint64_t c) {
+
+  // Leased again to another worker, the pieces of the chunk are dropped.
+  // Pieces of the GPU threads go on until the end of their batch.
+  lockRange();
+  for (int i = (int)freePieces.size() - 1; i >= 0; i--)
+    if (freePieces[i].chunk == c)
+      freePieces.erase(freePieces.begin() + i);
+  for (int i = 0; i < nbCPUSlot; i++) {
+    if (slots[i].chunk == (int64_t)c) {
+      slots[i].chunk = -1;
+      slots[i].rangeEnd.Set(&slots[i].resumeKey);
+      slots[i].rangeEnd.SubOne();
+    }
+  }
+  for (int i = 0; i < nbGPUThread; i++) {
+    vector<CKPT_PIECE> &pieces = slots[nbCPUSlot + i].pieces;
+    for (int j = 0; j < (int)pieces.size(); j++)
+      if (pieces[j].chunk == c)
+        pieces[j].chunk = nbChunk;
+  }
+  chunkPieces.erase(c);
+  unlockRange();
 
-bool VanitySearch::hasStarted(TH_PARAM *p) {
+}
 
-  bool hasStarted = true;
-  int total = nbCPUThread + nbGPUThread;
-  for (int i = 0; i < total; i++)
-    hasStarted = hasStarted && p[i].hasStarted;
+uint32_t VanitySearch::getDemand(uint32_t &nbFree) {
 
-  return hasStarted;
+  // One chunk per idle CPU thread (the busy ones share their pieces), the
+  // pieces of a GPU batch, and a single chunk in advance
+  lockRange();
+  uint32_t demand = gpuDemand + 1;
+  for (int i = 0; i < nbCPUSlot; i++)
+    if (slots[i].launched && slots[i].isRunning && slots[i].chunk < 0)
+      demand++;
+  nbFree = (uint32_t)freePieces.size();
+  unlockRange();
+  return demand;
 
 }
 
-// ----------------------------------------------------------------------------
+void VanitySearch::getLinkReport(vector<CKPT_PIECE> &pieces, vector<uint64_t> &completed, vector<string> &found) {
 
-void VanitySearch::rekeyRequest(TH_PARAM *p) {
+  // Positions first, their hits are then verified and reported before them
+  lockRange();
+  getPieces(slots, pieces);
+  completed.swap(completedChunks);
+  unlockRange();
+  waitVerifier();
+  lockRange();
+  found.swap(linkFound);
+  unlockRange();
 
-  bool hasStarted = true;
-  int total = nbCPUThread + nbGPUThread;
-  for (int i = 0; i < total; i++)
-  p[i].rekeyRequest = true;
+}
+
+uint64_t VanitySearch::getKeyCount() {
+
+  return getCPUCount() + getGPUCount();
 
 }
 
-// ----------------------------------------------------------------------------
+void VanitySearch::setTargetsFound(vector<int> &ids) {
 
-uint64_t VanitySearch::getGPUCount() {
+  // Found by the other workers, no longer searched
+  for (int i = 0; i < (int)ids.size(); i++)
+    if (ids[i] >= 0 && ids[i] < (int)inputPrefixes.size())
+      setTargetFound(ids[i]);
+  updateFound();
 
-  uint64_t count = 0;
-  for(int i=0;i<nbGPUThread;i++)
-    count += counters[0x80L+i];
-  return count;
+}
+
+bool VanitySearch::hasStartPubKey() {
+
+  return startPubKeySpecified;
 
 }
 
-uint64_t VanitySearch::getCPUCount() {
+bool VanitySearch::waitLeases() {
 
-  uint64_t count = 0;
-  for(int i=0;i<nbCPUThread;i++)
-    count += counters[i];
-  return count;
+  // Threads of a worker out of pieces wait for new leases until the end of the job
+  if (!linked || link->ended || endOfSearch)
+    return false;
+  Timer::SleepMillis(LINK_WAIT_MS);
+  return true;
 
 }
 
@@ -1700,56 +3910,139 @@ void VanitySearch::Search(int nbThread,std::vector<int> gpuId,std::vector<int> g
   double t0;
   double t1;
   endOfSearch = false;
-  nbCPUThread = nbThread;
+  nbCPUThread = 0;
   nbGPUThread = (useGpu?(int)gpuId.size():0);
   nbFoundKey = 0;
 
-  memset(counters,0,sizeof(counters));
+  // CPU threads can be added up to the number of cores of the host
+  nbCPUSlot = Timer::getMaxCoreNumber();
+  if (nbCPUSlot < nbThread)
+    nbCPUSlot = nbThread;
+
+  int nbTotal = nbCPUSlot + nbGPUThread;
+  stats = new THREAD_STATS[nbTotal];
+  for (int i = 0; i < nbTotal; i++) {
+    stats[i].keys = 0;
+    stats[i].hits = 0;
+    stats[i].groups = 0;
+    stats[i].rekeys = 0;
+    stats[i].rangeKeys = 0;
+    stats[i].epoch = (i < nbCPUSlot) ? 0xFFFFFFFF : 0;
+  }
 
-  printf("Number of CPU thread: %d\n", nbCPUThread);
+  printf("Number of CPU thread: %d\n", nbThread);
 
-  TH_PARAM *params = (TH_PARAM *)malloc((nbCPUThread + nbGPUThread) * sizeof(TH_PARAM));
-  memset(params,0,(nbCPUThread + nbGPUThread) * sizeof(TH_PARAM));
+  if (useNuma) {
+    Numa::Init();
+    nbNumaNode = Numa::GetNbNode();
+    numaNodes = new NUMA_NODE[nbNumaNode];
+    for (int i = 0; i < nbNumaNode; i++) {
+      numaNodes[i].Gn = NULL;
+      numaNodes[i].lookup = NULL;
+    }
+    printf("NUMA: %d node(s), threads pinned\n", nbNumaNode);
+  }
 
-  // Launch CPU threads
-  for (int i = 0; i < nbCPUThread; i++) {
+  // Verifier thread
+  hitQueue = new HitQueue(HIT_QUEUE_SIZE);
+  verifierStop = false;
+  THREAD_HANDLE verifier = launchThread(_VerifyHits, (void*)this);
+
+  TH_PARAM *params = new TH_PARAM[nbTotal];
+  for (int i = 0; i < nbTotal; i++) {
     params[i].obj = this;
     params[i].threadId = i;
-    params[i].isRunning = true;
-
-#ifdef WIN64
-    DWORD thread_id;
-    CreateThread(NULL, 0, _FindKey, (void*)(params+i), 0, &thread_id);
-    ghMutex = CreateMutex(NULL, FALSE, NULL);
-#else
-    pthread_t thread_id;
-    pthread_create(&thread_id, NULL, &_FindKey, (void*)(params+i));
-    ghMutex = PTHREAD_MUTEX_INITIALIZER;
-#endif
+    params[i].isRunning = false;
+    params[i].hasStarted = false;
+    params[i].rekeyRequest = false;
+    params[i].stopRequest = false;
+    params[i].launched = false;
+    params[i].hasResume = false;
+    params[i].chunk = -1;
+    params[i].working = false;
+    params[i].done = false;
+    params[i].steps = 0;
+  }
+  workers.resize(nbTotal);
+  slots = params;
+
+  if (workerAddr.length() > 0) {
+    // Range and chunks of the job, pieces leased by the coordinator
+    link = new CoordLink(this, workerAddr, leaseTimeout);
+    if (!link->Open())
+      exit(-1);
+  } else if (queueDir.length() > 0) {
+    // Range and chunks of the job, pieces claimed in the job directory. The
+    // first worker writes the chunks of its range (-rg).
+    if (rangeMode)
+      initChunks(rangeStart, rangeEnd);
+    link = new QueueLink(this, queueDir, leaseTimeout);
+    if (!link->Open())
+      exit(-1);
+  } else if (rangeRandom) {
+    // Whole range cut in chunks pulled in random order by all the threads
+    initChunks(rangeStart, rangeEnd);
+  } else if (rangeMode) {
+    // One part per CPU thread and per GPU. The CPU parts, contiguous, are
+    // cut in chunks pulled by the CPU threads.
+    int nbPart = nbThread + nbGPUThread;
+    if (nbThread > 0) {
+      Int s;
+      Int cpuEnd;
+      splitRange(rangeStart, rangeEnd, nbPart, nbThread - 1, s, cpuEnd);
+      initChunks(rangeStart, cpuEnd);
+    }
+    for (int i = 0; i < nbGPUThread; i++) {
+      TH_PARAM *p = params + (nbCPUSlot + i);
+      splitRange(rangeStart, rangeEnd, nbPart, nbThread + i, p->resumeKey, p->rangeEnd);
+      p->hasResume = true;
+      p->done = p->resumeKey.IsGreater(&p->rangeEnd);
+    }
   }
 
+  gpuDesc = "";
+  for (int i = 0; i < nbGPUThread; i++)
+    gpuDesc += (i ? "," : "") + to_string(gpuId[i]) + ":" + to_string(gridSize[2 * i]) + "x" + to_string(gridSize[2 * i + 1]);
+  if (resume)
+    restoreCheckpoint(params);
+
+  ResultWriter::setInterruptHandler(_Interrupt, (void *)this);
+
+  // Launch CPU threads
+  nbCPUTarget = nbThread;
+  if (linked)
+    link->Start();
+  for (int i = 0; i < nbThread; i++)
+    if (!params[i].done)
+      launchCPUThread(params + i);
+
   // Launch GPU threads
   for (int i = 0; i < nbGPUThread; i++) {
-    params[nbCPUThread+i].obj = this;
-    params[nbCPUThread+i].threadId = 0x80L+i;
-    params[nbCPUThread+i].isRunning = true;
-    params[nbCPUThread+i].gpuId = gpuId[i];
-    params[nbCPUThread+i].gridSizeX = gridSize[2*i];
-    params[nbCPUThread+i].gridSizeY = gridSize[2*i+1];
-#ifdef WIN64
-    DWORD thread_id;
-    CreateThread(NULL, 0, _FindKeyGPU, (void*)(params+(nbCPUThread+i)), 0, &thread_id);
-#else
-    pthread_t thread_id;
-    pthread_create(&thread_id, NULL, &_FindKeyGPU, (void*)(params+(nbCPUThread+i)));
-#endif
+    TH_PARAM *p = params + (nbCPUSlot + i);
+    if (p->done)
+      continue;
+    p->gpuId = gpuId[i];
+    p->gridSizeX = gridSize[2*i];
+    p->gridSizeY = gridSize[2*i+1];
+    p->isRunning = true;
+    p->launched = true;
+    workers[nbCPUSlot + i] = launchThread(_FindKeyGPU, (void*)p);
   }
 
+  // Live resize of the CPU threads
+#ifndef WIN64
+  sem_init(&threadSignal, 0, 0);
+  watchStop = false;
+  THREAD_HANDLE watchThread = launchThread(_SignalWatch, (void *)this);
+  signal(SIGUSR1, onThreadSignal);
+  signal(SIGUSR2, onThreadSignal);
+#endif
+
 #ifndef WIN64
   setvbuf(stdout, NULL, _IONBF, 0);
 #endif
 
-  uint64_t lastCount = 0;
+  uint64_t lastCount = getCPUCount() + getGPUCount();  // Not 0 when resumed
   uint64_t gpuCount = 0;
   uint64_t lastGPUCount = 0;
 
@@ -1766,19 +4059,39 @@ void VanitySearch::Search(int nbThread,std::vector<int> gpuId,std::vector<int> g
   memset(lastGpukeyRate,0,sizeof(lastkeyRate));
 
   // Wait that all threads have started
-  while (!hasStarted(params)) {
-    Timer::SleepMillis(500);
-  }
+  while (!hasStarted(params) && isAlive(params))
+    waitEvent(statsInterval);
 
   t0 = Timer::get_tick();
   startTime = t0;
+  double nextStats = t0 + statsInterval / 1000.0;
+  double nextCkpt = t0 + ckptInterval;
+
+  // Supervisor, woken by thread events or by the stats timer
+  while (isAlive(params) && !endOfSearch) {
 
-  while (isAlive(params)) {
+    int delta = threadRequest.exchange(0);
+    if (delta != 0)
+      resizeCPUThreads(params, nbCPUTarget + delta);
+    balanceCPUThreads(params);
+
+    double now = Timer::get_tick();
+    if (now < nextStats) {
+      waitEvent((uint32_t)((nextStats - now) * 1000.0) + 1);
+      continue;
+    }
+    nextStats = now + statsInterval / 1000.0;
+
+    // The file holds the wanted number of threads, signals last until it is read
+    if (ctlFile.length() > 0) {
+      int nb = readControlFile();
+      if (nb >= 0 && nb != nbCPUTarget)
+        resizeCPUThreads(params, nb);
+    }
 
-    int delay = 2000;
-    while (isAlive(params) && delay>0) {
-      Timer::SleepMillis(500);
-      delay -= 500;
+    if (ckptFile.length() > 0 && now >= nextCkpt) {
+      saveCheckpoint(params);
+      nextCkpt = now + ckptInterval;
     }
 
     gpuCount = getGPUCount();
@@ -1803,9 +4116,10 @@ void VanitySearch::Search(int nbThread,std::vector<int> gpuId,std::vector<int> g
     avgGpuKeyRate /= (double)(nbSample);
 
     if (isAlive(params)) {
+      string progress = rangeMode ? GetRangeProgress(avgKeyRate, count) : GetExpectedTime(avgKeyRate, (double)count);
       printf("\r[%.2f Mkey/s][GPU %.2f Mkey/s][Total 2^%.2f]%s[Found %d]  ",
         avgKeyRate / 1000000.0, avgGpuKeyRate / 1000000.0,
-          log2((double)count), GetExpectedTime(avgKeyRate, (double)count).c_str(),nbFoundKey);
+          log2((double)count), progress.c_str(),nbFoundKey.load());
     }
 
     if (rekey > 0) {
@@ -1822,7 +4136,53 @@ void VanitySearch::Search(int nbThread,std::vector<int> gpuId,std::vector<int> g
 
   }
 
-  free(params);
+  // Stop the remaining threads and wait for their last hits and records
+  endOfSearch = true;
+  for (int i = 0; i < (int)workers.size(); i++)
+    if (params[i].launched)
+      joinThread(workers[i]);
+  workers.clear();
+  verifierStop = true;
+  joinThread(verifier);
+
+  if (linked)
+    link->Stop();
+
+#ifndef WIN64
+  signal(SIGUSR1, SIG_IGN);
+  signal(SIGUSR2, SIG_IGN);
+  watchStop = true;
+  sem_post(&threadSignal);
+  joinThread(watchThread);
+  sem_destroy(&threadSignal);
+#endif
+
+  // Exact positions once the threads are stopped
+  if (ckptFile.length() > 0)
+    saveCheckpoint(params);
+
+  if (interrupted)
+    printf("\nInterrupted\n");
+
+  // Counters of all the threads
+  uint64_t nbHit = 0;
+  uint64_t nbGroup = 0;
+  uint64_t nbRekey = 0;
+  for (int i = 0; i < nbCPUSlot + nbGPUThread; i++) {
+    nbHit += stats[i].hits.load(std::memory_order_relaxed);
+    nbGroup += stats[i].groups.load(std::memory_order_relaxed);
+    nbRekey += stats[i].rekeys.load(std::memory_order_relaxed);
+  }
+  printf("\nLookup hits: %.0f, CPU groups and GPU calls: %.0f, rekeys: %.0f\n",
+    (double)nbHit, (double)nbGroup, (double)nbRekey);
+
+  ResultWriter::setInterruptHandler(NULL, NULL);
+  writer->close();
+
+  slots = NULL;
+  delete[] params;
+  delete[] stats;
+  stats = NULL;
 
 }
 
@@ -3,37 +3,116 @@
 
 #include <string>
 #include <vector>
+#include <atomic>
 #include "SECP256k1.h"
 #include "GPU/GPUEngine.h"
+#include "Wildcard.h"
+#include "XMatcher.h"
+#include "HitQueue.h"
+#include "ResultWriter.h"
+#include "Checkpoint.h"
+#include <unordered_set>
+#include <unordered_map>
 #ifdef WIN64
 #include <Windows.h>
+#else
+#include <pthread.h>
 #endif
 
 #define CPU_GRP_SIZE 1024
 
+// Harvest mode (all prefix matches written as records)
+#define HARVEST_NONE 0
+#define HARVEST_CSV  1   // address,type,wif,hex
+#define HARVEST_BIN  2   // 56 bytes: type,compressed,partial,0,hash160[20],privkey[32] (big endian)
+#define HARVEST_BATCH 1024
+
+// Hits are verified by a dedicated thread
+#define HIT_QUEUE_SIZE 16384
+#define HIT_BATCH 256
+
+// The lookup tables are rebuilt once 1/LOOKUP_PRUNE_RATIO of their targets are found
+#define LOOKUP_PRUNE_RATIO 64
+
+// Supervisor events
+#define EVENT_STARTED 1   // A thread has started its search
+#define EVENT_FOUND   2   // A key has been found
+#define EVENT_STOPPED 4   // A thread has exited
+#define EVENT_INTERRUPT 8 // SIGINT/SIGTERM received
+#define EVENT_RESIZE  16  // SIGUSR1/SIGUSR2 received
+#define STATS_INTERVAL 2000  // Default stats interval (ms)
+
+// Range chunks pulled by the CPU threads
+#define RANGE_CHUNK_SIZE (1ULL << 20)       // Default keys per chunk
+#define RANGE_MAX_CHUNK  (1ULL << 62)       // Maximum number of chunks, larger default chunks above
+#define RANGE_CHUNK_BITS 10                 // Smallest chunk asked (-chunk), whole CPU groups
+#define RANGE_MIN_STEAL  (2 * CPU_GRP_SIZE) // Minimum keys left to steal half of a piece
+#define RANGE_RANDOM_DRAW 8                 // Random draws before a scan for a free chunk
+
+#ifdef WIN64
+typedef HANDLE THREAD_HANDLE;
+typedef DWORD (WINAPI *THREAD_FUNC)(LPVOID);
+#else
+typedef pthread_t THREAD_HANDLE;
+typedef void *(*THREAD_FUNC)(void *);
+#endif
+
+// Thread helpers of the search and of BSGS, exit if a thread cannot be created
+THREAD_HANDLE launchThread(THREAD_FUNC f, void *param);
+void joinThread(THREAD_HANDLE h);
+void detachThread(THREAD_HANDLE h);
+
 class VanitySearch;
+class Coordinator;
+class WorkerLink;
 
 typedef struct {
 
   VanitySearch *obj;
-  int  threadId;
-  bool isRunning;
-  bool hasStarted;
-  bool rekeyRequest;
+  int  threadId;      // CPU slots first, then GPU threads
+  std::atomic<bool> isRunning;
+  std::atomic<bool> hasStarted;
+  std::atomic<bool> rekeyRequest;
+  std::atomic<bool> stopRequest;  // Thread removed from a live search
+  bool launched;
+  bool hasResume;     // Start from resumeKey (GPU range part or slot reused)
+  Int  resumeKey;     // Next key of the slot
+  Int  rangeEnd;      // Last key of the piece (CPU) or range part (GPU) of the slot
+  Int  ckptKey;       // First key of the CPU group in flight (range lock)
+  int64_t chunk;      // Chunk of the CPU piece, -1 if none (range lock)
+  bool working;       // A thread searches the piece (range lock)
+  std::atomic<bool> done;  // No range key left for the slot
+  std::atomic<uint64_t> steps;  // GPU kernel calls from the starting keys
+  std::vector<CKPT_PIECE> pieces;  // Piece of each GPU thread, random sampling (range lock)
   int  gridSizeX;
   int  gridSizeY;
   int  gpuId;
 
 } TH_PARAM;
 
+// Per thread stats, written by their thread only and read with relaxed loads.
+// Blocks are 2 cache lines long so that the counters of two threads never share
+// a cache line, whatever the alignment of the array.
+typedef struct {
+
+  std::atomic<uint64_t> keys;     // Keys checked
+  std::atomic<uint64_t> hits;     // Lookup hits
+  std::atomic<uint64_t> groups;   // CPU groups or GPU kernel calls
+  std::atomic<uint64_t> rekeys;
+  std::atomic<uint64_t> rangeKeys; // Keys of the range covered
+  std::atomic<uint32_t> epoch;    // Lookup epoch in use, 0xFFFFFFFF when stopped
+  uint8_t pad[128 - 5 * sizeof(std::atomic<uint64_t>) - sizeof(std::atomic<uint32_t>)];
+
+} THREAD_STATS;
 
 typedef struct {
 
   char *prefix;
   int prefixLength;
+  int type;
   prefix_t sPrefix;
   double difficulty;
-  bool *found;
+  std::atomic<bool> *found;   // Shared by the case variants of a prefix
 
   // For dreamer ;)
   bool isFull;
@@ -49,77 +128,264 @@ typedef struct {
 
 } PREFIX_TABLE_ITEM;
 
+// Lookup tables published to the search threads, rebuilt without the found items
+typedef struct {
+
+  PREFIX_TABLE_ITEM *table;            // 65536 buckets
+  std::vector<prefix_t> usedPrefix;    // GPU lookup16
+  std::vector<LPREFIX> usedPrefixL;    // GPU lookup32
+  uint32_t nbItem;
+  int nbLeft;                          // Targets left when built
+  uint32_t epoch;
+  bool owner;                          // Buckets allocated by pruneLookup()
+
+} PREFIX_LOOKUP;
+
+// Per NUMA node replicas, built by the first thread running on the node
+typedef struct {
+
+  Point *Gn;                             // Gn[CPU_GRP_SIZE/2] followed by _2Gn
+  std::atomic<PREFIX_LOOKUP *> lookup;   // Copy of the published lookup
+
+} NUMA_NODE;
+
+// Min-heap entry of the difficulty tracking
+typedef struct {
+
+  double difficulty;
+  std::atomic<bool> *found;
+
+} DIFFICULTY_ITEM;
+
+// Harvest mode, lookup hit waiting for batched address and key checks
+typedef struct {
+
+  Int key;
+  int32_t incr;
+  int endomorphism;
+  bool mode;
+  bool scriptHash;
+  bool hasPoint;
+  prefix_t prefIdx;
+  uint8_t hash160[20];
+  Point p;
+
+} HARVEST_ITEM;
+
 class VanitySearch {
 
 public:
 
   VanitySearch(Secp256K1 *secp, std::vector<std::string> &prefix, std::string seed, int searchMode,
-               bool useGpu,bool stop,std::string outputFile, bool useSSE,uint32_t maxFound,uint64_t rekey,
-               bool caseSensitive,Point &startPubKey,bool paranoiacSeed, uint32_t rangeStart, uint32_t rangeEnd, uint32_t keysPerThread);
+               bool useGpu,bool stop,ResultWriter *writer, bool useSSE,uint32_t maxFound,uint64_t rekey,
+               bool caseSensitive,Point &startPubKey,bool paranoiacSeed, Int &rangeStart, Int &rangeEnd, bool rangeStrict,
+               bool rangeRandom, int chunkBits, int harvest, uint32_t statsInterval, bool useNuma, std::string ctlFile,
+               std::string ckptFile, uint32_t ckptInterval, bool resume,
+               std::string coordAddr, std::string workerAddr, std::string queueDir, uint32_t leaseTimeout);
 
   void Search(int nbThread,std::vector<int> gpuId,std::vector<int> gridSize);
+  void Coordinate();
   void FindKeyCPU(TH_PARAM *p);
   void FindKeyGPU(TH_PARAM *p);
+  void VerifyHits();
+  void Interrupt();
+  void SignalWatch();
+
+  // Self check of the CPU group computation on degenerate centers
+  static bool CheckGroup(Secp256K1 *secp);
+
+  // Range pool of the coordinator (Coordinator.cpp) and of the workers (WorkerLink.cpp)
+  void lockRange();
+  void unlockRange();
+  std::string getJobId();
+  bool getJob(Int &start, Int &end, Int &size, uint64_t &nb);
+  bool setJob(Int &start, Int &end, Int &size, uint64_t nb, std::string worker, std::string source);
+  void getChunk(uint64_t c, Int &s, Int &e);
+  void endSearch();
+
+  // Coordinator, range lock held
+  bool takePieces(std::vector<CKPT_PIECE> &pieces);
+  void releasePieces(std::vector<CKPT_PIECE> &pieces);
+  void dropPieces(uint64_t c);
+  bool completeChunk(uint64_t c);
+  bool isJobDone();
+  void getJobProgress(uint64_t &nbDone, uint64_t &nb);
+
+  // Coordinator, results of the workers
+  bool checkResult(int type, std::string &addr, std::string &hex, std::string &wif);
+  void addResult(int type, std::string &addr, std::string &wif, std::string &hex);
+  void flushResults();
+
+  // Workers
+  void addPieces(std::vector<CKPT_PIECE> &pieces);
+  void revokeChunk(uint64_t c);
+  uint32_t getDemand(uint32_t &nbFree);
+  void getLinkReport(std::vector<CKPT_PIECE> &pieces, std::vector<uint64_t> &completed, std::vector<std::string> &found);
+  uint64_t getKeyCount();
+  void setTargetsFound(std::vector<int> &ids);
+  bool hasStartPubKey();
 
 private:
 
   std::string GetHex(std::vector<unsigned char> &buffer);
   std::string GetExpectedTime(double keyRate, double keyCount);
-  bool checkPrivKey(std::string addr, Int &key, int32_t incr, int endomorphism, bool mode);
-  void checkAddr(int prefIdx, uint8_t *hash160, Int &key, int32_t incr, int endomorphism, bool mode);
+  std::string GetRangeProgress(double keyRate, uint64_t keyCount);
+  void getPrivKey(Int &key, int32_t incr, int endomorphism, Int &k, Point &sp);
+  void pushHit(int type, std::string &addr, Int &key, int32_t incr, int endomorphism, bool mode);
+  void verifyHits(std::vector<HIT_ITEM> &hits);
+  void checkAddr(int prefIdx, uint8_t *hash160, Int &key, int32_t incr, int endomorphism, bool mode, bool scriptHash, Point *p);
+  void harvestFlush(std::vector<HARVEST_ITEM> &items);
+  void harvestVerify(std::vector<HARVEST_ITEM> &items, std::vector<int> &ids, std::vector<Int> &privKeys);
   void checkAddrSSE(uint8_t *h1, uint8_t *h2, uint8_t *h3, uint8_t *h4,
                     int32_t incr1, int32_t incr2, int32_t incr3, int32_t incr4,
                     Int &key, int endomorphism, bool mode);
+  bool patternFilter(uint8_t *hash160);
+  void checkPattern(std::string &addr, Int &key, int32_t incr, int endomorphism, bool mode);
+  bool setPatternFound(int id);
+  bool setTargetFound(int i);
+  void checkHash(bool compressed, Point &p, int32_t incr, Int &key, int endomorphism);
+  void checkHashSSE(bool compressed, Point &p1, Point &p2, Point &p3, Point &p4,
+                    int32_t incr1, int32_t incr2, int32_t incr3, int32_t incr4,
+                    Int &key, int endomorphism);
   void checkAddresses(bool compressed, Int key, int i, Point p1);
+  void checkPubKeys(Int &key, int i, Point &p1);
+  void checkPubKey(Int &x, Int &y, Int &key, int32_t incr, int endomorphism);
   void checkAddressesSSE(bool compressed, Int key, int i, Point p1, Point p2, Point p3, Point p4);
-  void output(std::string addr, std::string pAddr, std::string pAddrHex);
+  void output(int type, std::string addr, std::string pAddr, std::string pAddrHex);
   bool isAlive(TH_PARAM *p);
   bool isSingularPrefix(std::string pref);
+  bool isTaproot(std::string &pref);
   bool hasStarted(TH_PARAM *p);
   void rekeyRequest(TH_PARAM *p);
+  void notify(uint32_t event);
+  uint32_t waitEvent(uint32_t timeout);
   uint64_t getGPUCount();
   uint64_t getCPUCount();
+  void fillCheckpoint(Checkpoint &c);
+  void saveCheckpoint(TH_PARAM *p);
+  void getPieces(TH_PARAM *p, std::vector<CKPT_PIECE> &pieces);
+  void waitVerifier();
+  void restoreCheckpoint(TH_PARAM *p);
   bool initPrefix(std::string &prefix, PREFIX_ITEM *it);
   void dumpPrefixes();
   double getDiffuclty();
   void updateFound();
+  bool setFound(std::atomic<bool> *found);
+  void pruneLookup();
+  PREFIX_LOOKUP *enterLookup(int thId);
+  PREFIX_LOOKUP *nodeLookup(PREFIX_LOOKUP *l);
+  PREFIX_LOOKUP *cloneLookup(PREFIX_LOOKUP *l);
+  void enterNode(int node, std::vector<int> &cpus);
+  void freeLookup(PREFIX_LOOKUP *l);
   void getCPUStartingKey(int thId, Int& key, Point& startP);
-  void getGPUStartingKeys(int thId, int groupSize, int nbThread, Int *keys, Point *p);
-  void enumCaseUnsentivePrefix(std::string s, std::vector<std::string> &list);
+  void getCPUStartingPoint(Int &key, Point &startP);
+  void launchCPUThread(TH_PARAM *p);
+  void resizeCPUThreads(TH_PARAM *p, int nbThread);
+  void balanceCPUThreads(TH_PARAM *p);
+  void initChunks(Int &start, Int &end);
+  bool getRangeGroup(TH_PARAM *ph, Int &key, int &nbKey, bool &jump);
+  bool stealPiece(TH_PARAM *ph);
+  void endPiece(TH_PARAM *p);
+  void endChunk(uint64_t c);
+  uint64_t nextChunk();
+  void endGPUPieces(TH_PARAM *ph);
+  bool waitLeases();
+  int readControlFile();
+  void getGPUStartingKeys(TH_PARAM *ph, int groupSize, int nbThread, Int *keys, Point *p, Int *ends);
+  void splitRange(Int &start, Int &end, int nbPart, int part, Int &s, Int &e);
+  bool initCaseUnsensitivePrefix(std::string &prefix, std::vector<PREFIX_ITEM> &items);
   bool prefixMatch(char *prefix, char *addr);
 
   Secp256K1 *secp;
   Int startKey;
   Point startPubKey;
   bool startPubKeySpecified;
-  uint64_t counters[256];
+  THREAD_STATS *stats;                  // nbCPUSlot + nbGPUThread blocks
   double startTime;
   int searchType;
+  bool hasHash160;
+  bool hasP2SH;
   int searchMode;
   bool hasPattern;
   bool caseSensitive;
   bool useGpu;
+  bool useNuma;
+  NUMA_NODE *numaNodes;
+  int nbNumaNode;
   bool stopWhenFound;
-  bool endOfSearch;
-  int nbCPUThread;
+  std::atomic<bool> endOfSearch;
+  std::atomic<bool> interrupted;
+  int nbCPUThread;     // Running CPU threads
+  int nbCPUTarget;     // Wanted CPU threads
+  int nbCPUSlot;       // CPU slots, the GPU threads come next
   int nbGPUThread;
-  int nbFoundKey;
+  std::atomic<int> nbFoundKey;
   uint64_t rekey;
   uint64_t lastRekey;
   uint32_t nbPrefix;
-  std::string outputFile;
+  ResultWriter *writer;
+  int harvest;
   bool useSSE;
   bool onlyFull;
   uint32_t maxFound;
   double _difficulty;
   bool *patternFound;
+  WildcardMatcher *matcher;
+  bool pubKeySearch;
+  XMatcher *xMatcher;
+  std::atomic<int> nbPatternLeft;
+  std::atomic<int> nbPrefixLeft;
+  std::vector<DIFFICULTY_ITEM> difficultyHeap;
   std::vector<PREFIX_TABLE_ITEM> prefixes;
   std::vector<prefix_t> usedPrefix;
   std::vector<LPREFIX> usedPrefixL;
+  std::atomic<PREFIX_LOOKUP *> lookup;
+  std::vector<PREFIX_LOOKUP *> retiredLookups;
+  HitQueue *hitQueue;
+  volatile bool verifierStop;
+  std::unordered_set<std::string> verified;  // Recently reported addresses
   std::vector<std::string> &inputPrefixes;
-  uint32_t rangeStart;
-  uint32_t rangeEnd;
-  uint32_t keysPerThread;
+  bool rangeMode;
+  Int rangeStart;
+  Int rangeEnd;                // Inclusive
+  Int rangeSize;
+  bool rangeStrict;            // Only the keys of the range are checked
+  bool rangeRandom;            // Chunks pulled in random order
+  bool rangePool;              // Chunks pulled by all threads, GPU threads included (random, worker)
+  Int chunkStart;              // CPU part of the range (whole range when random), cut in chunks
+  Int chunkEnd;
+  Int chunkSize;
+  Int chunkReq;                // Chunk size asked (-chunk), zero for the default
+  uint64_t nbChunk;
+  std::atomic<uint64_t> chunkCursor;               // Next chunk to pull
+  std::atomic<uint64_t> nbChunkDone;
+  ChunkSet chunkDone;                              // Completed chunks
+  ChunkSet chunkTaken;                             // Pulled chunks, random sampling
+  std::unordered_map<uint64_t, uint32_t> chunkPieces;  // Pieces left of the chunks in progress
+  std::vector<CKPT_PIECE> freePieces;              // Pieces of a resumed search, leased or expired
+  TH_PARAM *slots;
+  std::string ckptFile;
+  uint32_t ckptInterval;               // Seconds between two checkpoints
+  bool resume;
+  std::string gpuDesc;                 // GPU ids and grid sizes
+  std::vector<std::atomic<bool> *> inputFound;  // Found flag of each input prefix, NULL if ignored
+  std::atomic<uint64_t> nbVerifiedHit;          // Hits processed by the verifier
+  uint32_t statsInterval;
+  uint32_t events;                      // Pending supervisor events
+  std::vector<THREAD_HANDLE> workers;   // Search threads by slot
+  std::string ctlFile;                  // Number of CPU threads, read at each stats interval
+
+  // Coordinator, or worker of a coordinator or of a job directory
+  std::string coordAddr;
+  Coordinator *coordinator;
+  uint32_t leaseTimeout;
+  bool linked;
+  std::string workerAddr;
+  std::string queueDir;
+  WorkerLink *link;
+  std::atomic<uint32_t> gpuDemand;      // Pieces needed by the GPU threads for one batch
+  std::vector<uint64_t> completedChunks;    // Chunks to report (range lock)
+  std::vector<std::string> linkFound;       // Results to report (range lock)
 
   Int beta;
   Int lambda;
@@ -128,8 +394,14 @@ private:
 
 #ifdef WIN64
   HANDLE ghMutex;
+  HANDLE rangeMutex;
+  CRITICAL_SECTION eventLock;
+  CONDITION_VARIABLE eventCond;
 #else
   pthread_mutex_t  ghMutex;
+  pthread_mutex_t  rangeMutex;
+  pthread_mutex_t  eventLock;
+  pthread_cond_t   eventCond;
 #endif
 
 };
@@ -16,9 +16,25 @@
 */
 
 #include "Wildcard.h"
+#include "SECP256k1.h"
+#include "Int.h"
+#include <string.h>
+#include <ctype.h>
+#include <map>
+#include <algorithm>
 
 using namespace std;
 
+static const char *base58Alphabet = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+static const char *bech32Alphabet = "qpzry9x8gf2tvdw0s3jn54khce6mua7l";
+
+// Max number of DFA states before falling back to Wildcard::match()
+#define MAX_DFA_STATE 65536
+
+#define DFA_DEAD   1
+#define DFA_ACCEPT 2
+#define DFA_SINK   4
+
 
 bool Wildcard::match(const char *str, const char *pattern, bool caseSensitive) {
 
@@ -62,3 +78,598 @@ starCheck:
   goto loopStart;
 
 }
+
+// ----------------------------------------------------------------------------
+
+static bool inAlphabet(const char *alphabet, char c) {
+  return c != 0 && strchr(alphabet, c) != NULL;
+}
+
+string Wildcard::getLiteral(string &pattern) {
+
+  size_t pos = pattern.find_first_of("*?");
+  if (pos == string::npos)
+    return pattern;
+  return pattern.substr(0, pos);
+
+}
+
+// ----------------------------------------------------------------------------
+
+static void pow2(Int &r, int n) {
+  r.SetInt32(0);
+  r.bits64[n / 64] = 1ULL << (n % 64);
+}
+
+static void addRange(Int &lo, Int &hi, Int &bMin, Int &bMax, vector<H160_RANGE> &ranges) {
+
+  Int l(&lo);
+  Int h(&hi);
+  if (l.IsLower(&bMin)) l.Set(&bMin);
+  if (h.IsGreater(&bMax)) h.Set(&bMax);
+  if (l.IsGreater(&h))
+    return;
+
+  // Payload = version(8) | hash160(160) | checksum(32)
+  H160_RANGE r;
+  r.lo = l.bits64[2];
+  r.hi = h.bits64[2];
+  ranges.push_back(r);
+
+}
+
+bool Wildcard::getRanges(string &literal, int addrType, vector<H160_RANGE> &ranges) {
+
+  ranges.clear();
+
+  if (addrType == BECH32) {
+
+    const char *hrp = "bc1q";
+    int hrpLength = (int)strlen(hrp);
+    int n = std::min((int)literal.length(), hrpLength);
+    if (strncmp(literal.c_str(), hrp, n) != 0)
+      return false;
+
+    // Each data character gives 5 bits of the witness program
+    uint64_t v = 0;
+    int nbBit = 0;
+    for (int i = hrpLength; i < (int)literal.length() && nbBit < 64; i++) {
+      const char *c = inAlphabet(bech32Alphabet, literal[i]) ? strchr(bech32Alphabet, literal[i]) : NULL;
+      if (c == NULL)
+        return false;
+      uint64_t d = (uint64_t)(c - bech32Alphabet);
+      if (nbBit + 5 <= 64) {
+        v = (v << 5) | d;
+        nbBit += 5;
+      } else {
+        v = (v << 4) | (d >> 1);
+        nbBit = 64;
+      }
+    }
+
+    H160_RANGE r;
+    if (nbBit == 0) {
+      r.lo = 0;
+      r.hi = 0xFFFFFFFFFFFFFFFFULL;
+    } else if (nbBit == 64) {
+      r.lo = v;
+      r.hi = v;
+    } else {
+      r.lo = v << (64 - nbBit);
+      r.hi = r.lo | ((1ULL << (64 - nbBit)) - 1);
+    }
+    ranges.push_back(r);
+    return true;
+
+  }
+
+  // Base58, 25 bytes payload seen as a 200 bits number V
+  uint64_t version = (addrType == P2SH) ? 5 : 0;
+  string lit = literal;
+  if (lit.length() == 0)
+    lit = (addrType == P2SH) ? "3" : "1";
+
+  int nbOne = 0;
+  while (nbOne < (int)lit.length() && lit[nbOne] == '1')
+    nbOne++;
+  string tail = lit.substr(nbOne);
+
+  // Version byte 0 produces the first '1', version 5 produces no leading '1'
+  if ((version == 0 && nbOne == 0) || (version != 0 && nbOne != 0) || nbOne > 25)
+    return false;
+
+  // V is in [version*2^192,(version+1)*2^192-1]
+  Int bMin((uint64_t)0);
+  bMin.bits64[3] = version;
+  Int bMax((uint64_t)0);
+  bMax.bits64[3] = version + 1;
+  bMax.SubOne();
+
+  // nbOne leading zero bytes: V < 256^(25-nbOne) (and V >= 256^(24-nbOne) for exactly nbOne)
+  Int vMax((uint64_t)0);
+  pow2(vMax, 8 * (25 - nbOne));
+  vMax.SubOne();
+  Int vMin((uint64_t)0);
+  if (tail.length() > 0)
+    pow2(vMin, 8 * (24 - nbOne));
+  if (vMin.IsGreater(&bMin)) bMin.Set(&vMin);
+  if (vMax.IsLower(&bMax)) bMax.Set(&vMax);
+
+  if (tail.length() == 0) {
+    addRange(bMin, bMax, bMin, bMax, ranges);
+    return ranges.size() > 0;
+  }
+
+  // Digits of V start with tail: V in [T*58^k,(T+1)*58^k-1] for all k
+  Int T((uint64_t)0);
+  for (int i = 0; i < (int)tail.length(); i++) {
+    if (!inAlphabet(base58Alphabet, tail[i]))
+      return false;
+    T.Mult(58);
+    T.Add((uint64_t)(strchr(base58Alphabet, tail[i]) - base58Alphabet));
+  }
+
+  Int p58((uint64_t)1);
+  Int lo;
+  Int hi;
+  while (true) {
+    lo.Mult(&T, &p58);
+    if (lo.IsGreater(&bMax))
+      break;
+    hi.Set(&lo);
+    hi.Add(&p58);
+    hi.SubOne();
+    addRange(lo, hi, bMin, bMax, ranges);
+    p58.Mult(58);
+  }
+
+  return ranges.size() > 0;
+
+}
+
+// ----------------------------------------------------------------------------
+
+static int nbCase(char c) {
+  char l = tolower(c);
+  char u = toupper(c);
+  return inAlphabet(base58Alphabet, l) + ((l != u) ? inAlphabet(base58Alphabet, u) : 0);
+}
+
+static void noCaseNode(string &lit, int pos, int addrType, uint64_t mask, vector<H160_RANGE> &ranges, double &proba) {
+
+  vector<H160_RANGE> r;
+  string head = lit.substr(0, pos);
+  if (!Wildcard::getRanges(head, addrType, r))
+    return;
+
+  bool fixed = true;
+  for (int i = 0; i < (int)r.size() && fixed; i++)
+    fixed = ((r[i].lo & mask) == (r[i].hi & mask));
+
+  if (fixed || pos == (int)lit.length()) {
+
+    // Remaining characters, k valid cases out of 58 digits each
+    double p = 0.0;
+    for (int i = 0; i < (int)r.size(); i++)
+      p += ((double)(r[i].hi - r[i].lo) + 1.0) / 18446744073709551616.0;
+    for (int i = pos; i < (int)lit.length(); i++)
+      p *= (double)nbCase(lit[i]) / 58.0;
+    proba += p;
+    ranges.insert(ranges.end(), r.begin(), r.end());
+    return;
+
+  }
+
+  char c = lit[pos];
+  char l = tolower(c);
+  char u = toupper(c);
+  if (inAlphabet(base58Alphabet, l)) {
+    lit[pos] = l;
+    noCaseNode(lit, pos + 1, addrType, mask, ranges, proba);
+  }
+  if (l != u && inAlphabet(base58Alphabet, u)) {
+    lit[pos] = u;
+    noCaseNode(lit, pos + 1, addrType, mask, ranges, proba);
+  }
+  lit[pos] = c;
+
+}
+
+double Wildcard::getRangesNoCase(string &literal, int addrType, int nbBit, vector<H160_RANGE> &ranges) {
+
+  ranges.clear();
+  string lit = literal;
+
+  if (addrType == BECH32) {
+    // Bech32 addresses are lower case
+    std::transform(lit.begin(), lit.end(), lit.begin(), ::tolower);
+    if (!getRanges(lit, addrType, ranges))
+      return 0.0;
+    double p = 0.0;
+    for (int i = 0; i < (int)ranges.size(); i++)
+      p += ((double)(ranges[i].hi - ranges[i].lo) + 1.0) / 18446744073709551616.0;
+    return p;
+  }
+
+  for (int i = 0; i < (int)lit.length(); i++)
+    if (nbCase(lit[i]) == 0)
+      return 0.0;
+
+  uint64_t mask = (nbBit >= 64) ? 0xFFFFFFFFFFFFFFFFULL : ~(0xFFFFFFFFFFFFFFFFULL >> nbBit);
+  double proba = 0.0;
+  noCaseNode(lit, (lit.length() > 0) ? 1 : 0, addrType, mask, ranges, proba);
+  return proba;
+
+}
+
+// ----------------------------------------------------------------------------
+
+static bool rangeLower(const H160_RANGE &a, const H160_RANGE &b) {
+  return a.lo < b.lo;
+}
+
+// Adds NFA position q and the positions reachable through empty '*' matches
+static void addPos(vector<uint32_t> &set, uint32_t q, vector<uint32_t> &stamp, uint32_t curStamp, vector<uint8_t> &isStar) {
+  while (stamp[q] != curStamp) {
+    stamp[q] = curStamp;
+    set.push_back(q);
+    if (!isStar[q]) break;
+    q++;
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+WildcardMatcher::WildcardMatcher(vector<string> &patterns, int addrType, bool caseSensitive) {
+
+  this->patterns = patterns;
+  this->caseSensitive = caseSensitive;
+  nbActive = (int)patterns.size();
+  active = new atomic<bool>[patterns.size()];
+  for (int i = 0; i < (int)patterns.size(); i++)
+    active[i] = true;
+
+  // Prefilter intervals of each pattern
+  patternRanges.resize(patterns.size());
+  for (int i = 0; i < (int)patterns.size(); i++) {
+    string lit = Wildcard::getLiteral(patterns[i]);
+    bool reachable;
+    if (caseSensitive)
+      reachable = Wildcard::getRanges(lit, addrType, patternRanges[i]);
+    else
+      reachable = Wildcard::getRangesNoCase(lit, addrType, 24, patternRanges[i]) > 0.0;
+    if (!reachable)
+      printf("Warning, pattern %s cannot match any address\n", patterns[i].c_str());
+  }
+
+  suffixMode = caseSensitive && addrType != BECH32 && isSuffixSearch(addrType);
+  set = buildSet();
+
+}
+
+WildcardMatcher::~WildcardMatcher() {
+
+  delete set.load();
+  for (int i = 0; i < (int)retiredSets.size(); i++)
+    delete retiredSets[i];
+  delete[] active;
+
+}
+
+WILDCARD_SET *WildcardMatcher::buildSet() {
+
+  // Prefilter, sorted and merged intervals of the active patterns
+  WILDCARD_SET *s = new WILDCARD_SET;
+  vector<H160_RANGE> all;
+  vector<int> ids;
+  for (int i = 0; i < (int)patterns.size(); i++) {
+    if (!active[i])
+      continue;
+    all.insert(all.end(), patternRanges[i].begin(), patternRanges[i].end());
+    ids.push_back(i);
+  }
+  s->nbActive = (int)ids.size();
+
+  std::sort(all.begin(), all.end(), rangeLower);
+  vector<H160_RANGE> &ranges = s->ranges;
+  for (int i = 0; i < (int)all.size(); i++) {
+    if (ranges.size() > 0 && (ranges.back().hi == 0xFFFFFFFFFFFFFFFFULL || all[i].lo <= ranges.back().hi + 1)) {
+      if (all[i].hi > ranges.back().hi) ranges.back().hi = all[i].hi;
+    } else {
+      ranges.push_back(all[i]);
+    }
+  }
+
+  if (ids.size() > 0)
+    build(ids, s);
+  if (suffixMode)
+    buildSuffixes(ids, s);
+  return s;
+
+}
+
+// ----------------------------------------------------------------------------
+
+// Max suffix digits handled by a 64 bit residue (58^10 < 2^64)
+#define MAX_SUFFIX_DIGIT 10
+
+bool WildcardMatcher::isSuffixSearch(int addrType) {
+
+  // All patterns are "1*suffix" or "3*suffix"
+  char start = (addrType == P2SH) ? '3' : '1';
+
+  for (int i = 0; i < (int)patterns.size(); i++) {
+    string &p = patterns[i];
+    if (p.length() < 3 || p[0] != start || p[1] != '*' || p.find_first_of("*?", 2) != string::npos)
+      return false;
+    for (int j = 2; j < (int)p.length(); j++)
+      if (!inAlphabet(base58Alphabet, p[j]))
+        return false;
+  }
+  return patterns.size() > 0;
+
+}
+
+void WildcardMatcher::buildSuffixes(vector<int> &ids, WILDCARD_SET *s) {
+
+  // The last k digits of an address are V mod 58^k (V = 200 bits payload),
+  // longer suffixes are checked on their last MAX_SUFFIX_DIGIT digits
+  vector<SUFFIX_SET> &suffixes = s->suffixes;
+  for (int i = 0; i < (int)ids.size(); i++) {
+
+    string suffix = patterns[ids[i]].substr(2);
+    if (suffix.length() > MAX_SUFFIX_DIGIT)
+      suffix = suffix.substr(suffix.length() - MAX_SUFFIX_DIGIT);
+
+    uint64_t m = 1;
+    uint64_t r = 0;
+    for (int j = 0; j < (int)suffix.length(); j++) {
+      m *= 58;
+      r = r * 58 + (uint64_t)(strchr(base58Alphabet, suffix[j]) - base58Alphabet);
+    }
+
+    int k = 0;
+    while (k < (int)suffixes.size() && suffixes[k].modulus != m)
+      k++;
+    if (k == (int)suffixes.size()) {
+      SUFFIX_SET e;
+      e.modulus = m;
+      suffixes.push_back(e);
+    }
+    suffixes[k].residues.insert(r);
+
+  }
+
+}
+
+bool WildcardMatcher::suffixFilter(uint8_t *payload) {
+
+  // V = payload[0]:L0:L1:L2 (64 bits limbs)
+  uint64_t l[3];
+  for (int i = 0; i < 3; i++)
+    l[i] = getH64(payload + 1 + 8 * i);
+
+  // Residues of the active patterns only, from the published set
+  vector<SUFFIX_SET> &suffixes = set.load()->suffixes;
+  for (int k = 0; k < (int)suffixes.size(); k++) {
+    uint64_t m = suffixes[k].modulus;
+    uint64_t r = payload[0] % m;
+    for (int i = 0; i < 3; i++)
+      _udiv128(r, l[i], m, &r);
+    if (suffixes[k].residues.find(r) != suffixes[k].residues.end())
+      return true;
+  }
+
+  return false;
+
+}
+
+// ----------------------------------------------------------------------------
+
+void WildcardMatcher::build(vector<int> &ids, WILDCARD_SET *s) {
+
+  // Split the group until each automaton fits in MAX_DFA_STATE
+  WILDCARD_DFA dfa;
+  if (compile(ids, dfa)) {
+    s->dfas.push_back(dfa);
+    return;
+  }
+
+  if (ids.size() == 1) {
+    s->notCompiled.push_back(ids[0]);
+    return;
+  }
+
+  vector<int> h1(ids.begin(), ids.begin() + ids.size() / 2);
+  vector<int> h2(ids.begin() + ids.size() / 2, ids.end());
+  build(h1, s);
+  build(h2, s);
+
+}
+// ----------------------------------------------------------------------------
+
+bool WildcardMatcher::compile(vector<int> &ids, WILDCARD_DFA &dfa) {
+
+  dfa.patterns = ids;
+
+  // Position q of the union NFA is (pattern posId[q], index posIdx[q])
+  vector<int> posId;
+  vector<int> posIdx;
+  vector<uint32_t> start;
+  for (int j = 0; j < (int)ids.size(); j++) {
+    int n = (int)patterns[ids[j]].length();
+    start.push_back((uint32_t)posId.size());
+    for (int i = 0; i <= n; i++) {
+      posId.push_back(ids[j]);
+      posIdx.push_back(i);
+    }
+  }
+
+  // Character classes, class 0 is for characters not present in the patterns
+  memset(dfa.charClass, 0, sizeof(dfa.charClass));
+  dfa.nbClass = 1;
+  for (int j = 0; j < (int)ids.size(); j++) {
+    string &p = patterns[ids[j]];
+    for (int i = 0; i < (int)p.length(); i++) {
+      uint8_t c = p[i] & 0x7F;
+      if (c == '*' || c == '?') continue;
+      if (!caseSensitive) c = tolower(c);
+      if (dfa.charClass[c] == 0) {
+        dfa.charClass[c] = dfa.nbClass;
+        if (!caseSensitive) dfa.charClass[toupper(c)] = dfa.nbClass;
+        dfa.nbClass++;
+      }
+    }
+  }
+  if (dfa.nbClass > 255)
+    return false;
+
+  vector<uint8_t> isStar(posId.size());
+  for (uint32_t q = 0; q < posId.size(); q++) {
+    string &p = patterns[posId[q]];
+    isStar[q] = (posIdx[q] < (int)p.length() && p[posIdx[q]] == '*');
+  }
+  vector<uint32_t> stamp(posId.size(), 0);
+  uint32_t curStamp = 1;
+
+  // Subset construction, a state is the sorted set of its NFA positions
+  vector<vector<uint32_t> > sets;
+  map<string, uint32_t> stateIds;
+  sets.push_back(vector<uint32_t>());
+  stateIds[string()] = 0;
+  vector<uint32_t> init;
+  for (int j = 0; j < (int)start.size(); j++)
+    addPos(init, start[j], stamp, curStamp, isStar);
+  std::sort(init.begin(), init.end());
+  stateIds[string((char *)init.data(), init.size() * 4)] = 1;
+  sets.push_back(init);
+
+  dfa.trans.clear();
+  for (uint32_t st = 0; st < sets.size(); st++) {
+
+    for (int k = 0; k < dfa.nbClass; k++) {
+
+      vector<uint32_t> nxt;
+      curStamp++;
+      for (int i = 0; i < (int)sets[st].size(); i++) {
+        uint32_t q = sets[st][i];
+        string &p = patterns[posId[q]];
+        int idx = posIdx[q];
+        if (idx == (int)p.length()) continue;
+        char c = p[idx];
+        if (c == '*') {
+          addPos(nxt, q, stamp, curStamp, isStar);
+        } else if (c == '?') {
+          addPos(nxt, q + 1, stamp, curStamp, isStar);
+        } else if (k != 0 && dfa.charClass[(uint8_t)(caseSensitive ? c : tolower(c)) & 0x7F] == k) {
+          addPos(nxt, q + 1, stamp, curStamp, isStar);
+        }
+      }
+      std::sort(nxt.begin(), nxt.end());
+
+      string key((char *)nxt.data(), nxt.size() * 4);
+      map<string, uint32_t>::iterator it = stateIds.find(key);
+      uint32_t id;
+      if (it == stateIds.end()) {
+        if (sets.size() >= MAX_DFA_STATE)
+          return false;
+        id = (uint32_t)sets.size();
+        stateIds[key] = id;
+        sets.push_back(nxt);
+      } else {
+        id = it->second;
+      }
+      dfa.trans.push_back(id);
+
+    }
+
+  }
+
+  // Accepting states and pattern ids
+  uint32_t nbState = (uint32_t)sets.size();
+  dfa.flags.resize(nbState);
+  dfa.acceptIdx.resize(nbState + 1);
+  dfa.acceptIds.clear();
+  for (uint32_t st = 0; st < nbState; st++) {
+
+    dfa.flags[st] = (st == 0) ? DFA_DEAD : 0;
+    dfa.acceptIdx[st] = (uint32_t)dfa.acceptIds.size();
+    for (int i = 0; i < (int)sets[st].size(); i++) {
+      uint32_t q = sets[st][i];
+      int id = posId[q];
+      if (posIdx[q] == (int)patterns[id].length())
+        dfa.acceptIds.push_back(id);
+    }
+
+    if (dfa.acceptIdx[st] != (uint32_t)dfa.acceptIds.size()) {
+      dfa.flags[st] |= DFA_ACCEPT;
+      bool sink = true;
+      for (int k = 0; k < dfa.nbClass && sink; k++)
+        sink = (dfa.trans[st*dfa.nbClass + k] == st);
+      if (sink) dfa.flags[st] |= DFA_SINK;
+    }
+
+  }
+  dfa.acceptIdx[nbState] = (uint32_t)dfa.acceptIds.size();
+
+  return true;
+
+}
+
+// ----------------------------------------------------------------------------
+
+void WildcardMatcher::match(const char *addr, vector<int> &ids) {
+
+  // Patterns removed since the set was built are skipped
+  WILDCARD_SET *s = set.load();
+  for (int d = 0; d < (int)s->dfas.size(); d++) {
+
+    WILDCARD_DFA &dfa = s->dfas[d];
+    uint32_t st = 1;
+    if (dfa.flags[st] & DFA_DEAD)
+      continue;
+
+    for (const uint8_t *c = (const uint8_t *)addr; *c; c++) {
+      st = dfa.trans[st*dfa.nbClass + dfa.charClass[*c & 0x7F]];
+      if (dfa.flags[st] & (DFA_DEAD | DFA_SINK))
+        break;
+    }
+
+    if ((dfa.flags[st] & (DFA_DEAD | DFA_ACCEPT)) == DFA_ACCEPT) {
+      for (uint32_t j = dfa.acceptIdx[st]; j < dfa.acceptIdx[st + 1]; j++)
+        if (active[dfa.acceptIds[j]])
+          ids.push_back(dfa.acceptIds[j]);
+    }
+
+  }
+
+  for (int i = 0; i < (int)s->notCompiled.size(); i++) {
+    int id = s->notCompiled[i];
+    if (active[id] && Wildcard::match(addr, patterns[id].c_str(), caseSensitive))
+      ids.push_back(id);
+  }
+
+}
+
+// ----------------------------------------------------------------------------
+
+bool WildcardMatcher::isActive(int id) {
+  return active[id];
+}
+
+void WildcardMatcher::remove(int id) {
+
+  if (!active[id])
+    return;
+  active[id] = false;
+  nbActive--;
+
+  // A new set replaces the published one, the search threads may still
+  // use the old one
+  WILDCARD_SET *cur = set.load();
+  if ((int64_t)(cur->nbActive - nbActive) * WILDCARD_PRUNE_RATIO < cur->nbActive)
+    return;
+  set = buildSet();
+  retiredSets.push_back(cur);
+
+}
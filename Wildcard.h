@@ -19,6 +19,18 @@
 #define WILDCARDH
 
 #include <string>
+#include <vector>
+#include <unordered_set>
+#include <atomic>
+#include <stdint.h>
+
+// Inclusive interval on the 64 upper bits (big endian) of a hash160
+typedef struct {
+
+  uint64_t lo;
+  uint64_t hi;
+
+} H160_RANGE;
 
 class Wildcard {
 
@@ -30,6 +42,123 @@ public:
   */
   static bool match(const char *str, const char *pattern,bool caseSensitive);
 
+  /**
+  * Returns the leading part of a pattern (up to the first wildcard)
+  */
+  static std::string getLiteral(std::string &pattern);
+
+  /**
+  * Computes the hash160 intervals of addresses starting with the given
+  * literal. Returns false if no address of this type can start with it.
+  */
+  static bool getRanges(std::string &literal, int addrType, std::vector<H160_RANGE> &ranges);
+
+  /**
+  * Case unsensitive version of getRanges(). Case variants are expanded
+  * lazily from a trie over the case choices, a branch is no longer
+  * expanded when the upper nbBit bits of its intervals are fixed.
+  * Returns the probability that a random hash160 matches.
+  */
+  static double getRangesNoCase(std::string &literal, int addrType, int nbBit, std::vector<H160_RANGE> &ranges);
+
+};
+
+// Automaton over a group of patterns, state 0 is the dead state, state 1
+// is the initial state
+typedef struct {
+
+  std::vector<int> patterns;
+  uint8_t charClass[128];
+  int nbClass;
+  std::vector<uint32_t> trans;
+  std::vector<uint8_t> flags;
+  std::vector<uint32_t> acceptIdx;   // acceptIds[acceptIdx[s]..acceptIdx[s+1]-1]
+  std::vector<int> acceptIds;
+
+} WILDCARD_DFA;
+
+// Target residues of the last k address digits (payload mod 58^k)
+typedef struct {
+
+  uint64_t modulus;
+  std::unordered_set<uint64_t> residues;
+
+} SUFFIX_SET;
+
+// Prefilter and automata of the active patterns, published to the search
+// threads and not modified once published
+typedef struct {
+
+  std::vector<H160_RANGE> ranges;    // Merged prefilter intervals
+  std::vector<WILDCARD_DFA> dfas;
+  std::vector<int> notCompiled;      // Patterns too large for a DFA, use Wildcard::match()
+  std::vector<SUFFIX_SET> suffixes;  // Suffix search only
+  int nbActive;                      // Active patterns when built
+
+} WILDCARD_SET;
+
+// The published set is rebuilt once 1/WILDCARD_PRUNE_RATIO of its patterns are removed
+#define WILDCARD_PRUNE_RATIO 4
+
+// Wildcard patterns compiled to a union DFA over the address alphabet,
+// with a hash160 interval prefilter built from their literal heads.
+class WildcardMatcher {
+
+public:
+
+  WildcardMatcher(std::vector<std::string> &patterns, int addrType, bool caseSensitive);
+  ~WildcardMatcher();
+
+  // Necessary condition on the 64 upper bits of the hash160
+  inline bool preFilter(uint64_t h64) {
+    std::vector<H160_RANGE> &ranges = set.load()->ranges;
+    int a = 0;
+    int b = (int)ranges.size();
+    while (a < b) {
+      int m = (a + b) / 2;
+      if (ranges[m].lo <= h64) a = m + 1;
+      else b = m;
+    }
+    return a > 0 && h64 <= ranges[a - 1].hi;
+  }
+
+  // Suffix search, all patterns are "1*suffix" or "3*suffix": necessary
+  // condition on the 25 bytes Base58Check payload
+  inline bool isSuffix() { return suffixMode; }
+  bool suffixFilter(uint8_t *payload);
+
+  // Appends the ids of the active patterns matching addr
+  void match(const char *addr, std::vector<int> &ids);
+
+  // Removes a pattern from the search, calls are serialized by the caller
+  void remove(int id);
+  bool isActive(int id);
+
+  // 64 upper bits (big endian) of a hash160
+  static inline uint64_t getH64(uint8_t *hash160) {
+    uint64_t h64 = 0;
+    for (int i = 0; i < 8; i++)
+      h64 = (h64 << 8) | hash160[i];
+    return h64;
+  }
+
+private:
+
+  WILDCARD_SET *buildSet();
+  void build(std::vector<int> &ids, WILDCARD_SET *s);
+  bool isSuffixSearch(int addrType);
+  void buildSuffixes(std::vector<int> &ids, WILDCARD_SET *s);
+  bool compile(std::vector<int> &ids, WILDCARD_DFA &dfa);
+
+  std::vector<std::string> patterns;
+  bool caseSensitive;
+  std::atomic<bool> *active;
+  int nbActive;
+  std::vector<std::vector<H160_RANGE> > patternRanges;
+  std::atomic<WILDCARD_SET *> set;
+  std::vector<WILDCARD_SET *> retiredSets;   // Freed with the matcher, they may still be in use
+  bool suffixMode;
+
 };
 
 #endif // WILDCARDH
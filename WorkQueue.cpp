@@ -0,0 +1,422 @@
+/*
+ * This file is part of the VanitySearch distribution (https://github.com/JeanLucPons/VanitySearch).
+ * Copyright (c) 2019 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "WorkQueue.h"
+#include "Timer.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+#ifdef WIN64
+#include <Windows.h>
+#include <io.h>
+#include <direct.h>
+#else
+#include <unistd.h>
+#include <dirent.h>
+#endif
+
+using namespace std;
+
+// ----------------------------------------------------------------------------
+
+static bool makeDir(string path) {
+
+#ifdef WIN64
+  return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+  return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+
+}
+
+static void listDir(string path, vector<string> &names) {
+
+  // Hidden, temporary and stale files skipped
+#ifdef WIN64
+  WIN32_FIND_DATAA fd;
+  HANDLE h = FindFirstFileA((path + "/*").c_str(), &fd);
+  if (h == INVALID_HANDLE_VALUE)
+    return;
+  do {
+    if (fd.cFileName[0] != '.' && strchr(fd.cFileName, '.') == NULL)
+      names.push_back(string(fd.cFileName));
+  } while (FindNextFileA(h, &fd));
+  FindClose(h);
+#else
+  DIR *d = opendir(path.c_str());
+  if (d == NULL)
+    return;
+  struct dirent *e;
+  while ((e = readdir(d)) != NULL)
+    if (e->d_name[0] != '.' && strchr(e->d_name, '.') == NULL)
+      names.push_back(string(e->d_name));
+  closedir(d);
+#endif
+
+}
+
+static bool createFile(string path, string content, bool exclusive) {
+
+  // Content synced before close, errno is EEXIST if an exclusive file exists
+#ifdef WIN64
+  int fd = _open(path.c_str(), _O_CREAT | _O_WRONLY | _O_BINARY | (exclusive ? _O_EXCL : _O_TRUNC), _S_IREAD | _S_IWRITE);
+  if (fd < 0)
+    return false;
+  bool ok = _write(fd, content.c_str(), (unsigned int)content.length()) == (int)content.length();
+  ok = _commit(fd) == 0 && ok;
+  _close(fd);
+#else
+  int fd = open(path.c_str(), O_CREAT | O_WRONLY | (exclusive ? O_EXCL : O_TRUNC), 0644);
+  if (fd < 0)
+    return false;
+  bool ok = write(fd, content.c_str(), content.length()) == (ssize_t)content.length();
+  ok = fsync(fd) == 0 && ok;
+  close(fd);
+#endif
+  return ok;
+
+}
+
+static bool readFile(string path, string &content) {
+
+  FILE *f = fopen(path.c_str(), "rb");
+  if (f == NULL)
+    return false;
+  char buff[4096];
+  size_t n;
+  content = "";
+  while ((n = fread(buff, 1, sizeof(buff), f)) > 0)
+    content.append(buff, n);
+  bool ok = !ferror(f);
+  fclose(f);
+  return ok;
+
+}
+
+static bool fileExists(string path) {
+
+#ifdef WIN64
+  return _access(path.c_str(), 0) == 0;
+#else
+  return access(path.c_str(), F_OK) == 0;
+#endif
+
+}
+
+static bool moveFile(string from, string to, bool replace) {
+
+  // Without replace, fails if to exists (the source is then kept)
+#ifdef WIN64
+  return MoveFileExA(from.c_str(), to.c_str(), (replace ? MOVEFILE_REPLACE_EXISTING : 0) | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+  if (replace)
+    return rename(from.c_str(), to.c_str()) == 0;
+  // rename() replaces, link() does not
+  if (link(from.c_str(), to.c_str()) != 0)
+    return false;
+  unlink(from.c_str());
+  return true;
+#endif
+
+}
+
+// ----------------------------------------------------------------------------
+
+WorkQueue::WorkQueue(string dir) {
+
+  this->dir = dir;
+  this->results = NULL;
+
+  char host[256];
+#ifdef WIN64
+  DWORD size = sizeof(host);
+  if (!GetComputerNameA(host, &size))
+    strcpy(host, "host");
+  id = string(host) + "-" + to_string(GetCurrentProcessId());
+#else
+  if (gethostname(host, sizeof(host)) != 0)
+    strcpy(host, "host");
+  host[sizeof(host) - 1] = 0;
+  id = string(host) + "-" + to_string(getpid());
+#endif
+  // Host names and pids may be the same in containers
+  id += "-" + Timer::getSeed(4);
+  // Used as file name, without dot
+  for (int i = 0; i < (int)id.length(); i++)
+    if (id[i] == '.' || id[i] == '/' || id[i] == '\\' || id[i] == ':')
+      id[i] = '_';
+
+}
+
+WorkQueue *WorkQueue::Open(string dir, bool create) {
+
+  if (!create) {
+    if (!fileExists(dir + "/job")) {
+      printf("Error: %s has no job, the first worker needs a range (-rg)\n", dir.c_str());
+      return NULL;
+    }
+    return new WorkQueue(dir);
+  }
+
+  const char *subs[] = { "claim", "done", "worker", "results" };
+  if (!makeDir(dir)) {
+    printf("Error: cannot create directory %s: %s\n", dir.c_str(), strerror(errno));
+    return NULL;
+  }
+  for (int i = 0; i < 4; i++) {
+    string sub = dir + "/" + subs[i];
+    if (!makeDir(sub)) {
+      printf("Error: cannot create directory %s: %s\n", sub.c_str(), strerror(errno));
+      return NULL;
+    }
+  }
+  return new WorkQueue(dir);
+
+}
+
+string WorkQueue::getPath(const char *sub, uint64_t chunk) {
+  return dir + "/" + sub + "/" + to_string(chunk);
+}
+
+// ----------------------------------------------------------------------------
+
+bool WorkQueue::CreateJob(string &job) {
+
+  // Complete file published without replacing the job of another worker
+  string name = dir + "/job";
+  string tmpName = dir + "/job." + id + ".tmp";
+  if (!createFile(tmpName, job, false)) {
+    printf("Error: cannot write %s: %s\n", tmpName.c_str(), strerror(errno));
+    return false;
+  }
+  moveFile(tmpName, name, false);
+  remove(tmpName.c_str());
+  return ReadJob(job);
+
+}
+
+bool WorkQueue::ReadJob(string &job) {
+  return readFile(dir + "/job", job);
+}
+
+// ----------------------------------------------------------------------------
+
+int WorkQueue::Claim(uint64_t chunk) {
+
+  string name = getPath("claim", chunk);
+  if (createFile(name, id, true))
+    return 1;
+  if (errno == EEXIST)
+    return 0;
+  printf("\nError: cannot create %s: %s\n", name.c_str(), strerror(errno));
+  return -1;
+
+}
+
+bool WorkQueue::Reclaim(uint64_t chunk, string owner, string token, string &holder) {
+
+  // Only the worker creating the takeover token can replace the claim, and
+  // only if the claim is still the one of owner. Tokens are kept.
+  string name = getPath("claim", chunk);
+  string tokenName = name + ".takeover." + token;
+  holder = "";
+  if (!createFile(tokenName, id, true)) {
+    if (errno == EEXIST)
+      readFile(tokenName, holder);
+    return false;
+  }
+
+  string content;
+  if (!readFile(name, content) || content != owner)
+    return false;
+  string tmpName = name + "." + id + ".tmp";
+  if (!createFile(tmpName, id, false) || !moveFile(tmpName, name, true)) {
+    printf("\nError: cannot write %s: %s\n", name.c_str(), strerror(errno));
+    remove(tmpName.c_str());
+    return false;
+  }
+  return true;
+
+}
+
+string WorkQueue::GetOwner(uint64_t chunk) {
+
+  string owner;
+  if (!readFile(getPath("claim", chunk), owner))
+    return "";
+  return owner;
+
+}
+
+void WorkQueue::ListClaims(vector<uint64_t> &chunks) {
+
+  vector<string> names;
+  listDir(dir + "/claim", names);
+  for (int i = 0; i < (int)names.size(); i++)
+    chunks.push_back(strtoull(names[i].c_str(), NULL, 10));
+
+}
+
+// ----------------------------------------------------------------------------
+
+bool WorkQueue::SetDone(uint64_t chunk) {
+
+  string name = getPath("done", chunk);
+  if (createFile(name, "", false))
+    return true;
+  printf("\nError: cannot create %s: %s\n", name.c_str(), strerror(errno));
+  return false;
+
+}
+
+bool WorkQueue::IsDone(uint64_t chunk) {
+  return fileExists(getPath("done", chunk));
+}
+
+// ----------------------------------------------------------------------------
+
+bool WorkQueue::WriteState(QUEUE_STATE &state) {
+
+  char tmp[64];
+  sprintf(tmp, "VanitySearch worker %d\n", QUEUE_VERSION);
+  string s = string(tmp);
+  sprintf(tmp, "beat %" PRIu64 " %d\n", state.beat, state.ended);
+  s += string(tmp);
+  for (int i = 0; i < (int)state.pieces.size(); i++)
+    s += "piece " + to_string(state.pieces[i].chunk) + " " + state.pieces[i].start.GetBase16() + " " +
+      state.pieces[i].end.GetBase16() + "\n";
+  s += "end\n";
+
+  string name = dir + "/worker/" + id;
+  string tmpName = name + ".tmp";
+  if (!createFile(tmpName, s, false) || !moveFile(tmpName, name, true)) {
+    printf("\nError: cannot write %s: %s\n", name.c_str(), strerror(errno));
+    return false;
+  }
+  return true;
+
+}
+
+void WorkQueue::ReadStates(unordered_map<string, QUEUE_STATE> &states) {
+
+  vector<string> names;
+  listDir(dir + "/worker", names);
+
+  for (int i = 0; i < (int)names.size(); i++) {
+
+    string content;
+    if (names[i] == id || !readFile(dir + "/worker/" + names[i], content))
+      continue;
+
+    QUEUE_STATE st;
+    st.beat = 0;
+    st.ended = false;
+    int version = 0;
+    bool ended = false;
+    bool ok = true;
+    size_t pos = 0;
+    while (ok && !ended && pos < content.length()) {
+      size_t eol = content.find('\n', pos);
+      if (eol == string::npos)
+        break;
+      string line = content.substr(pos, eol - pos);
+      pos = eol + 1;
+      char s1[512];
+      char s2[512];
+      int e;
+      CKPT_PIECE p;
+      if (sscanf(line.c_str(), "VanitySearch worker %d", &version) == 1) {
+        ok = version == QUEUE_VERSION;
+      } else if (sscanf(line.c_str(), "beat %" SCNu64 " %d", &st.beat, &e) == 2) {
+        st.ended = e != 0;
+      } else if (sscanf(line.c_str(), "piece %" SCNu64 " %511s %511s", &p.chunk, s1, s2) == 3) {
+        p.start.SetBase16(s1);
+        p.end.SetBase16(s2);
+        st.pieces.push_back(p);
+      } else {
+        ended = line == "end";
+        ok = ended;
+      }
+    }
+
+    if (ok && ended && version == QUEUE_VERSION)
+      states[names[i]] = st;
+
+  }
+
+}
+
+// ----------------------------------------------------------------------------
+
+bool WorkQueue::AppendResults(vector<string> &lines) {
+
+  if (lines.size() == 0)
+    return true;
+
+  string name = dir + "/results/" + id;
+  if (results == NULL) {
+    results = fopen(name.c_str(), "ab");
+    if (results == NULL) {
+      printf("\nError: cannot open %s: %s\n", name.c_str(), strerror(errno));
+      return false;
+    }
+  }
+
+  for (int i = 0; i < (int)lines.size(); i++)
+    fprintf(results, "%s\n", lines[i].c_str());
+  bool ok = fflush(results) == 0;
+#ifdef WIN64
+  ok = _commit(_fileno(results)) == 0 && ok;
+#else
+  ok = fsync(fileno(results)) == 0 && ok;
+#endif
+  if (!ok)
+    printf("\nError while writing %s\n", name.c_str());
+  return ok;
+
+}
+
+bool WorkQueue::ReadResults(string dir, vector<string> &lines, int &nbFile) {
+
+  if (!fileExists(dir + "/results")) {
+    printf("Error: %s is not a job directory\n", dir.c_str());
+    return false;
+  }
+  vector<string> names;
+  listDir(dir + "/results", names);
+
+  nbFile = (int)names.size();
+  for (int i = 0; i < nbFile; i++) {
+    string content;
+    if (!readFile(dir + "/results/" + names[i], content)) {
+      printf("Error: cannot read %s/results/%s\n", dir.c_str(), names[i].c_str());
+      return false;
+    }
+    // A line cut by a crash is ignored
+    size_t pos = 0;
+    size_t eol;
+    while ((eol = content.find('\n', pos)) != string::npos) {
+      if (eol > pos)
+        lines.push_back(content.substr(pos, eol - pos));
+      pos = eol + 1;
+    }
+  }
+  return true;
+
+}
@@ -0,0 +1,98 @@
+/*
+ * This file is part of the VanitySearch distribution (https://github.com/JeanLucPons/VanitySearch).
+ * Copyright (c) 2019 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WORKQUEUEH
+#define WORKQUEUEH
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdio.h>
+#include <stdint.h>
+#include "Checkpoint.h"
+
+#define QUEUE_VERSION 1
+
+// Worker state, renamed over the previous one at each report
+typedef struct {
+
+  uint64_t beat;                   // Report counter
+  bool ended;                      // Worker stopped, its claims can be taken at once
+  std::vector<CKPT_PIECE> pieces;  // Parts of its claimed chunks left
+
+} QUEUE_STATE;
+
+// Job shared by workers through a directory (NFS, Lustre, ...), no server needed:
+//   job            job description, written once
+//   claim/<chunk>  id of the worker searching the chunk, created with O_EXCL
+//   claim/<chunk>.takeover.<token>  id of the worker taking the claim over, O_EXCL
+//   done/<chunk>   completed chunk
+//   worker/<id>    heartbeat and progress of a worker
+//   results/<id>   results found by a worker
+class WorkQueue {
+
+public:
+
+  // NULL on failure, an error is printed. Missing directories are created
+  // when create is set, the directory must have a job otherwise.
+  static WorkQueue *Open(std::string dir, bool create);
+
+  // Writes the job if the directory has none, job is then the one of the directory
+  bool CreateJob(std::string &job);
+
+  // False if the directory has no job
+  bool ReadJob(std::string &job);
+
+  // 1 if claimed, 0 if already claimed, -1 on error
+  int Claim(uint64_t chunk);
+
+  // Takes the claim of an expired owner over, false if the claim is no longer
+  // the one of owner or if the token (owner and its last heartbeat) was already
+  // taken, holder is then the worker which took it
+  bool Reclaim(uint64_t chunk, std::string owner, std::string token, std::string &holder);
+
+  // Empty if not claimed
+  std::string GetOwner(uint64_t chunk);
+  void ListClaims(std::vector<uint64_t> &chunks);
+
+  bool SetDone(uint64_t chunk);
+  bool IsDone(uint64_t chunk);
+
+  bool WriteState(QUEUE_STATE &state);
+
+  // States of the other workers
+  void ReadStates(std::unordered_map<std::string, QUEUE_STATE> &states);
+
+  // Result lines of this worker, appended and synced
+  bool AppendResults(std::vector<std::string> &lines);
+
+  // Result lines of all the workers of a directory
+  static bool ReadResults(std::string dir, std::vector<std::string> &lines, int &nbFile);
+
+  std::string id;      // host-pid-random
+
+private:
+
+  WorkQueue(std::string dir);
+  std::string getPath(const char *sub, uint64_t chunk);
+
+  std::string dir;
+  FILE *results;
+
+};
+
+#endif // WORKQUEUEH
@@ -0,0 +1,521 @@
+/*
+ * This file is part of the VanitySearch distribution (https://github.com/JeanLucPons/VanitySearch).
+ * Copyright (c) 2019 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "WorkerLink.h"
+#include "Coordinator.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace std;
+
+// ----------------------------------------------------------------------------
+
+#ifdef WIN64
+DWORD WINAPI _WorkerLink(LPVOID lpParam) {
+#else
+void *_WorkerLink(void *lpParam) {
+#endif
+  WorkerLink *l = (WorkerLink *)lpParam;
+  l->Run();
+  return 0;
+}
+
+WorkerLink::WorkerLink(VanitySearch *v, uint32_t leaseTimeout) {
+
+  this->v = v;
+  this->leaseTimeout = leaseTimeout;
+  this->nbChunk = 0;
+  this->ended = false;
+  this->progress = 0.0;
+  this->stop = false;
+
+}
+
+void WorkerLink::Start() {
+
+  stop = false;
+  thread = launchThread(_WorkerLink, (void *)this);
+
+}
+
+void WorkerLink::Stop() {
+
+  stop = true;
+  joinThread(thread);
+
+}
+
+void WorkerLink::Run() {
+
+  bool ok = true;
+  bool noMore = false;   // The coordinator had no piece left, asked again after the next report
+  double nextReport = Timer::get_tick() + LINK_REPORT_MS / 1000.0;
+
+  while (ok && !stop) {
+
+    // The chunks left stay with the coordinator or in the directory for the other workers
+    uint32_t nbFree;
+    uint32_t demand = v->getDemand(nbFree);
+    if (!ended && !noMore && nbFree < demand) {
+      int nb = request(demand - nbFree);
+      ok = nb >= 0;
+      noMore = nb == 0;
+    }
+
+    if (ok && Timer::get_tick() >= nextReport) {
+      ok = report(false);
+      noMore = false;
+      nextReport = Timer::get_tick() + LINK_REPORT_MS / 1000.0;
+    }
+
+    Timer::SleepMillis(LINK_WAIT_MS);
+
+  }
+
+  // Last results and positions, the pieces left go back to the coordinator
+  // or can be claimed at once by the other workers
+  if (ok)
+    ok = report(true);
+  if (!ok) {
+    ended = true;
+    v->endSearch();
+  }
+  close(ok);
+
+}
+
+// ----------------------------------------------------------------------------
+
+CoordLink::CoordLink(VanitySearch *v, string addr, uint32_t leaseTimeout) : WorkerLink(v, leaseTimeout) {
+
+  this->addr = addr;
+  this->s = NULL;
+  this->known = 0;
+
+}
+
+bool CoordLink::Open() {
+
+  s = NetSocket::Connect(addr);
+  if (s == NULL)
+    return false;
+
+  string line;
+  if (!s->SendLine("hello " + to_string(COORD_PROTOCOL) + " " + v->getJobId()) || !s->ReadLine(line)) {
+    printf("Error: no reply from %s\n", addr.c_str());
+    return false;
+  }
+  if (line.compare(0, 6, "error ") == 0) {
+    printf("Error: %s: %s\n", addr.c_str(), line.substr(6).c_str());
+    return false;
+  }
+
+  vector<string> f = NetSocket::Split(line);
+  if (f.size() != 6 || f[0] != "job") {
+    printf("Error: invalid reply from %s\n", addr.c_str());
+    return false;
+  }
+
+  // Same chunks on both sides, all of them leased
+  Int start;
+  Int end;
+  Int size;
+  start.SetBase16((char *)f[1].c_str());
+  end.SetBase16((char *)f[2].c_str());
+  size.SetBase16((char *)f[3].c_str());
+  nbChunk = strtoull(f[4].c_str(), NULL, 10);
+  return v->setJob(start, end, size, nbChunk, f[5], addr);
+
+}
+
+int CoordLink::request(uint32_t nbPiece) {
+
+  string line;
+  if (!s->SendLine("get " + to_string(nbPiece)))
+    return -1;
+
+  vector<CKPT_PIECE> got;
+  while (true) {
+    if (!s->ReadLine(line))
+      return -1;
+    if (line == "ok")
+      break;
+    if (line == "end") {
+      ended = true;
+      break;
+    }
+    vector<string> f = NetSocket::Split(line);
+    CKPT_PIECE pc;
+    if (f.size() != 4 || f[0] != "lease")
+      return -1;
+    pc.chunk = strtoull(f[1].c_str(), NULL, 10);
+    pc.start.SetBase16((char *)f[2].c_str());
+    pc.end.SetBase16((char *)f[3].c_str());
+    if (pc.chunk >= nbChunk)
+      return -1;
+    got.push_back(pc);
+  }
+
+  v->addPieces(got);
+  return (int)got.size();
+
+}
+
+bool CoordLink::report(bool last) {
+
+  vector<CKPT_PIECE> pieces;
+  vector<uint64_t> completed;
+  vector<string> found;
+  v->getLinkReport(pieces, completed, found);
+
+  // Progress of the chunks in progress, pieces grouped by chunk
+  unordered_map<uint64_t, string> chunks;
+  for (int i = 0; i < (int)pieces.size(); i++)
+    chunks[pieces[i].chunk] += " " + pieces[i].start.GetBase16() + ":" + pieces[i].end.GetBase16();
+
+  vector<string> req;
+  vector<uint64_t> reqChunk;
+  for (int i = 0; i < (int)found.size(); i++) {
+    req.push_back("found " + found[i]);
+    reqChunk.push_back(nbChunk);
+  }
+  for (int i = 0; i < (int)completed.size(); i++) {
+    req.push_back("complete " + to_string(completed[i]));
+    reqChunk.push_back(nbChunk);
+  }
+  for (auto it = chunks.begin(); it != chunks.end(); it++) {
+    req.push_back("progress " + to_string(it->first) + it->second);
+    reqChunk.push_back(it->first);
+  }
+  req.push_back("beat " + to_string(v->getKeyCount()) + " " + to_string(known));
+  reqChunk.push_back(nbChunk);
+
+  // Requests sent by windows, replies read in order
+  string line;
+  for (size_t i = 0; i < req.size(); i += LINK_WINDOW) {
+    size_t n = req.size() - i;
+    if (n > LINK_WINDOW) n = LINK_WINDOW;
+    string all = req[i];
+    for (size_t j = 1; j < n; j++)
+      all += "\n" + req[i + j];
+    if (!s->SendLine(all))
+      return false;
+    for (size_t j = 0; j < n; j++) {
+      if (!s->ReadLine(line))
+        return false;
+      if (line.compare(0, 7, "revoke ") == 0) {
+        v->revokeChunk(reqChunk[i + j]);
+      } else if (line.compare(0, 3, "ok ") == 0) {
+        vector<string> f = NetSocket::Split(line);
+        if (f.size() != 5) {
+          printf("\nError: %s: invalid reply %s\n", addr.c_str(), line.c_str());
+          return false;
+        }
+        double nb = atof(f[2].c_str());
+        if (nb > 0)
+          progress = atof(f[1].c_str()) / nb;
+        // Targets found by the other workers are no longer searched
+        if (f[4] != "-") {
+          vector<int> ids;
+          size_t pos = 0;
+          while (pos < f[4].length()) {
+            size_t next = f[4].find(',', pos);
+            if (next == string::npos) next = f[4].length();
+            ids.push_back(atoi(f[4].substr(pos, next - pos).c_str()));
+            pos = next + 1;
+          }
+          known += ids.size();
+          v->setTargetsFound(ids);
+        }
+        if (f[3] == "1") {
+          ended = true;
+          v->endSearch();
+        }
+      } else if (line != "ok") {
+        printf("\nError: %s: %s\n", addr.c_str(), line.c_str());
+        return false;
+      }
+    }
+  }
+
+  return !last || s->SendLine("bye");
+
+}
+
+void CoordLink::close(bool ok) {
+
+  if (!ok)
+    printf("\nError: connection to %s lost\n", addr.c_str());
+  s->Close();
+
+}
+
+// ----------------------------------------------------------------------------
+
+QueueLink::QueueLink(VanitySearch *v, string dir, uint32_t leaseTimeout) : WorkerLink(v, leaseTimeout) {
+
+  this->dir = dir;
+  this->queue = NULL;
+  this->cursor = 0;
+  this->beat = 0;
+  this->nextScan = 0.0;
+
+}
+
+bool QueueLink::Open() {
+
+  // Range and chunks of the command line (-rg), or the ones of the directory
+  Int start;
+  Int end;
+  Int size;
+  uint64_t nb;
+  bool hasRange = v->getJob(start, end, size, nb);
+
+  queue = WorkQueue::Open(dir, hasRange);
+  if (queue == NULL)
+    return false;
+
+  // The first worker writes the job, the other ones take it or check it (-rg)
+  string job;
+  if (hasRange) {
+    string localJob = "VanitySearch job " + to_string(QUEUE_VERSION) + "\n" +
+      "id " + v->getJobId() + "\n" +
+      "range " + start.GetBase16() + " " + end.GetBase16() + "\n" +
+      "chunks " + size.GetBase16() + " " + to_string(nb) + "\n";
+    job = localJob;
+    if (!queue->CreateJob(job)) {
+      printf("Error: cannot read the job of %s\n", dir.c_str());
+      return false;
+    }
+    if (job != localJob) {
+      printf("Error: %s has a different job (targets, search options or range)\n", dir.c_str());
+      return false;
+    }
+  } else if (!queue->ReadJob(job)) {
+    printf("Error: cannot read the job of %s\n", dir.c_str());
+    return false;
+  }
+
+  vector<string> f;
+  size_t pos = 0;
+  size_t eol;
+  while ((eol = job.find('\n', pos)) != string::npos) {
+    string line = job.substr(pos, eol - pos);
+    vector<string> l = NetSocket::Split(line);
+    f.insert(f.end(), l.begin(), l.end());
+    pos = eol + 1;
+  }
+  if (f.size() != 11 || f[0] != "VanitySearch" || f[1] != "job" || f[3] != "id" || f[5] != "range" || f[8] != "chunks") {
+    printf("Error: invalid job in %s\n", dir.c_str());
+    return false;
+  }
+  if (f[2] != to_string(QUEUE_VERSION) || f[4] != v->getJobId()) {
+    printf("Error: %s has a different job (targets or search options: prefixes, -c, -u, -b, -sp, -strict)\n", dir.c_str());
+    return false;
+  }
+
+  // Same chunks for all the workers, all of them claimed in the directory
+  start.SetBase16((char *)f[6].c_str());
+  end.SetBase16((char *)f[7].c_str());
+  size.SetBase16((char *)f[9].c_str());
+  nbChunk = strtoull(f[10].c_str(), NULL, 10);
+  if (!v->setJob(start, end, size, nbChunk, queue->id, dir))
+    return false;
+
+  // Claims start after the first chunks already claimed
+  vector<uint64_t> claimed;
+  queue->ListClaims(claimed);
+  unordered_set<uint64_t> taken(claimed.begin(), claimed.end());
+  while (cursor < nbChunk && taken.count(cursor) > 0)
+    cursor++;
+  nextScan = Timer::get_tick();
+
+  return true;
+
+}
+
+int QueueLink::request(uint32_t nbPiece) {
+
+  // Chunks claimed in order. Pieces of expired workers are added by the scans.
+  vector<CKPT_PIECE> got;
+  while (got.size() < nbPiece && cursor < nbChunk) {
+    uint64_t c = cursor++;
+    int r = queue->Claim(c);
+    if (r < 0)
+      return -1;
+    if (r == 0)
+      continue;
+    CKPT_PIECE pc;
+    pc.chunk = c;
+    v->getChunk(c, pc.start, pc.end);
+    got.push_back(pc);
+    claims.insert(c);
+  }
+
+  v->addPieces(got);
+  return (int)got.size();
+
+}
+
+void QueueLink::scan() {
+
+  // Heartbeats are followed with the local clock, the clocks of the hosts may differ
+  double now = Timer::get_tick();
+  unordered_map<string, QUEUE_STATE> states;
+  queue->ReadStates(states);
+  for (auto it = states.begin(); it != states.end(); it++) {
+    QUEUE_PEER &p = peers[it->first];
+    if (p.seen == 0.0 || p.beat != it->second.beat) {
+      p.beat = it->second.beat;
+      p.seen = now;
+    }
+  }
+
+  // A worker without state yet expires from the first time it is seen
+  auto expired = [&](string &w) {
+    QUEUE_PEER &p = peers[w];
+    if (p.seen == 0.0) {
+      p.beat = 0;
+      p.seen = now;
+    }
+    auto st = states.find(w);
+    return (st != states.end() && st->second.ended) || now - p.seen >= (double)leaseTimeout;
+  };
+
+  // Chunks of the expired workers taken over from their last progress.
+  // Completed chunks are checked once, only the other claims are read.
+  vector<uint64_t> claimed;
+  queue->ListClaims(claimed);
+  vector<CKPT_PIECE> got;
+  for (int i = 0; i < (int)claimed.size(); i++) {
+
+    uint64_t c = claimed[i];
+    if (c >= nbChunk || done.count(c) > 0 || claims.count(c) > 0)
+      continue;
+    if (queue->IsDone(c)) {
+      done.insert(c);
+      continue;
+    }
+    string owner = queue->GetOwner(c);
+    if (owner.length() == 0 || owner == queue->id || !expired(owner))
+      continue;
+
+    // One takeover per owner and heartbeat. A worker which took the token
+    // and expired before replacing the claim is taken over in turn.
+    string token = owner + "." + to_string(peers[owner].beat);
+    string holder;
+    bool ok = false;
+    for (int j = 0; j < 4 && !ok; j++) {
+      ok = queue->Reclaim(c, owner, token, holder);
+      if (ok || holder.length() == 0 || holder == queue->id || !expired(holder))
+        break;
+      token += "." + holder + "." + to_string(peers[holder].beat);
+    }
+    if (!ok)
+      continue;
+    auto st = states.find(owner);
+
+    int nb = 0;
+    if (st != states.end()) {
+      for (int j = 0; j < (int)st->second.pieces.size(); j++) {
+        if (st->second.pieces[j].chunk == c) {
+          got.push_back(st->second.pieces[j]);
+          nb++;
+        }
+      }
+    }
+    if (nb == 0) {
+      CKPT_PIECE pc;
+      pc.chunk = c;
+      v->getChunk(c, pc.start, pc.end);
+      got.push_back(pc);
+    }
+    claims.insert(c);
+    printf("\nChunk %.0f of %s taken over\n", (double)c, owner.c_str());
+
+  }
+
+  v->addPieces(got);
+
+  progress = (double)done.size() / (double)nbChunk;
+  if (done.size() >= nbChunk)
+    ended = true;
+
+}
+
+bool QueueLink::report(bool last) {
+
+  // Results synced first, then the completed chunks, then the positions
+  vector<CKPT_PIECE> pieces;
+  vector<uint64_t> completed;
+  vector<string> found;
+  v->getLinkReport(pieces, completed, found);
+  for (int i = 0; i < (int)found.size(); i++)
+    found[i] += v->hasStartPubKey() ? " 1" : " 0";
+  if (!queue->AppendResults(found))
+    return false;
+
+  for (int i = 0; i < (int)completed.size(); i++) {
+    if (!queue->SetDone(completed[i]))
+      return false;
+    claims.erase(completed[i]);
+    done.insert(completed[i]);
+  }
+  progress = (double)done.size() / (double)nbChunk;
+
+  // Chunks taken over while this worker was stalled. A claim which cannot
+  // be read (file system error) is checked again at the next report.
+  vector<uint64_t> lost;
+  for (auto it = claims.begin(); it != claims.end(); it++) {
+    string owner = queue->GetOwner(*it);
+    if (owner.length() > 0 && owner != queue->id)
+      lost.push_back(*it);
+  }
+  for (int i = 0; i < (int)lost.size(); i++) {
+    v->revokeChunk(lost[i]);
+    claims.erase(lost[i]);
+  }
+
+  QUEUE_STATE st;
+  st.beat = ++beat;
+  st.ended = last;
+  for (int i = 0; i < (int)pieces.size(); i++)
+    if (claims.count(pieces[i].chunk) > 0)
+      st.pieces.push_back(pieces[i]);
+  if (!queue->WriteState(st))
+    return false;
+
+  double now = Timer::get_tick();
+  if (!last && now >= nextScan) {
+    scan();
+    double period = (double)leaseTimeout / 4.0;
+    if (period < LINK_REPORT_MS / 1000.0)
+      period = LINK_REPORT_MS / 1000.0;
+    nextScan = now + period;
+  }
+
+  return true;
+
+}
+
+void QueueLink::close(bool ok) {
+
+  if (!ok)
+    printf("\nError: job directory %s not usable\n", dir.c_str());
+
+}
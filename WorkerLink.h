@@ -0,0 +1,128 @@
+/*
+ * This file is part of the VanitySearch distribution (https://github.com/JeanLucPons/VanitySearch).
+ * Copyright (c) 2019 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WORKERLINKH
+#define WORKERLINKH
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <unordered_set>
+#include <unordered_map>
+#include "Vanity.h"
+#include "Net.h"
+#include "WorkQueue.h"
+
+#define LINK_REPORT_MS   1000    // Worker heartbeat, results and progress
+#define LINK_WAIT_MS     50      // Worker threads waiting for leases
+#define LINK_WINDOW      256     // Requests sent before reading their replies
+
+// Worker of a job directory, followed with the local clock
+typedef struct {
+
+  uint64_t beat;
+  double seen;       // Local time of the last beat change
+
+} QUEUE_PEER;
+
+// Worker of a shared job, feeds the range pool of the search with the pieces
+// of a coordinator or of a job directory, and reports from its own thread
+class WorkerLink {
+
+public:
+
+  WorkerLink(VanitySearch *v, uint32_t leaseTimeout);
+  virtual ~WorkerLink() {}
+
+  // Range and chunks of the job given to the search, false on failure (an error is printed)
+  virtual bool Open() = 0;
+
+  void Start();
+  void Stop();
+  void Run();
+
+  std::atomic<bool> ended;   // No more work from the coordinator or the directory
+  double progress;           // Completed chunks of the job
+
+protected:
+
+  // Number of pieces added to the pool, -1 on error
+  virtual int request(uint32_t nbPiece) = 0;
+  // Results, completed chunks and positions, the last one when the search ends
+  virtual bool report(bool last) = 0;
+  virtual void close(bool ok) = 0;
+
+  VanitySearch *v;
+  uint32_t leaseTimeout;
+  uint64_t nbChunk;
+  std::atomic<bool> stop;
+  THREAD_HANDLE thread;
+
+};
+
+// Pieces leased by a coordinator (Coordinator.h)
+class CoordLink : public WorkerLink {
+
+public:
+
+  CoordLink(VanitySearch *v, std::string addr, uint32_t leaseTimeout);
+  bool Open();
+
+protected:
+
+  int request(uint32_t nbPiece);
+  bool report(bool last);
+  void close(bool ok);
+
+private:
+
+  std::string addr;
+  NetSocket *s;
+  size_t known;          // Targets found received from the coordinator
+
+};
+
+// Chunks claimed in a job directory (WorkQueue.h)
+class QueueLink : public WorkerLink {
+
+public:
+
+  QueueLink(VanitySearch *v, std::string dir, uint32_t leaseTimeout);
+  bool Open();
+
+protected:
+
+  int request(uint32_t nbPiece);
+  bool report(bool last);
+  void close(bool ok);
+
+private:
+
+  void scan();
+
+  std::string dir;
+  WorkQueue *queue;
+  uint64_t cursor;                 // Next chunk to claim
+  uint64_t beat;
+  double nextScan;
+  std::unordered_set<uint64_t> claims;                 // Chunks claimed
+  std::unordered_set<uint64_t> done;                   // Chunks known completed
+  std::unordered_map<std::string, QUEUE_PEER> peers;   // Heartbeats of the other workers
+
+};
+
+#endif // WORKERLINKH
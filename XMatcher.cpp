@@ -0,0 +1,262 @@
+/*
+ * This file is part of the VanitySearch distribution (https://github.com/JeanLucPons/VanitySearch).
+ * Copyright (c) 2019 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "XMatcher.h"
+#include "SECP256k1.h"
+#include "Bech32.h"
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <algorithm>
+
+using namespace std;
+
+// ----------------------------------------------------------------------------
+
+XMatcher::XMatcher() {
+}
+
+// ----------------------------------------------------------------------------
+
+bool XMatcher::add(std::string &hex, int id) {
+
+  if (hex.length() < 3)
+    return false;
+
+  for (int i = 0; i < (int)hex.length(); i++)
+    if (!isxdigit(hex[i]))
+      return false;
+
+  int parity;
+  bool compressed = true;
+  string xStr = hex.substr(2);
+
+  if (hex[0] != '0')
+    return false;
+
+  switch (hex[1]) {
+  case '2':
+    parity = 0;
+    break;
+  case '3':
+    parity = 1;
+    break;
+  case '4':
+    // Uncompressed key, y given only with a full x
+    compressed = false;
+    parity = -1;
+    if (hex.length() == 130) {
+      parity = isdigit(hex[129]) ? (hex[129] - '0') & 1 : (tolower(hex[129]) - 'a' + 10) & 1;
+      xStr = hex.substr(2, 64);
+    }
+    break;
+  default:
+    return false;
+  }
+
+  if (xStr.length() > 64)
+    return false;
+
+  int nbBit = 4 * (int)xStr.length();
+  string padded = xStr;
+  while (padded.length() < 64)
+    padded.append("0");
+
+  Int x;
+  x.SetBase16((char *)padded.c_str());
+  add(hex, x, nbBit, parity, compressed, PUBKEY, id);
+
+  return true;
+
+}
+
+// ----------------------------------------------------------------------------
+
+bool XMatcher::addP2TR(std::string &addr, int id) {
+
+  string hrp = addr.substr(0, 4);
+  std::transform(hrp.begin(), hrp.end(), hrp.begin(), ::tolower);
+  if (addr.length() < 5 || hrp != "bc1p")
+    return false;
+
+  uint8_t data[64];
+  memset(data, 0, 64);
+  int nbBit;
+
+  if (addr.length() == 62) {
+
+    // Full address
+    int witver;
+    size_t witprog_len;
+    if (!segwit_addr_decode(&witver, data, &witprog_len, "bc", addr.c_str()) || witver != 1 || witprog_len != 32)
+      return false;
+    nbBit = 256;
+
+  } else {
+
+    if (addr.length() > 56)
+      return false;
+    size_t data_length;
+    if (!bech32_decode_nocheck(data, &data_length, addr.c_str() + 4))
+      return false;
+    nbBit = 5 * ((int)addr.length() - 4);
+    if (nbBit > 256) nbBit = 256;
+
+  }
+
+  Int x;
+  x.SetInt32(0);
+  for (int i = 0; i < 32; i++)
+    x.bits64[3 - i / 8] |= (uint64_t)data[i] << (56 - 8 * (i % 8));
+
+  // BIP340 x-only keys have an even y, the reported key is the even one
+  add(addr, x, nbBit, 0, true, P2TR, id);
+
+  return true;
+
+}
+
+// ----------------------------------------------------------------------------
+
+void XMatcher::add(std::string &str, Int &x, int nbBit, int parity, bool compressed, int type, int id) {
+
+  X_TARGET t;
+  t.str = str;
+  t.type = type;
+  for (int i = 0; i < 4; i++)
+    t.x[i] = x.bits64[i];
+  t.nbBit = nbBit;
+  t.parity = parity;
+  t.compressed = compressed;
+
+  // y and -y share the same x, the parity selects one of them
+  t.difficulty = pow(2.0, nbBit + ((parity >= 0) ? 1 : 0));
+
+  t.lo = t.x[3];
+  t.hi = t.x[3];
+  if (nbBit < 64) {
+    uint64_t mask = (nbBit == 0) ? 0xFFFFFFFFFFFFFFFFULL : (0xFFFFFFFFFFFFFFFFULL >> nbBit);
+    t.lo &= ~mask;
+    t.hi = t.lo | mask;
+  }
+
+  if (id >= (int)indexOf.size())
+    indexOf.resize(id + 1, -1);
+  indexOf[id] = (int)targets.size();
+
+  targets.push_back(t);
+  targetIds.push_back(id);
+  active.push_back(1);
+
+}
+
+// ----------------------------------------------------------------------------
+
+void XMatcher::build() {
+
+  exact.clear();
+  prefixes.clear();
+  ranges.clear();
+
+  vector<X_RANGE> all;
+  for (int i = 0; i < (int)targets.size(); i++) {
+    if (targets[i].nbBit >= 64) {
+      exact.insert(std::make_pair(targets[i].x[3], i));
+    } else {
+      prefixes.push_back(i);
+      X_RANGE r;
+      r.lo = targets[i].lo;
+      r.hi = targets[i].hi;
+      all.push_back(r);
+    }
+  }
+
+  // Merge intervals
+  sort(all.begin(), all.end(), [](const X_RANGE &a, const X_RANGE &b) { return a.lo < b.lo; });
+  for (int i = 0; i < (int)all.size(); i++) {
+    if (ranges.size() > 0 && (ranges.back().hi == 0xFFFFFFFFFFFFFFFFULL || all[i].lo <= ranges.back().hi + 1)) {
+      if (all[i].hi > ranges.back().hi)
+        ranges.back().hi = all[i].hi;
+    } else {
+      ranges.push_back(all[i]);
+    }
+  }
+
+}
+
+// ----------------------------------------------------------------------------
+
+bool XMatcher::isMatching(X_TARGET &t, Int *x) {
+
+  int nbBit = t.nbBit;
+  for (int w = 3; w >= 0 && nbBit > 0; w--) {
+    uint64_t mask = (nbBit >= 64) ? 0xFFFFFFFFFFFFFFFFULL : ~(0xFFFFFFFFFFFFFFFFULL >> nbBit);
+    if ((x->bits64[w] & mask) != t.x[w])
+      return false;
+    nbBit -= 64;
+  }
+
+  return true;
+
+}
+
+void XMatcher::match(Int *x, std::vector<int> &ids) {
+
+  uint64_t x64 = x->bits64[3];
+
+  if (exact.size() > 0) {
+    auto r = exact.equal_range(x64);
+    for (auto it = r.first; it != r.second; it++) {
+      int i = it->second;
+      if (active[i] && isMatching(targets[i], x))
+        ids.push_back(targetIds[i]);
+    }
+  }
+
+  for (int j = 0; j < (int)prefixes.size(); j++) {
+    int i = prefixes[j];
+    if (active[i] && x64 >= targets[i].lo && x64 <= targets[i].hi)
+      ids.push_back(targetIds[i]);
+  }
+
+}
+
+// ----------------------------------------------------------------------------
+
+void XMatcher::remove(int id) {
+  active[indexOf[id]] = 0;
+}
+
+X_TARGET &XMatcher::get(int id) {
+  return targets[indexOf[id]];
+}
+
+int XMatcher::getSize() {
+  return (int)targets.size();
+}
+
+double XMatcher::getDifficulty() {
+
+  // Most probable target still searched
+  double min = pow(2.0, 257);
+  for (int i = 0; i < (int)targets.size(); i++)
+    if (active[i] && targets[i].difficulty < min)
+      min = targets[i].difficulty;
+
+  return min;
+
+}
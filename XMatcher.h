@@ -0,0 +1,107 @@
+/*
+ * This file is part of the VanitySearch distribution (https://github.com/JeanLucPons/VanitySearch).
+ * Copyright (c) 2019 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef XMATCHERH
+#define XMATCHERH
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include "Int.h"
+
+// Target on the x coordinate of a public key
+typedef struct {
+
+  std::string str;
+  int type;           // PUBKEY or P2TR
+  uint64_t x[4];      // x (or x prefix), same word order as Int::bits64
+  int nbBit;          // Prefix length in bits, 256 for a full x
+  int parity;         // Required y parity (0 even, 1 odd), -1 for both
+  bool compressed;
+  uint64_t lo;        // Inclusive interval on the 64 upper bits of x
+  uint64_t hi;
+  double difficulty;
+
+} X_TARGET;
+
+// Inclusive interval on the 64 upper bits of x
+typedef struct {
+
+  uint64_t lo;
+  uint64_t hi;
+
+} X_RANGE;
+
+class XMatcher {
+
+public:
+
+  XMatcher();
+
+  // Adds a full public key or a public key hex prefix (02, 03 or 04 followed
+  // by up to 64 hex digits of x, or a full 130 digits uncompressed key)
+  bool add(std::string &hex, int id);
+
+  // Adds a taproot address or address prefix (bc1p followed by x in bech32)
+  bool addP2TR(std::string &addr, int id);
+
+  // Adds x bits prefix of the given length
+  void add(std::string &str, Int &x, int nbBit, int parity, bool compressed, int type, int id);
+
+  // Must be called once all targets are added
+  void build();
+
+  // Necessary condition on the 64 upper bits of x
+  inline bool preFilter(uint64_t x64) {
+    if (exact.size() > 0 && exact.find(x64) != exact.end())
+      return true;
+    int a = 0;
+    int b = (int)ranges.size();
+    while (a < b) {
+      int m = (a + b) / 2;
+      if (ranges[m].lo <= x64) a = m + 1;
+      else b = m;
+    }
+    return a > 0 && x64 <= ranges[a - 1].hi;
+  }
+
+  // Appends the ids of the active targets matching x (y parity not checked)
+  void match(Int *x, std::vector<int> &ids);
+
+  // Removes a target from the search (no rebuild)
+  void remove(int id);
+
+  X_TARGET &get(int id);
+  int getSize();
+  double getDifficulty();
+
+private:
+
+  bool isMatching(X_TARGET &t, Int *x);
+
+  std::vector<X_TARGET> targets;
+  std::vector<int> targetIds;
+  std::vector<int> indexOf;                        // Target index of an id, -1 if none
+  std::vector<uint8_t> active;
+  std::unordered_multimap<uint64_t, int> exact;   // Targets with at least 64 bits
+  std::vector<int> prefixes;                       // Shorter prefixes
+  std::vector<X_RANGE> ranges;                     // Merged intervals of shorter prefixes
+
+};
+
+#endif // XMATCHERH
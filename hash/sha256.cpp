@@ -484,7 +484,9 @@ void sha256_checksum(uint8_t *input, int length, uint8_t *checksum) {
   uint8_t b[64];
   memcpy(b,input,length);
   memcpy(b + length, _sha256::pad, 56-length);
-  WRITEBE64(b + 56, length << 3);
+  // Length written through memcpy (uint64_t store aliased with uint32_t loads in Transform2)
+  uint64_t sizedesc = _byteswap_uint64((uint64_t)length << 3);
+  memcpy(b + 56, &sizedesc, 8);
   _sha256::Transform2(s, b);
   WRITEBE32(checksum,s[0]);
 
@@ -17,10 +17,14 @@
 
 #include "Timer.h"
 #include "Vanity.h"
+#include "Coordinator.h"
+#include "WorkQueue.h"
+#include "BSGS.h"
 #include "SECP256k1.h"
 #include <fstream>
 #include <string>
 #include <string.h>
+#include <ctype.h>
 #include <stdexcept>
 #include "hash/sha512.h"
 #include "hash/sha256.h"
@@ -37,8 +41,16 @@ void printUsage() {
   printf("             [-gpuId gpuId1[,gpuId2,...]] [-g g1x,g1y,[,g2x,g2y,...]]\n");
   printf("             [-o outputfile] [-m maxFound] [-ps seed] [-s seed] [-t nbThread]\n");
   printf("             [-nosse] [-r rekey] [-check] [-kp] [-sp startPubKey]\n");
-  printf("             [-rp privkey partialkeyfile] [-rg rangeStart,rangeEnd] [-kt keysPerThread] [prefix]\n\n");
+  printf("             [-rp privkey partialkeyfile] [-rg rangeStart,rangeEnd] [-strict] [-random]\n");
+  printf("             [-chunk bits]\n");
+  printf("             [-harvest csv|bin] [-of text|jsonl|csv] [-fsync none|N|Tms] [-si statsInterval]\n");
+  printf("             [-numa] [-ctl controlfile]\n");
+  printf("             [-ckpt file] [-ckpti interval] [-resume]\n");
+  printf("             [-coord address] [-worker address] [-lease timeout]\n");
+  printf("             [-queue dir] [-merge dir] [-bsgs] [-bsgsm bits] [-bsgsfile file] [prefix]\n\n");
   printf(" prefix: prefix to search (Can contains wildcard '?' or '*')\n");
+  printf("         or public key hex prefix (02, 03 or 04 followed by x digits, no hashing)\n");
+  printf("         or bc1p prefix (taproot, untweaked x-only output key)\n");
   printf(" -v: Print version\n");
   printf(" -u: Search uncompressed addresses\n");
   printf(" -b: Search both uncompressed or compressed addresses\n");
@@ -47,12 +59,14 @@ void printUsage() {
   printf(" -stop: Stop when all prefixes are found\n");
   printf(" -i inputfile: Get list of prefixes to search from specified file\n");
   printf(" -o outputfile: Output results to the specified file\n");
+  printf(" -of text|jsonl|csv: Output record format, default is text\n");
+  printf(" -fsync none|N|Tms: Sync outputfile to disk every N records or every T ms, default is none\n");
   printf(" -gpu gpuId1,gpuId2,...: List of GPU(s) to use, default is 0\n");
   printf(" -g g1x,g1y,g2x,g2y, ...: Specify GPU(s) kernel gridsize, default is 8*(MP number),128\n");
   printf(" -m: Specify maximun number of prefixes found by each kernel call\n");
   printf(" -s seed: Specify a seed for the base key, default is random\n");
   printf(" -ps seed: Specify a seed concatened with a crypto secure random seed\n");
-  printf(" -t threadNumber: Specify number of CPU thread, default is number of core\n");
+  printf(" -t threadNumber: Specify number of CPU thread, default is number of usable core (affinity, cgroup quota)\n");
   printf(" -nosse: Disable SSE hash function\n");
   printf(" -l: List cuda enabled devices\n");
   printf(" -check: Check CPU and GPU kernel vs CPU\n");
@@ -62,8 +76,25 @@ void printUsage() {
   printf(" -rp privkey partialkeyfile: Reconstruct final private key(s) from partial key(s) info.\n");
   printf(" -sp startPubKey: Start the search with a pubKey (for private key splitting)\n");
   printf(" -r rekey: Rekey interval in MegaKey, default is disabled\n");
-  printf(" -rg rangeStart,rangeEnd: Range of keys to search specified as start,end values\n");
-  printf(" -kt keysPerThread: Number of keys processed by each thread in a loop, default is 50000000\n");
+  printf(" -rg rangeStart,rangeEnd: Range of private keys to search, inclusive hex start,end values (start >= 1) split between the threads\n");
+  printf(" -strict: Range-strict mode, only the keys of the range are checked (no endomorphism nor symmetry)\n");
+  printf(" -random: Search random chunks of the range, each chunk once (use -ckpt to keep the coverage)\n");
+  printf(" -chunk bits: Range chunks of 2^bits keys (%d to 62), default is 2^20 keys\n", RANGE_CHUNK_BITS);
+  printf(" -si statsInterval: Interval between two stats lines in ms, default is 2000\n");
+  printf(" -numa: Pin threads over the NUMA nodes, with node local copies of the search tables\n");
+  printf(" -ctl controlfile: Number of CPU thread read from controlfile at each stats interval (live resize)\n");
+  printf(" -ckpt file: Save search progress to file periodically and at exit\n");
+  printf(" -ckpti interval: Checkpoint interval in seconds, default is %d\n", CHECKPOINT_INTERVAL);
+  printf(" -resume: Resume the search from the checkpoint file (same targets and options needed)\n");
+  printf(" -coord address: Coordinator of the range (-rg) given to workers, host:port or unix:path\n");
+  printf(" -worker address: Search the work units leased by the coordinator at address\n");
+  printf(" -lease timeout: Seconds without heartbeat before the work units of a worker are reassigned, default is %d\n", LEASE_TIMEOUT);
+  printf(" -queue dir: Search the chunks claimed in a shared job directory, the first worker needs -rg\n");
+  printf(" -merge dir: Write the results of the workers of a job directory to outputfile, without duplicates\n");
+  printf(" -bsgs: Baby-step giant-step search of the private keys of full public keys (prefix or -i) in the range (-rg)\n");
+  printf(" -bsgsm bits: 2^bits baby steps (max %d), default is about sqrt(range size * number of keys / 2) up to 2^%d\n", BSGS_MAX_BITS, BSGS_AUTO_BITS);
+  printf(" -bsgsfile file: Keep the baby steps in a memory mapped file, reused by the next runs with the same explicit -bsgsm\n");
+  printf(" -harvest csv|bin: Write all prefix matches to outputfile as CSV or 56 bytes binary records (needs -o)\n");
   exit(0);
 
 }
@@ -91,6 +122,27 @@ int getInt(string name,char *v) {
 
 // ------------------------------------------------------------------------------------------
 
+void getHexInt(string name, Int &v, string text) {
+
+  // 256 bits hex value, optional 0x
+  if (text.length() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X'))
+    text = text.substr(2);
+  if (text.length() == 0 || text.length() > 64) {
+    printf("Invalid %s argument, hex number of 1 to 64 digits expected\n", name.c_str());
+    exit(-1);
+  }
+  for (int i = 0; i < (int)text.length(); i++) {
+    if (!isxdigit(text[i])) {
+      printf("Invalid %s argument, hex number expected\n", name.c_str());
+      exit(-1);
+    }
+  }
+  v.SetBase16((char *)text.c_str());
+
+}
+
+// ------------------------------------------------------------------------------------------
+
 void getInts(string name,vector<int> &tokens, const string &text, char sep) {
 
   size_t start = 0, end = 0;
@@ -200,43 +252,6 @@ void generateKeyPair(Secp256K1 *secp, string seed, int searchMode,bool paranoiac
 
 // ------------------------------------------------------------------------------------------
 
-void outputAdd(string outputFile, int addrType, string addr, string pAddr, string pAddrHex) {
-
-  FILE *f = stdout;
-  bool needToClose = false;
-
-  if (outputFile.length() > 0) {
-    f = fopen(outputFile.c_str(), "a");
-    if (f == NULL) {
-      printf("Cannot open %s for writing\n", outputFile.c_str());
-      f = stdout;
-    } else {
-      needToClose = true;
-    }
-  }
-
-  fprintf(f, "\nPub Addr: %s\n", addr.c_str());
-
-
-  switch (addrType) {
-  case P2PKH:
-    fprintf(f, "Priv (WIF): p2pkh:%s\n", pAddr.c_str());
-    break;
-  case P2SH:
-    fprintf(f, "Priv (WIF): p2wpkh-p2sh:%s\n", pAddr.c_str());
-    break;
-  case BECH32:
-    fprintf(f, "Priv (WIF): p2wpkh:%s\n", pAddr.c_str());
-    break;
-  }
-  fprintf(f, "Priv (HEX): 0x%s\n", pAddrHex.c_str());
-
-  if (needToClose)
-    fclose(f);
-
-}
-
-// ------------------------------------------------------------------------------------------
 #define CHECK_ADDR()                                           \
   fullPriv.ModAddK1order(&e, &partialPrivKey);                 \
   p = secp->ComputePublicKey(&fullPriv);                       \
@@ -245,10 +260,10 @@ void outputAdd(string outputFile, int addrType, string addr, string pAddr, strin
     found = true;                                              \
     string pAddr = secp->GetPrivAddress(compressed, fullPriv); \
     string pAddrHex = fullPriv.GetBase16();                    \
-    outputAdd(outputFile, addrType, addr, pAddr, pAddrHex);    \
+    writer->write(addrType, addr, pAddr, pAddrHex, false);     \
   }
 
-void reconstructAdd(Secp256K1 *secp, string fileName, string outputFile, string privAddr) {
+void reconstructAdd(Secp256K1 *secp, string fileName, ResultWriter *writer, string privAddr) {
 
   bool compressed;
   int addrType;
@@ -261,8 +276,14 @@ void reconstructAdd(Secp256K1 *secp, string fileName, string outputFile, string
   if(privKey.IsNegative())
     exit(-1);
 
+  vector<string> allLines;
   vector<string> lines;
-  parseFile(fileName,lines);
+  parseFile(fileName,allLines);
+
+  // Address type lines are informative only
+  for (int i = 0; i < (int)allLines.size(); i++)
+    if (allLines[i].substr(0, 6) != "Type: ")
+      lines.push_back(allLines[i]);
 
   for (int i = 0; i < (int)lines.size(); i+=2) {
 
@@ -280,7 +301,7 @@ void reconstructAdd(Secp256K1 *secp, string fileName, string outputFile, string
         addrType = P2SH; break;
       case 'b':
       case 'B':
-        addrType = BECH32; break;
+        addrType = (tolower(addr.data()[3]) == 'p') ? P2TR : BECH32; break;
       default:
         printf("Invalid partialkey info file at line %d\n", i);
         printf("%s Address format not supported\n", addr.c_str());
@@ -367,6 +388,44 @@ void reconstructAdd(Secp256K1 *secp, string fileName, string outputFile, string
 
 // ------------------------------------------------------------------------------------------
 
+void mergeResults(string dir, ResultWriter *writer) {
+
+  // Result files of the workers of a job directory, a key searched twice
+  // (chunk taken over) is written once
+  vector<string> lines;
+  int nbFile;
+  if (!WorkQueue::ReadResults(dir, lines, nbFile))
+    exit(-1);
+
+  unordered_set<string> seen;
+  int nbDup = 0;
+  int nbBad = 0;
+  for (int i = 0; i < (int)lines.size(); i++) {
+    char addr[256];
+    char wif[256];
+    char hex[256];
+    int type;
+    int partial;
+    if (sscanf(lines[i].c_str(), "%d %255s %255s %255s %d", &type, addr, wif, hex, &partial) != 5 ||
+        type < 0 || type > P2TR) {
+      nbBad++;
+      continue;
+    }
+    if (!seen.insert(string(addr) + " " + string(hex)).second) {
+      nbDup++;
+      continue;
+    }
+    writer->write(type, string(addr), string(wif), string(hex), partial != 0);
+  }
+  writer->close();
+
+  printf("Merged %d results from %d workers (%d duplicates, %d invalid lines)\n",
+    (int)seen.size(), nbFile, nbDup, nbBad);
+
+}
+
+// ------------------------------------------------------------------------------------------
+
 int main(int argc, char* argv[]) {
 
   // Global Init
@@ -392,6 +451,9 @@ int main(int argc, char* argv[]) {
   string seed = "";
   vector<string> prefix;
   string outputFile = "";
+  int outputFormat = RESULT_TEXT;
+  int fsyncMode = FSYNC_NONE;
+  uint32_t fsyncValue = 0;
   int nbCPUThread = Timer::getCoreNumber();
   bool tSpecified = false;
   bool sse = true;
@@ -402,9 +464,28 @@ int main(int argc, char* argv[]) {
   bool startPubKeyCompressed;
   bool caseSensitive = true;
   bool paranoiacSeed = false;
-  uint32_t rangeStart = 0;
-  uint32_t rangeEnd = 0;
-  uint32_t keysPerThread = 50000000;
+  Int rangeStart;
+  Int rangeEnd;
+  rangeStart.SetInt32(0);
+  rangeEnd.SetInt32(0);
+  int harvest = HARVEST_NONE;
+  uint32_t statsInterval = STATS_INTERVAL;
+  bool useNuma = false;
+  bool rangeStrict = false;
+  bool rangeRandom = false;
+  int chunkBits = 0;
+  string ckptFile = "";
+  uint32_t ckptInterval = CHECKPOINT_INTERVAL;
+  bool resume = false;
+  string ctlFile = "";
+  string coordAddr = "";
+  string workerAddr = "";
+  uint32_t leaseTimeout = LEASE_TIMEOUT;
+  string queueDir = "";
+  string mergeDir = "";
+  bool bsgs = false;
+  int bsgsBits = 0;
+  string bsgsFile = "";
 
   while (a < argc) {
 
@@ -428,6 +509,7 @@ int main(int argc, char* argv[]) {
 
       Int::Check();
       secp->Check();
+      VanitySearch::CheckGroup(secp);
 
 #ifdef WITHGPU
       if (gridSize.size() == 0) {
@@ -490,7 +572,10 @@ int main(int argc, char* argv[]) {
       a++;
       string file = string(argv[a]);
       a++;
-      reconstructAdd(secp,file,outputFile,priv);
+      ResultWriter *writer = new ResultWriter(outputFile, outputFormat, fsyncMode, fsyncValue, false);
+      writer->setAddressLabel("Pub Addr: ");
+      reconstructAdd(secp,file,writer,priv);
+      writer->close();
       exit(0);
     } else if (strcmp(argv[a], "-u") == 0) {
       searchMode = SEARCH_UNCOMPRESSED;
@@ -518,6 +603,37 @@ int main(int argc, char* argv[]) {
       a++;
       outputFile = string(argv[a]);
       a++;
+    } else if (strcmp(argv[a], "-of") == 0) {
+      a++;
+      if (strcmp(argv[a], "text") == 0) {
+        outputFormat = RESULT_TEXT;
+      } else if (strcmp(argv[a], "jsonl") == 0) {
+        outputFormat = RESULT_JSONL;
+      } else if (strcmp(argv[a], "csv") == 0) {
+        outputFormat = RESULT_CSV;
+      } else {
+        printf("Error: -of param must be text, jsonl or csv\n");
+        exit(-1);
+      }
+      a++;
+    } else if (strcmp(argv[a], "-fsync") == 0) {
+      // none, every N records or every T ms
+      a++;
+      string v = string(argv[a]);
+      if (v == "none") {
+        fsyncMode = FSYNC_NONE;
+      } else if (v.length() > 2 && v.substr(v.length() - 2) == "ms") {
+        fsyncMode = FSYNC_TIME;
+        fsyncValue = getInt("fsync", (char *)v.substr(0, v.length() - 2).c_str());
+      } else {
+        fsyncMode = FSYNC_RECORDS;
+        fsyncValue = getInt("fsync", argv[a]);
+      }
+      if (fsyncMode != FSYNC_NONE && (int)fsyncValue <= 0) {
+        printf("Error: -fsync param must be none, N or Tms with N,T > 0\n");
+        exit(-1);
+      }
+      a++;
     } else if (strcmp(argv[a], "-i") == 0) {
       a++;
       parseFile(string(argv[a]),prefix);
@@ -536,21 +652,116 @@ int main(int argc, char* argv[]) {
       rekey = (uint64_t)getInt("rekey", argv[a]);
       a++;
     } else if (strcmp(argv[a], "-rg") == 0) {
-      // Range start,end
+      // Range start,end (hex)
       a++;
-      vector<int> values;
-      getInts("range", values, string(argv[a]), ',');
-      if (values.size() != 2) {
+      string rg = string(argv[a]);
+      size_t sep = rg.find(',');
+      if (sep == string::npos) {
         printf("Error: -rg param must have the format start,end\n");
         exit(-1);
       }
-      rangeStart = values[0];
-      rangeEnd = values[1];
+      getHexInt("rangeStart", rangeStart, rg.substr(0, sep));
+      getHexInt("rangeEnd", rangeEnd, rg.substr(sep + 1));
       a++;
     } else if (strcmp(argv[a], "-kt") == 0) {
-      // Keys per thread
+      // Replaced by the range parts, kept for existing command lines
+      printf("Warning: -kt is deprecated and ignored, the range is split between the threads\n");
+      a += 2;
+    } else if (strcmp(argv[a], "-ctl") == 0) {
+      a++;
+      ctlFile = string(argv[a]);
+      a++;
+    } else if (strcmp(argv[a], "-strict") == 0) {
+      rangeStrict = true;
+      a++;
+    } else if (strcmp(argv[a], "-random") == 0) {
+      rangeRandom = true;
+      a++;
+    } else if (strcmp(argv[a], "-chunk") == 0) {
+      a++;
+      chunkBits = getInt("chunkBits", argv[a]);
+      if (chunkBits < RANGE_CHUNK_BITS || chunkBits > 62) {
+        printf("Error: -chunk param must be in [%d,62]\n", RANGE_CHUNK_BITS);
+        exit(-1);
+      }
+      a++;
+    } else if (strcmp(argv[a], "-ckpt") == 0) {
+      a++;
+      ckptFile = string(argv[a]);
       a++;
-      keysPerThread = getInt("keysPerThread", argv[a]);
+    } else if (strcmp(argv[a], "-ckpti") == 0) {
+      // Checkpoint interval
+      a++;
+      ckptInterval = getInt("ckptInterval", argv[a]);
+      if ((int)ckptInterval <= 0) {
+        printf("Error: -ckpti param must be > 0\n");
+        exit(-1);
+      }
+      a++;
+    } else if (strcmp(argv[a], "-resume") == 0) {
+      resume = true;
+      a++;
+    } else if (strcmp(argv[a], "-coord") == 0) {
+      a++;
+      coordAddr = string(argv[a]);
+      a++;
+    } else if (strcmp(argv[a], "-worker") == 0) {
+      a++;
+      workerAddr = string(argv[a]);
+      a++;
+    } else if (strcmp(argv[a], "-queue") == 0) {
+      a++;
+      queueDir = string(argv[a]);
+      a++;
+    } else if (strcmp(argv[a], "-merge") == 0) {
+      a++;
+      mergeDir = string(argv[a]);
+      a++;
+    } else if (strcmp(argv[a], "-bsgs") == 0) {
+      bsgs = true;
+      a++;
+    } else if (strcmp(argv[a], "-bsgsm") == 0) {
+      a++;
+      bsgsBits = getInt("bsgsBits", argv[a]);
+      if (bsgsBits <= 0 || bsgsBits > BSGS_MAX_BITS) {
+        printf("Error: -bsgsm param must be in [1,%d]\n", BSGS_MAX_BITS);
+        exit(-1);
+      }
+      a++;
+    } else if (strcmp(argv[a], "-bsgsfile") == 0) {
+      a++;
+      bsgsFile = string(argv[a]);
+      a++;
+    } else if (strcmp(argv[a], "-lease") == 0) {
+      a++;
+      leaseTimeout = getInt("leaseTimeout", argv[a]);
+      if ((int)leaseTimeout <= 0) {
+        printf("Error: -lease param must be > 0\n");
+        exit(-1);
+      }
+      a++;
+    } else if (strcmp(argv[a], "-numa") == 0) {
+      useNuma = true;
+      a++;
+    } else if (strcmp(argv[a], "-si") == 0) {
+      // Stats interval
+      a++;
+      statsInterval = getInt("statsInterval", argv[a]);
+      if ((int)statsInterval <= 0) {
+        printf("Error: -si param must be > 0\n");
+        exit(-1);
+      }
+      a++;
+    } else if (strcmp(argv[a], "-harvest") == 0) {
+      a++;
+      if (strcmp(argv[a], "csv") == 0) {
+        harvest = HARVEST_CSV;
+      } else if (strcmp(argv[a], "bin") == 0) {
+        harvest = HARVEST_BIN;
+      } else {
+        printf("Error: -harvest param must be csv or bin\n");
+        exit(-1);
+      }
       a++;
     } else if (strcmp(argv[a], "-h") == 0) {
       printUsage();
@@ -576,6 +787,60 @@ int main(int argc, char* argv[]) {
     exit(-1);
   }
 
+  if (mergeDir.length() > 0) {
+    ResultWriter *writer = new ResultWriter(outputFile, outputFormat, fsyncMode, fsyncValue, false);
+    mergeResults(mergeDir, writer);
+    exit(0);
+  }
+
+  if (bsgs) {
+    if (rangeEnd.IsZero() || gpuEnable || rangeRandom || ckptFile.length() > 0 || harvest != HARVEST_NONE ||
+        !startPuKey.isZero() || coordAddr.length() > 0 || workerAddr.length() > 0 || queueDir.length() > 0) {
+      printf("Error: -bsgs needs a range (-rg) and runs on CPU threads only, without -random, -ckpt, -harvest, -sp, -coord, -worker or -queue\n");
+      exit(-1);
+    }
+    ResultWriter *writer = new ResultWriter(outputFile, outputFormat, fsyncMode, fsyncValue, false);
+    BSGS *b = new BSGS(secp, prefix, rangeStart, rangeEnd, bsgsBits, bsgsFile, writer, statsInterval);
+    b->Search(nbCPUThread);
+    delete b;
+    exit(ResultWriter::getSignal() ? 128 + ResultWriter::getSignal() : 0);
+  }
+
+  if (harvest != HARVEST_NONE && outputFile.length() == 0) {
+    printf("Error: -harvest needs an output file (-o)\n");
+    exit(-1);
+  }
+
+  if (resume && ckptFile.length() == 0) {
+    printf("Error: -resume needs a checkpoint file (-ckpt)\n");
+    exit(-1);
+  }
+
+  if (rangeStrict && rangeEnd.IsZero() && workerAddr.length() == 0 && queueDir.length() == 0) {
+    printf("Error: -strict needs a range (-rg)\n");
+    exit(-1);
+  }
+
+  if (coordAddr.length() > 0 && (rangeEnd.IsZero() || workerAddr.length() > 0 || queueDir.length() > 0)) {
+    printf("Error: -coord needs a range (-rg) and cannot be a worker\n");
+    exit(-1);
+  }
+
+  if (workerAddr.length() > 0 && (!rangeEnd.IsZero() || rangeRandom || ckptFile.length() > 0 || harvest != HARVEST_NONE)) {
+    printf("Error: the range, its order and checkpoints of a worker (-rg, -random, -ckpt) are the ones of its coordinator, -harvest is not supported\n");
+    exit(-1);
+  }
+
+  if (queueDir.length() > 0 && (workerAddr.length() > 0 || rangeRandom || ckptFile.length() > 0 || harvest != HARVEST_NONE)) {
+    printf("Error: the job directory keeps the progress of its workers (no -ckpt), -worker, -random and -harvest are not supported\n");
+    exit(-1);
+  }
+
+  if (rangeRandom && rangeEnd.IsZero()) {
+    printf("Error: -random needs a range (-rg)\n");
+    exit(-1);
+  }
+
   // Let one CPU core free per gpu is gpu is enabled
   // It will avoid to hang the system
   if( !tSpecified && nbCPUThread>1 && gpuEnable)
@@ -588,9 +853,18 @@ int main(int argc, char* argv[]) {
     searchMode = (startPubKeyCompressed)?SEARCH_COMPRESSED:SEARCH_UNCOMPRESSED;
   }
 
-  VanitySearch *v = new VanitySearch(secp, prefix, seed, searchMode, gpuEnable, stop, outputFile, sse,
-    maxFound, rekey, caseSensitive, startPuKey, paranoiacSeed, rangeStart, rangeEnd, keysPerThread);
-  v->Search(nbCPUThread,gpuId,gridSize);
+  ResultWriter *writer = new ResultWriter(outputFile, outputFormat, fsyncMode, fsyncValue, harvest == HARVEST_BIN);
+
+  VanitySearch *v = new VanitySearch(secp, prefix, seed, searchMode, gpuEnable, stop, writer, sse,
+    maxFound, rekey, caseSensitive, startPuKey, paranoiacSeed, rangeStart, rangeEnd, rangeStrict,
+    rangeRandom, chunkBits, harvest, statsInterval, useNuma, ctlFile, ckptFile, ckptInterval, resume,
+    coordAddr, workerAddr, queueDir, leaseTimeout);
+  if (coordAddr.length() > 0)
+    v->Coordinate();
+  else
+    v->Search(nbCPUThread,gpuId,gridSize);
 
-  return 0;
+  // Stopped by a signal
+  int sig = ResultWriter::getSignal();
+  return sig ? 128 + sig : 0;
 }